@@ -4,11 +4,27 @@
 #include <cstdlib>
 #include <iterator>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "signature.hpp"
 #include "delta.hpp"
+#include "local_delta.hpp"
 #include "patch.hpp"
+#include "mapped_file.hpp"
+#include "random_access_file.hpp"
+#include "tree.hpp"
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 struct command_line_arguments
 {
@@ -17,7 +33,16 @@ struct command_line_arguments
 	std::string second_file;
 	std::string third_file;
 	size_t chunk_size{ 100 };
+	bool chunk_size_given{ false };
+	size_t strong_hash_length{ rd::default_strong_hash_length };
+	size_t num_threads{ 1 };
 	bool print_progress{ false };
+	bool use_mmap{ true };
+	bool use_cdc{ false };
+	bool in_place{ false };
+	std::string basis_file; // old file for extending chunks of delta
+	rd::codec literal_codec{ rd::codec::none };
+	std::string stats_format; // empty, "text" or "json"
 };
 
 command_line_arguments show_usage(char* program_name)
@@ -26,11 +51,31 @@ command_line_arguments show_usage(char* program_name)
 		<< "\tsignature old-file signature-file \n"
 		<< "\tdelta signature-file new-file delta-file \n"
 		<< "\tpatch old-file delta-file gen-file \n"
+		<< "\tdiff old-file new-file delta-file \n"
+		<< "\tsignature-tree old-dir signature-archive \n"
+		<< "\tdelta-tree signature-archive new-dir delta-archive \n"
+		<< "\tpatch-tree old-dir delta-archive gen-dir \n"
 		<< "\t-h,--help\t\tShow this help message.\n"
 		<< "\n"
+		<< "File '-' is the standard input or output, only one input of a command can be the standard input.\n"
+		<< "The old file of patch has to be a regular file.\n"
+		<< "\n"
 		<< "Options:\n"
-		<< "\t-c,--chunk\t\tSize of chunks in bytes. Default is 100.\n"
-		<< "\t-v,--verbose\t\tShow progress."
+		<< "\t-c,--chunk\t\tSize of chunks in bytes, average size with --cdc. Default is 100.\n"
+		<< "\t\t\t\tdiff: length of the indexed blocks of the old file, runs of at least twice the length\n"
+		<< "\t\t\t\tare always found. Default is 16.\n"
+		<< "\t--cdc\t\t\tCut the old file into content-defined chunks, from 1/4 to 4 times the chunk size long.\n"
+		<< "\t-s,--strong\t\tLength of the strong hash of every chunk in bytes (0-64). 0 turns it off. Default is 16.\n"
+		<< "\t-t,--threads\t\tNumber of threads used for creating signature and delta. 0 means all hardware threads. Default is 1.\n"
+		<< "\t--no-mmap\t\tRead and write files through streams instead of mapping them into memory.\n"
+		<< "\t--in-place\t\tdelta: create delta that can be applied in place, on one thread. Chunks shifted by insertions and\n"
+		<< "\t\t\t\tdeletions are moved, blocks that trade places cost the data of one of them.\n"
+		<< "\t\t\t\tpatch: rewrite the old file in place, only changed regions are written. The patched file has to be the old file.\n"
+		<< "\t--basis old-file\tdelta: extend matched chunks byte by byte against the old file, the delta copies any range of it.\n"
+		<< "\t--compress[=zstd]\tdelta, delta-tree: compress literal data of deltas in blocks by the built-in LZ codec, or by zstd\n"
+		<< "\t\t\t\tif it was available when the program was built. Patch detects compressed deltas by itself.\n"
+		<< "\t--stats[=json]\t\tPrint counters and time of every phase to the standard error, as text or JSON.\n"
+		<< "\t-v,--verbose\t\tShow processed bytes, throughput and remaining time on the standard error."
 		<< std::endl;
 
 	return command_line_arguments{};
@@ -60,13 +105,25 @@ command_line_arguments process_arguments(int argc, char** argv)
 				if (i + 1 < argc)
 				{
 					result.chunk_size = std::stoul(argv[++i]);
+					result.chunk_size_given = true;
+				}
+				else
+				{
+					return show_usage(argv[0]);
+				}
+			}
+			else if ((arg == "-s") || (arg == "--strong"))
+			{
+				if (i + 1 < argc)
+				{
+					result.strong_hash_length = std::stoul(argv[++i]);
 				}
 				else
 				{
 					return show_usage(argv[0]);
 				}
 			}
-			else if (arg == "signature")
+			else if ((arg == "signature") || (arg == "signature-tree"))
 			{
 				if (i + 2 < argc)
 				{
@@ -79,7 +136,7 @@ command_line_arguments process_arguments(int argc, char** argv)
 					return show_usage(argv[0]);
 				}
 			}
-			else if (arg == "delta")
+			else if ((arg == "delta") || (arg == "delta-tree"))
 			{
 				if (i + 3 < argc)
 				{
@@ -93,7 +150,7 @@ command_line_arguments process_arguments(int argc, char** argv)
 					return show_usage(argv[0]);
 				}
 			}
-			else if (arg == "patch")
+			else if ((arg == "patch") || (arg == "patch-tree") || (arg == "diff"))
 			{
 				if (i + 3 < argc)
 				{
@@ -107,6 +164,56 @@ command_line_arguments process_arguments(int argc, char** argv)
 					return show_usage(argv[0]);
 				}
 			}
+			else if ((arg == "-t") || (arg == "--threads"))
+			{
+				if (i + 1 < argc)
+				{
+					result.num_threads = std::stoul(argv[++i]);
+				}
+				else
+				{
+					return show_usage(argv[0]);
+				}
+			}
+			else if (arg == "--cdc")
+			{
+				result.use_cdc = true;
+			}
+			else if (arg == "--no-mmap")
+			{
+				result.use_mmap = false;
+			}
+			else if (arg == "--in-place")
+			{
+				result.in_place = true;
+			}
+			else if (arg == "--basis")
+			{
+				if (i + 1 < argc)
+				{
+					result.basis_file = argv[++i];
+				}
+				else
+				{
+					return show_usage(argv[0]);
+				}
+			}
+			else if ((arg == "--compress") || (arg == "--compress=lz"))
+			{
+				result.literal_codec = rd::codec::lz;
+			}
+			else if (arg == "--compress=zstd")
+			{
+				result.literal_codec = rd::codec::zstd;
+			}
+			else if ((arg == "--stats") || (arg == "--stats=text"))
+			{
+				result.stats_format = "text";
+			}
+			else if (arg == "--stats=json")
+			{
+				result.stats_format = "json";
+			}
 			else if ((arg == "-v") || (arg == "--verbose"))
 			{
 				result.print_progress = true;
@@ -125,100 +232,716 @@ command_line_arguments process_arguments(int argc, char** argv)
 	return result;
 }
 
+/// <summary>
+/// Counters and phase times of one command, printed to the standard error by --stats
+/// </summary>
+class stats_report
+{
+public:
+	explicit stats_report(std::string command)
+		: command(std::move(command))
+	{
+	}
+
+	void add(const std::string& name, size_t value)
+	{
+		values.emplace_back(name, std::to_string(value));
+	}
+
+	void add_seconds(const std::string& name, double seconds)
+	{
+		std::ostringstream value;
+		value.precision(6);
+		value << std::fixed << seconds;
+		values.emplace_back(name + "_seconds", value.str());
+	}
+
+	void print(const std::string& format) const
+	{
+		if (format == "json")
+		{
+			std::cerr << "{\"command\": \"" << command << "\"";
+			for (const auto& value : values)
+			{
+				std::cerr << ", \"" << value.first << "\": " << value.second;
+			}
+			std::cerr << "}" << std::endl;
+		}
+		else
+		{
+			std::cerr << "Statistics of " << command << ":\n";
+			for (const auto& value : values)
+			{
+				std::cerr << "\t" << value.first << ": " << value.second << "\n";
+			}
+			std::cerr << std::flush;
+		}
+	}
+
+private:
+	std::string command;
+	std::vector<std::pair<std::string, std::string>> values;
+};
+
+/// <summary>
+/// Measures wall time of consecutive phases of a command
+/// </summary>
+class phase_timer
+{
+public:
+	/// <summary>
+	/// Returns seconds since the previous call (or since construction) and starts the next phase
+	/// </summary>
+	double next_phase()
+	{
+		const auto now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(now - phase_start).count();
+		phase_start = now;
+		return seconds;
+	}
+
+private:
+	std::chrono::steady_clock::time_point phase_start{ std::chrono::steady_clock::now() };
+};
+
+/// <summary>
+/// Renders progress reported by the library on one line of the standard error: processed bytes, throughput and ETA.
+/// The line is redrawn at most a few times per second.
+/// </summary>
+class progress_printer
+{
+public:
+	explicit progress_printer(std::string label)
+		: label(std::move(label))
+	{
+	}
+
+	/// <summary>
+	/// Returns the callback for the library, empty if progress is not printed so that the library doesn't report anything
+	/// </summary>
+	rd::progress_callback callback(bool enabled)
+	{
+		if (!enabled)
+		{
+			return nullptr;
+		}
+
+		return [this](size_t bytes_done, size_t bytes_total) { print(bytes_done, bytes_total); };
+	}
+
+private:
+	void print(size_t bytes_done, size_t bytes_total)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		// total of data read from a pipe is not known until its end, then the library reports bytes_done == bytes_total
+		const bool done = bytes_done == bytes_total;
+		if (!done && now - last_print < std::chrono::milliseconds(200))
+		{
+			return;
+		}
+		last_print = now;
+
+		const double seconds = std::chrono::duration<double>(now - start).count();
+		const double bytes_per_second = seconds > 0 ? bytes_done / seconds : 0;
+		char line[160];
+		if (done)
+		{
+			std::snprintf(line, sizeof(line), "\r%s: %.1f MB, %.1f MB/s, done in %.1f s   \n", label.c_str(),
+				bytes_done / 1e6, bytes_per_second / 1e6, seconds);
+		}
+		else if (bytes_total == 0)
+		{
+			std::snprintf(line, sizeof(line), "\r%s: %.1f MB, %.1f MB/s   ", label.c_str(),
+				bytes_done / 1e6, bytes_per_second / 1e6);
+		}
+		else
+		{
+			const double eta = bytes_per_second > 0 ? (bytes_total - bytes_done) / bytes_per_second : 0;
+			std::snprintf(line, sizeof(line), "\r%s: %.1f / %.1f MB (%.0f%%), %.1f MB/s, ETA %.0f s   ", label.c_str(),
+				bytes_done / 1e6, bytes_total / 1e6, 100.0 * bytes_done / bytes_total, bytes_per_second / 1e6, eta);
+		}
+		std::cerr << line << std::flush;
+	}
+
+	std::string label;
+	std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+	std::chrono::steady_clock::time_point last_print{};
+};
+
+/// <summary>
+/// Returns the standard input for file name "-", opens the file otherwise
+/// </summary>
+std::istream& open_input(const std::string& file_name, std::ifstream& file, const std::string& description)
+{
+	if (file_name == "-")
+	{
+		return std::cin;
+	}
+
+	file.open(file_name, std::ios_base::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Unable to open " + description + "!");
+	}
+	return file;
+}
+
+/// <summary>
+/// Content of a whole file in memory, mapped if possible and read otherwise
+/// </summary>
+struct whole_file
+{
+	rd::mapped_file mapping;
+	std::vector<char> buffer;
+	const char* data{ nullptr };
+	size_t length{ 0 };
+};
+
+/// <summary>
+/// Maps the file into memory, or reads it in blocks until its end if it can't be mapped or it is the standard input
+/// </summary>
+void load_whole_file(const std::string& file_name, bool use_mmap, whole_file& file, const std::string& description)
+{
+	if (use_mmap && file_name != "-" && file.mapping.open_read(file_name))
+	{
+		file.data = file.mapping.data();
+		file.length = file.mapping.size();
+		return;
+	}
+
+	std::ifstream input_file;
+	auto& input = open_input(file_name, input_file, description);
+	constexpr size_t block_length = 1 << 20;
+	while (input)
+	{
+		const size_t length = file.buffer.size();
+		file.buffer.resize(length + block_length);
+		input.read(file.buffer.data() + length, block_length);
+		file.buffer.resize(length + static_cast<size_t>(input.gcount()));
+	}
+	if (input.bad())
+	{
+		throw std::runtime_error("Unable to read " + description + "!");
+	}
+	file.data = file.buffer.data();
+	file.length = file.buffer.size();
+}
+
+/// <summary>
+/// Returns the standard output for file name "-", creates the file otherwise
+/// </summary>
+std::ostream& open_output(const std::string& file_name, std::ofstream& file, const std::string& description)
+{
+	if (file_name == "-")
+	{
+		return std::cout;
+	}
+
+	file.open(file_name, std::ios_base::binary | std::ios_base::trunc);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Unable to open " + description + "!");
+	}
+	return file;
+}
 
-void create_signature(const command_line_arguments& cla)
+bool create_signature(const command_line_arguments& cla)
 {
 	try
 	{
+		rd::cdc_parameters cdc;
+		if (cla.use_cdc)
+		{
+			cdc.min_length = std::max<size_t>(1, cla.chunk_size / 4);
+			cdc.average_length = cla.chunk_size;
+			cdc.max_length = cla.chunk_size * 4;
+		}
+
 		// create signature
-		std::ifstream old_file(cla.first_file, std::ios_base::binary);
-		if (!old_file.is_open())
+		phase_timer timer;
+		progress_printer printer("signature");
+		const auto progress = printer.callback(cla.print_progress);
+		double load_seconds = 0;
+		rd::signature old_file_signature;
+		rd::mapped_file old_mapping;
+		if (cla.use_mmap && cla.first_file != "-" && old_mapping.open_read(cla.first_file))
 		{
-			throw std::runtime_error("Unable to open old file!");
+			load_seconds = timer.next_phase();
+			if (cla.use_cdc)
+			{
+				old_file_signature = rd::calculate_signature_cdc_parallel(
+					old_mapping.data(), old_mapping.size(), cdc, cla.strong_hash_length, cla.num_threads, progress);
+			}
+			else
+			{
+				old_file_signature = rd::calculate_signature_parallel(
+					old_mapping.data(), old_mapping.size(), cla.chunk_size, cla.strong_hash_length, cla.num_threads, progress);
+			}
 		}
-		old_file.seekg(0, old_file.end);
-		size_t old_file_size = old_file.tellg();
-		old_file.seekg(0, old_file.beg);
-		auto old_file_signature = rd::calculate_signature<std::istreambuf_iterator<char>>(
-			std::istreambuf_iterator<char>(old_file), old_file_size, cla.chunk_size);
+		else
+		{
+			// the old file is read in blocks until its end, its size doesn't have to be known
+			std::ifstream old_file;
+			auto& old_input = open_input(cla.first_file, old_file, "old file");
+			load_seconds = timer.next_phase();
+			if (cla.use_cdc)
+			{
+				old_file_signature = rd::calculate_signature_cdc_stream(old_input, cdc, cla.strong_hash_length, progress);
+			}
+			else
+			{
+				old_file_signature = rd::calculate_signature_stream(old_input, cla.chunk_size, cla.strong_hash_length, progress);
+			}
+		}
+
+		const double hash_seconds = timer.next_phase();
 
 		// save signature to file
-		std::ofstream signature_file(cla.second_file, std::ios_base::binary);
-		rd::signature::write_to_binary_file(signature_file, old_file_signature);
+		std::ofstream signature_file;
+		auto& signature_output = open_output(cla.second_file, signature_file, "signature file");
+		rd::signature::write_to_binary_file(signature_output, old_file_signature);
+		signature_output.flush();
+		signature_file.close();
+
+		if (!cla.stats_format.empty())
+		{
+			const auto& chunks = old_file_signature.chunks;
+			stats_report report("signature");
+			report.add("bytes", chunks.empty() ? 0 : chunks.back().start_position + chunks.back().length);
+			report.add("chunks", chunks.size());
+			report.add_seconds("load", load_seconds);
+			report.add_seconds("hash", hash_seconds);
+			report.add_seconds("write", timer.next_phase());
+			report.print(cla.stats_format);
+		}
+
+		return true;
 	}
 	catch (const std::exception& e)
 	{
 		std::cerr << "Error while creating signature for file '" << cla.first_file << "': " << e.what() << std::endl;
+		return false;
 	}
 }
 
-void create_delta(const command_line_arguments& cla)
+bool create_delta(const command_line_arguments& cla)
 {
 	try
 	{
-		// load signature
-		std::ifstream signature_file(cla.first_file, std::ios_base::binary);
-		if (!signature_file.is_open())
+		if (cla.first_file == "-" && cla.second_file == "-")
 		{
-			throw std::runtime_error("Unable to open signature file!");
+			throw std::invalid_argument("Signature file and new file can't both be the standard input!");
 		}
+
+		// load signature, mapped signature file is used in place
+		phase_timer timer;
+		rd::mapped_signature mapped_signature_;
 		rd::signature signature_;
-		rd::signature::read_from_binary_file(signature_file, signature_);
+		rd::signature_view signature_view_;
+		if (cla.use_mmap && cla.first_file != "-" && mapped_signature_.open(cla.first_file))
+		{
+			signature_view_ = mapped_signature_.view();
+		}
+		else
+		{
+			std::ifstream signature_file;
+			rd::signature::read_from_binary_file(open_input(cla.first_file, signature_file, "signature file"), signature_);
+			signature_view_ = signature_;
+		}
+
+		// load new file and write delta to file while it is being calculated,
+		// a streamed delta is written if the output can't seek back to the header
+		std::ofstream delta_file;
+		auto& delta_output = open_output(cla.third_file, delta_file, "delta file");
+		rd::delta_writer writer(delta_output, cla.literal_codec);
+		// deltas applicable in place are calculated sequentially because every chunk depends on the instructions before it
+		rd::in_place_sink<rd::delta_writer> in_place_writer(writer);
+
+		// old file is used for extending the chunks byte by byte, it has to be read as a whole
+		whole_file basis;
+		if (!cla.basis_file.empty())
+		{
+			if (cla.in_place)
+			{
+				throw std::invalid_argument("Chunks can't be extended with --in-place!");
+			}
+			if (cla.basis_file == "-")
+			{
+				throw std::invalid_argument("Basis file can't be the standard input!");
+			}
+			load_whole_file(cla.basis_file, cla.use_mmap, basis, "basis file");
+		}
+		rd::match_extender<rd::delta_writer> extending_writer(writer, basis.data, basis.length);
+
+		double load_seconds = 0;
+		progress_printer printer("delta");
+		const auto progress = printer.callback(cla.print_progress);
+		const auto calculate = [&](auto& sink)
+		{
+			constexpr bool sequential = std::is_same_v<std::decay_t<decltype(sink)>, rd::in_place_sink<rd::delta_writer>>;
+			rd::mapped_file new_mapping;
+			if (cla.use_mmap && cla.second_file != "-" && new_mapping.open_read(cla.second_file))
+			{
+				load_seconds = timer.next_phase();
+				if constexpr (!sequential)
+				{
+					if (cla.num_threads != 1)
+					{
+						return rd::calculate_delta_parallel(signature_view_, new_mapping.data(), new_mapping.size(), sink, cla.num_threads, 0, progress);
+					}
+				}
+				return rd::calculate_delta<const char*>(signature_view_, new_mapping.data(), new_mapping.size(), sink, progress);
+			}
+
+			// the new file is read in blocks until its end, its size doesn't have to be known
+			std::ifstream new_file;
+			auto& new_input = open_input(cla.second_file, new_file, "new file");
+			load_seconds = timer.next_phase();
+			return rd::calculate_delta_stream(signature_view_, new_input, sink, progress);
+		};
+
+		rd::delta_stats stats;
+		if (cla.in_place)
+		{
+			stats = calculate(in_place_writer);
+		}
+		else if (!cla.basis_file.empty())
+		{
+			stats = calculate(extending_writer);
+		}
+		else
+		{
+			stats = calculate(writer);
+		}
 
-		// load new file
-		std::ifstream new_file(cla.second_file, std::ios_base::binary);
-		if (!new_file.is_open())
+		// index and scan are timed by the library, instructions are written during the scan and the rest is written by finish
+		timer.next_phase();
+		extending_writer.finish();
+		writer.finish();
+		delta_output.flush();
+		delta_file.close();
+		stats.load_seconds = load_seconds;
+		stats.write_seconds = timer.next_phase();
+		// bytes are counted before the chunks are extended, extended bytes are copied instead of written as data
+		stats.literal_bytes -= extending_writer.extended_bytes();
+		stats.matched_bytes += extending_writer.extended_bytes();
+
+		if (!cla.stats_format.empty())
 		{
-			throw std::runtime_error("Unable to open new file!");
+			stats_report report("delta");
+			report.add("bytes_scanned", stats.bytes_scanned);
+			report.add("weak_probes", stats.weak_probes);
+			report.add("weak_hits", stats.weak_hits);
+			report.add("strong_confirmations", stats.strong_confirmations);
+			report.add("false_positives", stats.false_positives);
+			report.add("literal_bytes", stats.literal_bytes);
+			report.add("matched_bytes", stats.matched_bytes);
+			report.add("zero_bytes", stats.zero_bytes);
+			report.add("extended_bytes", extending_writer.extended_bytes());
+			report.add_seconds("load", stats.load_seconds);
+			report.add_seconds("index", stats.index_seconds);
+			report.add_seconds("scan", stats.scan_seconds);
+			report.add_seconds("write", stats.write_seconds);
+			report.print(cla.stats_format);
 		}
-		new_file.seekg(0, new_file.end);
-		size_t new_file_size = new_file.tellg();
-		new_file.seekg(0, new_file.beg);
 
-		// create delta and save it to file
-		rd::delta delta_ = rd::calculate_delta<std::istreambuf_iterator<char>>(signature_, std::istreambuf_iterator<char>(new_file), new_file_size);
-		std::ofstream delta_file(cla.third_file, std::ios_base::binary);
-		rd::delta::write_to_binary_file(delta_file, delta_);
+		return true;
 	}
 	catch (const std::exception& e)
 	{
 		std::cerr << "Error while creating delta from signature file '" << cla.first_file 
 			<< "' and new file '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
+
+bool create_local_delta(const command_line_arguments& cla)
+{
+	try
+	{
+		if (cla.first_file == "-" && cla.second_file == "-")
+		{
+			throw std::invalid_argument("Old file and new file can't both be the standard input!");
+		}
+		if (cla.in_place)
+		{
+			throw std::invalid_argument("Delta of two files can't be created with --in-place!");
+		}
+
+		// both files are needed as a whole, the old file is indexed and the new file is searched in it
+		phase_timer timer;
+		whole_file old_file;
+		whole_file new_file;
+		load_whole_file(cla.first_file, cla.use_mmap, old_file, "old file");
+		load_whole_file(cla.second_file, cla.use_mmap, new_file, "new file");
+		const double load_seconds = timer.next_phase();
+
+		std::ofstream delta_file;
+		auto& delta_output = open_output(cla.third_file, delta_file, "delta file");
+		rd::delta_writer writer(delta_output, cla.literal_codec);
+		rd::local_delta_options options;
+		if (cla.chunk_size_given)
+		{
+			options.block_length = cla.chunk_size;
+		}
+		progress_printer printer("diff");
+		auto stats = rd::calculate_local_delta(old_file.data, old_file.length, new_file.data, new_file.length, writer,
+			options, printer.callback(cla.print_progress));
+
+		timer.next_phase();
+		writer.finish();
+		delta_output.flush();
+		delta_file.close();
+		stats.load_seconds = load_seconds;
+		stats.write_seconds = timer.next_phase();
+
+		if (!cla.stats_format.empty())
+		{
+			stats_report report("diff");
+			report.add("bytes_scanned", stats.bytes_scanned);
+			report.add("weak_probes", stats.weak_probes);
+			report.add("weak_hits", stats.weak_hits);
+			report.add("strong_confirmations", stats.strong_confirmations);
+			report.add("false_positives", stats.false_positives);
+			report.add("literal_bytes", stats.literal_bytes);
+			report.add("matched_bytes", stats.matched_bytes);
+			report.add("zero_bytes", stats.zero_bytes);
+			report.add_seconds("load", stats.load_seconds);
+			report.add_seconds("index", stats.index_seconds);
+			report.add_seconds("scan", stats.scan_seconds);
+			report.add_seconds("write", stats.write_seconds);
+			report.print(cla.stats_format);
+		}
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error while creating delta from old file '" << cla.first_file
+			<< "' and new file '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
 	}
 }
 
-void create_patch(const command_line_arguments& cla)
+bool create_patch(const command_line_arguments& cla)
 {
 	try
 	{
-		// load old file
-		std::ifstream old_file(cla.first_file, std::ios_base::binary);
-		if (!old_file.is_open())
+		// load old file, instructions can copy chunks from anywhere so it can't be a pipe
+		if (cla.first_file == "-")
+		{
+			throw std::invalid_argument("Old file can't be the standard input!");
+		}
+		// the patched file is created before the old file is read, so it would destroy the data the delta copies from
+		std::error_code error;
+		if (cla.third_file != "-" && std::filesystem::equivalent(cla.first_file, cla.third_file, error))
+		{
+			throw std::invalid_argument("Patched file can't be the old file, use --in-place to patch it!");
+		}
+		phase_timer timer;
+		rd::mapped_file old_mapping;
+		rd::random_access_file old_file;
+		const bool old_file_mapped = cla.use_mmap && old_mapping.open_read(cla.first_file);
+		if (!old_file_mapped && !old_file.open(cla.first_file))
 		{
 			throw std::runtime_error("Unable to open old file!");
 		}
 
 		// load delta
-		std::ifstream delta_file(cla.second_file, std::ios_base::binary);
-		if (!old_file.is_open())
+		std::ifstream delta_file;
+		// instructions are read while patching
+		rd::delta_reader reader(open_input(cla.second_file, delta_file, "delta file"));
+		const double load_seconds = timer.next_phase();
+
+		// patch old file and save it
+		progress_printer printer("patch");
+		const auto progress = printer.callback(cla.print_progress);
+		// length of a streamed delta is known only at its end so it is written through a stream like standard output
+		rd::mapped_file patch_mapping;
+		if (cla.use_mmap && cla.third_file != "-" && !reader.is_streamed() && patch_mapping.create(cla.third_file, reader.data_length()))
+		{
+			if (old_file_mapped)
+			{
+				rd::patch<char*>(old_mapping.data(), old_mapping.size(), reader, patch_mapping.data(), progress);
+			}
+			else
+			{
+				rd::patch<char*>(old_file, reader, patch_mapping.data(), progress);
+			}
+		}
+		else
 		{
-			throw std::runtime_error("Unable to open delta file!");
+			std::ofstream patch_file;
+			auto& patch_output = open_output(cla.third_file, patch_file, "patched file");
+			if (old_file_mapped)
+			{
+				rd::patch<std::ostreambuf_iterator<char>>(
+					old_mapping.data(), old_mapping.size(), reader, std::ostreambuf_iterator<char>(patch_output), progress);
+			}
+			else
+			{
+				rd::patch<std::ostreambuf_iterator<char>>(
+					old_file, reader, std::ostreambuf_iterator<char>(patch_output), progress);
+			}
+			patch_output.flush();
 		}
-		rd::delta delta_;
-		rd::delta::read_from_binary_file(delta_file, delta_);
 
-		// patch old file and save it
-		std::ofstream patch_file(cla.third_file, std::ios_base::binary);
-		rd::patch<std::ostreambuf_iterator<char>>(
-			old_file, delta_, std::ostreambuf_iterator<char>(patch_file));
+		if (!cla.stats_format.empty())
+		{
+			// patched data is written while the instructions are applied
+			stats_report report("patch");
+			report.add("bytes", reader.data_length());
+			report.add("instructions", reader.num_instructions());
+			report.add_seconds("load", load_seconds);
+			report.add_seconds("patch", timer.next_phase());
+			report.print(cla.stats_format);
+		}
+
+		return true;
 	}
 	catch (const std::exception& e)
 	{
 		std::cerr << "Error while creating patch from old file '" << cla.first_file
 			<< "' and delta '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
+
+bool create_patch_in_place(const command_line_arguments& cla)
+{
+	try
+	{
+		if (cla.third_file != cla.first_file)
+		{
+			throw std::invalid_argument("Patched file has to be the old file with --in-place!");
+		}
+
+		// delta is checked before the old file is changed, so it has to be read twice
+		phase_timer timer;
+		std::ifstream delta_file;
+		auto& delta_input = open_input(cla.second_file, delta_file, "delta file");
+		progress_printer printer("patch");
+		const auto stats = rd::patch_in_place(cla.first_file, delta_input, printer.callback(cla.print_progress));
+
+		if (!cla.stats_format.empty())
+		{
+			stats_report report("patch");
+			report.add("bytes", stats.data_length);
+			report.add("bytes_written", stats.bytes_written);
+			report.add("bytes_read", stats.bytes_read);
+			report.add("zero_bytes", stats.zero_bytes);
+			report.add_seconds("patch", timer.next_phase());
+			report.print(cla.stats_format);
+		}
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error while patching file '" << cla.first_file << "' in place with delta '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
+
+rd::tree_options make_tree_options(const command_line_arguments& cla)
+{
+	rd::tree_options options;
+	options.chunk_length = cla.chunk_size;
+	if (cla.use_cdc)
+	{
+		options.cdc.min_length = std::max<size_t>(1, cla.chunk_size / 4);
+		options.cdc.average_length = cla.chunk_size;
+		options.cdc.max_length = cla.chunk_size * 4;
+	}
+	options.strong_hash_length = cla.strong_hash_length;
+	options.num_threads = cla.num_threads;
+	options.literal_codec = cla.literal_codec;
+
+	return options;
+}
+
+void print_tree_stats(const command_line_arguments& cla, const rd::tree_stats& stats, double seconds)
+{
+	if (!cla.stats_format.empty())
+	{
+		stats_report report(cla.command);
+		report.add("files", stats.files);
+		report.add("unchanged_files", stats.unchanged_files);
+		report.add("changed_files", stats.changed_files);
+		report.add("removed_files", stats.removed_files);
+		report.add("bytes", stats.bytes);
+		report.add_seconds("total", seconds);
+		report.print(cla.stats_format);
 	}
 }
 
+bool create_signature_tree(const command_line_arguments& cla)
+{
+	try
+	{
+		phase_timer timer;
+		std::ofstream archive(cla.second_file, std::ios_base::binary);
+		if (!archive.is_open())
+		{
+			throw std::runtime_error("Unable to open signature archive!");
+		}
+		const auto stats = rd::signature_tree(cla.first_file, archive, make_tree_options(cla));
+		archive.close();
+
+		print_tree_stats(cla, stats, timer.next_phase());
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error while creating signatures of directory '" << cla.first_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
+
+bool create_delta_tree(const command_line_arguments& cla)
+{
+	try
+	{
+		phase_timer timer;
+		std::ofstream archive(cla.third_file, std::ios_base::binary);
+		if (!archive.is_open())
+		{
+			throw std::runtime_error("Unable to open delta archive!");
+		}
+		const auto stats = rd::delta_tree(cla.first_file, cla.second_file, archive, make_tree_options(cla));
+		archive.close();
+
+		print_tree_stats(cla, stats, timer.next_phase());
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error while creating deltas from signature archive '" << cla.first_file
+			<< "' and directory '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
+
+bool create_patch_tree(const command_line_arguments& cla)
+{
+	try
+	{
+		phase_timer timer;
+		const auto stats = rd::patch_tree(cla.first_file, cla.second_file, cla.third_file, make_tree_options(cla));
+
+		print_tree_stats(cla, stats, timer.next_phase());
+
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error while patching directory '" << cla.first_file
+			<< "' with delta archive '" << cla.second_file << "': " << e.what() << std::endl;
+		return false;
+	}
+}
 
 int main(int argc, char** argv)
 {
@@ -228,12 +951,21 @@ int main(int argc, char** argv)
 		return EXIT_SUCCESS;
 	}
 
+	// files can be piped through the standard streams, they are only used for binary data
+	std::ios_base::sync_with_stdio(false);
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	// failures are reported by the exit code too, so commands can be chained in scripts and pipelines
+	bool succeeded = true;
 	if (cla.command == "signature")
 	{
 		assert(cla.first_file.length() > 0);
 		assert(cla.second_file.length() > 0);
 
-		create_signature(cla);
+		succeeded = create_signature(cla);
 	}
 
 	if (cla.command == "delta")
@@ -242,7 +974,7 @@ int main(int argc, char** argv)
 		assert(cla.second_file.length() > 0);
 		assert(cla.third_file.length() > 0);
 
-		create_delta(cla);
+		succeeded = create_delta(cla);
 	}
 
 	if (cla.command == "patch")
@@ -251,8 +983,50 @@ int main(int argc, char** argv)
 		assert(cla.second_file.length() > 0);
 		assert(cla.third_file.length() > 0);
 
-		create_patch(cla);
+		if (cla.in_place)
+		{
+			succeeded = create_patch_in_place(cla);
+		}
+		else
+		{
+			succeeded = create_patch(cla);
+		}
+	}
+
+	if (cla.command == "diff")
+	{
+		assert(cla.first_file.length() > 0);
+		assert(cla.second_file.length() > 0);
+		assert(cla.third_file.length() > 0);
+
+		succeeded = create_local_delta(cla);
+	}
+
+	if (cla.command == "signature-tree")
+	{
+		assert(cla.first_file.length() > 0);
+		assert(cla.second_file.length() > 0);
+
+		succeeded = create_signature_tree(cla);
+	}
+
+	if (cla.command == "delta-tree")
+	{
+		assert(cla.first_file.length() > 0);
+		assert(cla.second_file.length() > 0);
+		assert(cla.third_file.length() > 0);
+
+		succeeded = create_delta_tree(cla);
+	}
+
+	if (cla.command == "patch-tree")
+	{
+		assert(cla.first_file.length() > 0);
+		assert(cla.second_file.length() > 0);
+		assert(cla.third_file.length() > 0);
+
+		succeeded = create_patch_tree(cla);
 	}
 
-	return EXIT_SUCCESS;
+	return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 }
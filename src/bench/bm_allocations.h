@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+
+/// <summary>
+/// Number and total size of heap allocations made by the benchmark process, counted by operator new in main.cpp.
+/// </summary>
+struct allocation_counter
+{
+	static inline std::atomic<size_t> count{ 0 };
+	static inline std::atomic<size_t> bytes{ 0 };
+
+	allocation_counter()
+		: start_count(count), start_bytes(bytes)
+	{
+	}
+
+	size_t allocations() const { return count - start_count; }
+	size_t allocated_bytes() const { return bytes - start_bytes; }
+
+private:
+	size_t start_count;
+	size_t start_bytes;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/// <summary>
+/// Deterministic pseudo random data, the same seed always gives the same bytes on every platform.
+/// </summary>
+inline std::vector<char> make_random_data(size_t data_length, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::vector<char> result(data_length);
+	for (auto& byte : result)
+	{
+		byte = static_cast<char>(generator() & 0xff);
+	}
+
+	return result;
+}
+
+/// <summary>
+/// Deterministic text like a log, lines with a few words and numbers. It compresses about as well as source code or logs.
+/// </summary>
+inline std::vector<char> make_text_data(size_t data_length, uint32_t seed)
+{
+	static const char* const words[] = { "request", "response", "user", "status", "error", "value", "time", "id", "ok", "retry" };
+	std::mt19937 generator(seed);
+	std::vector<char> result;
+	result.reserve(data_length + 64);
+	while (result.size() < data_length)
+	{
+		const std::string line = std::string(words[generator() % 10]) + " " + words[generator() % 10] + "=" + std::to_string(generator() % 10000) + "\n";
+		result.insert(result.end(), line.begin(), line.end());
+	}
+	result.resize(data_length);
+
+	return result;
+}
+
+/// <summary>
+/// Copy of the given data with a few random bytes inserted every 'distance' bytes.
+/// Insertions shift the rest of the data so chunks have to be searched for at every offset.
+/// </summary>
+inline std::vector<char> make_data_with_inserts(const std::vector<char>& original, size_t distance, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::vector<char> result;
+	result.reserve(original.size() + original.size() / distance * 8);
+	for (size_t i = 0; i < original.size(); ++i)
+	{
+		if (i % distance == distance / 2)
+		{
+			const auto insert_length = 1 + generator() % 8;
+			for (size_t j = 0; j < insert_length; ++j)
+			{
+				result.push_back(static_cast<char>(generator() & 0xff));
+			}
+		}
+		result.push_back(original[i]);
+	}
+
+	return result;
+}
+
+/// <summary>
+/// Copy of the given data with a few bytes deleted every 'distance' bytes.
+/// </summary>
+inline std::vector<char> make_data_with_deletes(const std::vector<char>& original, size_t distance, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::vector<char> result;
+	result.reserve(original.size());
+	for (size_t i = 0; i < original.size(); ++i)
+	{
+		if (i % distance == distance / 2)
+		{
+			i += generator() % 8;
+			continue;
+		}
+		result.push_back(original[i]);
+	}
+
+	return result;
+}
+
+/// <summary>
+/// Copy of the given data with random data of the given length appended at the end.
+/// </summary>
+inline std::vector<char> make_data_with_append(const std::vector<char>& original, size_t append_length, uint32_t seed)
+{
+	auto result = original;
+	const auto appended = make_random_data(append_length, seed);
+	result.insert(result.end(), appended.cbegin(), appended.cend());
+
+	return result;
+}
+
+/// <summary>
+/// Copy of the given data with a few random bytes inserted at the beginning, so the whole data is shifted.
+/// </summary>
+inline std::vector<char> make_shifted_data(const std::vector<char>& original, size_t shift_length, uint32_t seed)
+{
+	auto result = make_random_data(shift_length, seed);
+	result.insert(result.end(), original.cbegin(), original.cend());
+
+	return result;
+}
+
+/// <summary>
+/// How the new data used by the benchmarks differs from the old data
+/// </summary>
+enum class data_shape
+{
+	identical,
+	inserts,
+	deletes,
+	appends,
+	shift,
+	random
+};
+
+inline const char* data_shape_name(data_shape shape)
+{
+	switch (shape)
+	{
+	case data_shape::identical: return "identical";
+	case data_shape::inserts: return "inserts";
+	case data_shape::deletes: return "deletes";
+	case data_shape::appends: return "appends";
+	case data_shape::shift: return "shift";
+	case data_shape::random: return "random";
+	}
+
+	return "unknown";
+}
+
+/// <summary>
+/// Deterministic new data of the given shape made from the old data.
+/// Inserts and deletes are a few bytes every 64 KB (or 16 times in small data), appends add 1/8 of the data
+/// and the shift inserts 3 bytes at the beginning.
+/// </summary>
+inline std::vector<char> make_new_data(data_shape shape, const std::vector<char>& old_data, uint32_t seed)
+{
+	const size_t distance = std::max<size_t>(64, std::min<size_t>(64 * 1024, old_data.size() / 16));
+	switch (shape)
+	{
+	case data_shape::identical: return old_data;
+	case data_shape::inserts: return make_data_with_inserts(old_data, distance, seed);
+	case data_shape::deletes: return make_data_with_deletes(old_data, distance, seed);
+	case data_shape::appends: return make_data_with_append(old_data, old_data.size() / 8, seed);
+	case data_shape::shift: return make_shifted_data(old_data, 3, seed);
+	case data_shape::random: return make_random_data(old_data.size(), seed);
+	}
+
+	return old_data;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include "hash.hpp"
+#include "checksum.hpp"
+#include "signature.hpp"
+#include "delta.hpp"
+#include "local_delta.hpp"
+#include "compression.hpp"
+#include "bm_data.h"
+#include "bm_allocations.h"
+
+#include <unordered_map>
+#include <vector>
+#include <sstream>
+
+
+// Cost of looking for a chunk at every offset of the data when the whole window is hashed again at every offset.
+// This is what calculate_delta did before it started rolling the checksum.
+static void bm_delta_window_rehash(benchmark::State& state)
+{
+	const size_t data_length = state.range(0);
+	const size_t chunk_length = state.range(1);
+	const auto data = make_random_data(data_length, 1);
+	const std::unordered_map<uint32_t, size_t> chunks{ { 0, 0 } };
+
+	for (auto _ : state)
+	{
+		size_t hits = 0;
+		for (size_t i = 0; i + chunk_length <= data_length; ++i)
+		{
+			hits += chunks.count(rd::compute_hash(data.data() + i, chunk_length));
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetBytesProcessed(state.iterations() * data_length);
+}
+
+// Cost of looking for a chunk at every offset of the data when the checksum is rolled through the data.
+static void bm_delta_window_rolling(benchmark::State& state)
+{
+	const size_t data_length = state.range(0);
+	const size_t chunk_length = state.range(1);
+	const auto data = make_random_data(data_length, 1);
+	const std::unordered_map<uint32_t, size_t> chunks{ { 0, 0 } };
+
+	for (auto _ : state)
+	{
+		size_t hits = 0;
+		rd::rolling_checksum checksum;
+		checksum.reset(data.data(), chunk_length);
+		for (size_t i = 0; i + chunk_length < data_length; ++i)
+		{
+			hits += chunks.count(checksum.value());
+			checksum.roll(data[i], data[i + chunk_length]);
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetBytesProcessed(state.iterations() * data_length);
+}
+
+// Whole delta calculation for data that has small inserts every 64 KB.
+static void bm_delta_calculate(benchmark::State& state)
+{
+	const size_t data_length = state.range(0);
+	const size_t chunk_length = state.range(1);
+	const auto old_data = make_random_data(data_length, 1);
+	const auto new_data = make_data_with_inserts(old_data, 64 * 1024, 2);
+	const auto sig = rd::calculate_signature(old_data.data(), old_data.size(), chunk_length);
+
+	for (auto _ : state)
+	{
+		auto del = rd::calculate_delta(sig, new_data.data(), new_data.size());
+		benchmark::DoNotOptimize(del.data_length);
+	}
+	state.SetBytesProcessed(state.iterations() * new_data.size());
+}
+
+// Delta of data with a small edit every 'distance' bytes, so it has many short literals.
+// Reports heap allocations and allocated bytes needed for calculating the delta and for reading it from a file.
+static void bm_delta_many_edits(benchmark::State& state)
+{
+	const size_t data_length = 4 << 20;
+	const size_t distance = state.range(0);
+	const auto old_data = make_random_data(data_length, 1);
+	const auto new_data = make_data_with_inserts(old_data, distance, 2);
+	const auto sig = rd::calculate_signature(old_data.data(), old_data.size(), 64);
+
+	size_t num_instructions = 0;
+	size_t calculate_allocations = 0;
+	size_t calculate_bytes = 0;
+	size_t read_allocations = 0;
+	size_t read_bytes = 0;
+	for (auto _ : state)
+	{
+		const allocation_counter calculate_counter;
+		auto del = rd::calculate_delta(sig, new_data.data(), new_data.size());
+		calculate_allocations += calculate_counter.allocations();
+		calculate_bytes += calculate_counter.allocated_bytes();
+		num_instructions = del.instructions.size();
+
+		state.PauseTiming();
+		std::stringstream delta_file;
+		rd::delta::write_to_binary_file(delta_file, del);
+		state.ResumeTiming();
+
+		const allocation_counter read_counter;
+		rd::delta read_delta;
+		rd::delta::read_from_binary_file(delta_file, read_delta);
+		read_allocations += read_counter.allocations();
+		read_bytes += read_counter.allocated_bytes();
+		benchmark::DoNotOptimize(read_delta.data_length);
+	}
+
+	state.counters["instructions"] = static_cast<double>(num_instructions);
+	state.counters["calculate_allocs"] = benchmark::Counter(static_cast<double>(calculate_allocations), benchmark::Counter::kAvgIterations);
+	state.counters["calculate_bytes"] = benchmark::Counter(static_cast<double>(calculate_bytes), benchmark::Counter::kAvgIterations, benchmark::Counter::kIs1024);
+	state.counters["read_allocs"] = benchmark::Counter(static_cast<double>(read_allocations), benchmark::Counter::kAvgIterations);
+	state.counters["read_bytes"] = benchmark::Counter(static_cast<double>(read_bytes), benchmark::Counter::kAvgIterations, benchmark::Counter::kIs1024);
+	state.SetBytesProcessed(state.iterations() * new_data.size());
+}
+
+// Delta of data with small inserts every 64 KB with chunks extended against the original data, the argument is the chunk length.
+// Reports the ratio of literal data to the new data, which stays low with long chunks that are faster to search for.
+static void bm_delta_extend_matches(benchmark::State& state)
+{
+	const size_t chunk_length = state.range(0);
+	const auto old_data = make_random_data(16 << 20, 1);
+	const auto new_data = make_data_with_inserts(old_data, 64 * 1024, 2);
+	const auto sig = rd::calculate_signature(old_data.data(), old_data.size(), chunk_length);
+
+	size_t literal_length = 0;
+	for (auto _ : state)
+	{
+		rd::delta del;
+		rd::delta_builder builder(del);
+		rd::match_extender<rd::delta_builder> extender(builder, old_data.data(), old_data.size());
+		rd::calculate_delta(sig, new_data.data(), new_data.size(), extender);
+		extender.finish();
+		literal_length = del.literals.size();
+	}
+	state.SetBytesProcessed(state.iterations() * new_data.size());
+	state.counters["literal_ratio"] = static_cast<double>(literal_length) / new_data.size();
+}
+
+// Delta of two local files without a signature, the arguments are the block length and 1 for small inserts every 64 KB or 0 for unrelated data.
+// Unrelated data is all literal data, so it shows the cost of looking up every position in the index of the old data.
+static void bm_delta_local(benchmark::State& state)
+{
+	const size_t block_length = state.range(0);
+	const auto old_data = make_random_data(16 << 20, 1);
+	const auto new_data = state.range(1) ? make_data_with_inserts(old_data, 64 * 1024, 2) : make_random_data(old_data.size(), 2);
+	rd::local_delta_options options;
+	options.block_length = block_length;
+
+	size_t literal_length = 0;
+	for (auto _ : state)
+	{
+		const auto del = rd::calculate_local_delta(old_data.data(), old_data.size(), new_data.data(), new_data.size(), options);
+		literal_length = del.literals.size();
+	}
+	state.SetBytesProcessed(state.iterations() * new_data.size());
+	state.counters["literal_ratio"] = static_cast<double>(literal_length) / new_data.size();
+}
+
+// Compression of literal blocks of a delta, the first argument is the codec and the second one is 1 for text and 0 for random data.
+static void bm_delta_compress_literals(benchmark::State& state)
+{
+	const auto literal_codec = static_cast<rd::codec>(state.range(0));
+	const auto data = state.range(1) ? make_text_data(4 << 20, 1) : make_random_data(4 << 20, 1);
+	if (!rd::is_codec_available(literal_codec))
+	{
+		state.SkipWithError("Codec is not available in this build");
+		return;
+	}
+
+	std::vector<char> compressed;
+	size_t compressed_length = 0;
+	for (auto _ : state)
+	{
+		compressed_length = 0;
+		for (size_t i = 0; i < data.size(); i += rd::delta_format::literal_block_length)
+		{
+			const size_t length = std::min(rd::delta_format::literal_block_length, data.size() - i);
+			compressed_length += rd::compress_block(literal_codec, data.data() + i, length, compressed) ? compressed.size() : length;
+		}
+		benchmark::DoNotOptimize(compressed.data());
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+	state.counters["ratio"] = static_cast<double>(data.size()) / compressed_length;
+}
+
+// Decompression of the literal blocks, the arguments are the same as above.
+static void bm_delta_decompress_literals(benchmark::State& state)
+{
+	const auto literal_codec = static_cast<rd::codec>(state.range(0));
+	const auto data = state.range(1) ? make_text_data(4 << 20, 1) : make_random_data(4 << 20, 1);
+	if (!rd::is_codec_available(literal_codec))
+	{
+		state.SkipWithError("Codec is not available in this build");
+		return;
+	}
+
+	std::vector<std::vector<char>> blocks;
+	for (size_t i = 0; i < data.size(); i += rd::delta_format::literal_block_length)
+	{
+		blocks.emplace_back();
+		rd::compress_block(literal_codec, data.data() + i, rd::delta_format::literal_block_length, blocks.back());
+	}
+
+	std::vector<char> decompressed(rd::delta_format::literal_block_length);
+	for (auto _ : state)
+	{
+		for (const auto& block : blocks)
+		{
+			rd::decompress_block(literal_codec, block.data(), block.size(), decompressed.data(), decompressed.size());
+		}
+		benchmark::DoNotOptimize(decompressed.data());
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+BENCHMARK(bm_delta_window_rehash)->ArgsProduct({ { 1 << 20 }, { 100, 1000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_window_rolling)->ArgsProduct({ { 1 << 20 }, { 100, 1000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_calculate)->ArgsProduct({ { 1 << 20, 16 << 20 }, { 100, 1000 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_many_edits)->Arg(256)->Arg(4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_extend_matches)->Arg(100)->Arg(1000)->Arg(16384)->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_local)->ArgsProduct({ { 16, 64 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_compress_literals)->ArgsProduct({ { 1, 2 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(bm_delta_decompress_literals)->ArgsProduct({ { 1, 2 }, { 1 } })->Unit(benchmark::kMillisecond);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include "checksum.hpp"
+#include "hash.hpp"
+#include "strong_hash.hpp"
+#include "signature.hpp"
+#include "bm_data.h"
+
+#include <vector>
+
+
+// Runs the benchmark only for kernels the CPU supports, the argument is the level of the kernel.
+static bool skip_unsupported_level(benchmark::State& state, rd::impl::simd_level level)
+{
+	if (level > rd::impl::supported_simd_level())
+	{
+		state.SkipWithError("SIMD level is not supported by this CPU");
+		return true;
+	}
+
+	return false;
+}
+
+// Adler32 of the whole data.
+static void bm_hash_checksum(benchmark::State& state)
+{
+	const auto level = static_cast<rd::impl::simd_level>(state.range(0));
+	const auto data = make_random_data(1 << 20, 1);
+	if (skip_unsupported_level(state, level))
+	{
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(rd::impl::compute_checksum_at_level(data.data(), data.size(), level));
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+// Jenkins hashes of all chunks of the data.
+static void bm_hash_chunk_hashes(benchmark::State& state)
+{
+	const auto level = static_cast<rd::impl::simd_level>(state.range(0));
+	const size_t chunk_length = 1000;
+	const auto data = make_random_data(1 << 20, 1);
+	std::vector<uint32_t> hashes(data.size() / chunk_length);
+	if (skip_unsupported_level(state, level))
+	{
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		rd::impl::compute_hashes_at_level(data.data(), chunk_length, hashes.size(), hashes.data(), level);
+		benchmark::DoNotOptimize(hashes.data());
+	}
+	state.SetBytesProcessed(state.iterations() * hashes.size() * chunk_length);
+}
+
+// 16 byte BLAKE2b hashes of all chunks of the data.
+static void bm_hash_chunk_strong_hashes(benchmark::State& state)
+{
+	const auto level = static_cast<rd::impl::simd_level>(state.range(0));
+	const size_t chunk_length = 1000;
+	const auto data = make_random_data(1 << 20, 1);
+	std::vector<uint8_t> digests(data.size() / chunk_length * 16);
+	if (skip_unsupported_level(state, level))
+	{
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		rd::impl::compute_strong_hashes_at_level(data.data(), chunk_length, digests.size() / 16, digests.data(), 16, level);
+		benchmark::DoNotOptimize(digests.data());
+	}
+	state.SetBytesProcessed(state.iterations() * digests.size() / 16 * chunk_length);
+}
+
+// Whole signature with the fastest kernels, with and without strong hashes.
+static void bm_hash_signature(benchmark::State& state)
+{
+	const size_t chunk_length = state.range(0);
+	const size_t strong_hash_length = state.range(1);
+	const auto data = make_random_data(16 << 20, 1);
+
+	for (auto _ : state)
+	{
+		auto sig = rd::calculate_signature(data.data(), data.size(), chunk_length, strong_hash_length);
+		benchmark::DoNotOptimize(sig.chunks.data());
+	}
+	state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+BENCHMARK(bm_hash_checksum)->DenseRange(0, 3)->Unit(benchmark::kMicrosecond);
+BENCHMARK(bm_hash_chunk_hashes)->DenseRange(0, 3)->Unit(benchmark::kMicrosecond);
+BENCHMARK(bm_hash_chunk_strong_hashes)->DenseRange(0, 3)->Unit(benchmark::kMicrosecond);
+BENCHMARK(bm_hash_signature)->ArgsProduct({ { 100, 1000 }, { 0, 16 } })->Unit(benchmark::kMillisecond);
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "bm_data.h"
+
+#include <cstdlib>
+#include <streambuf>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// End-to-end benchmarks of signature, delta and patch for every data shape and data length.
+// They are registered at runtime because the longest data is limited by ROLLDIFF_BENCH_MAX_LENGTH.
+
+constexpr size_t pipeline_chunk_length = 1024;
+
+/// <summary>
+/// Stream buffer that only counts written bytes, used for the size of encoded deltas without keeping them in memory.
+/// </summary>
+class counting_buffer : public std::streambuf
+{
+public:
+	size_t size() const { return length; }
+
+protected:
+	int_type overflow(int_type character) override
+	{
+		if (!traits_type::eq_int_type(character, traits_type::eof()))
+		{
+			++length;
+		}
+		return traits_type::not_eof(character);
+	}
+
+	std::streamsize xsputn(const char*, std::streamsize count) override
+	{
+		length += static_cast<size_t>(count);
+		return count;
+	}
+
+private:
+	size_t length{ 0 };
+};
+
+/// <summary>
+/// Stream buffer that reads data in memory, used for the stream functions without the cost of a file.
+/// </summary>
+class memory_input_buffer : public std::streambuf
+{
+public:
+	explicit memory_input_buffer(const std::vector<char>& data)
+	{
+		char* begin = const_cast<char*>(data.data());
+		setg(begin, begin, begin + data.size());
+	}
+};
+
+/// <summary>
+/// Old data, new data and signature of the last requested shape and length.
+/// Generating long data takes a while, so benchmarks of the same data reuse it.
+/// </summary>
+struct pipeline_data
+{
+	static const pipeline_data& get(data_shape shape, size_t data_length)
+	{
+		static pipeline_data data;
+		if (data.old_data.size() != data_length || data.sig.chunks.empty())
+		{
+			data.old_data = make_random_data(data_length, 1);
+			data.sig = rd::calculate_signature(data.old_data.data(), data.old_data.size(), pipeline_chunk_length);
+			data.new_data.clear();
+		}
+		if (data.shape != shape || data.new_data.empty())
+		{
+			data.shape = shape;
+			data.new_data = make_new_data(shape, data.old_data, 2);
+		}
+
+		return data;
+	}
+
+	data_shape shape{ data_shape::identical };
+	std::vector<char> old_data;
+	std::vector<char> new_data;
+	rd::signature sig;
+};
+
+static void bm_pipeline_signature(benchmark::State& state)
+{
+	const auto& data = pipeline_data::get(data_shape::identical, state.range(0));
+
+	size_t num_chunks = 0;
+	for (auto _ : state)
+	{
+		auto sig = rd::calculate_signature(data.old_data.data(), data.old_data.size(), pipeline_chunk_length);
+		num_chunks = sig.chunks.size();
+		benchmark::DoNotOptimize(sig.chunks.data());
+	}
+
+	state.counters["chunks"] = static_cast<double>(num_chunks);
+	state.SetBytesProcessed(state.iterations() * data.old_data.size());
+}
+
+static void bm_pipeline_delta(benchmark::State& state, data_shape shape)
+{
+	const auto& data = pipeline_data::get(shape, state.range(0));
+
+	size_t num_instructions = 0;
+	size_t delta_length = 0;
+	for (auto _ : state)
+	{
+		auto del = rd::calculate_delta(data.sig, data.new_data.data(), data.new_data.size());
+
+		state.PauseTiming();
+		num_instructions = del.instructions.size();
+		counting_buffer delta_buffer;
+		std::ostream delta_file(&delta_buffer);
+		rd::delta::write_to_binary_file(delta_file, del);
+		delta_length = delta_buffer.size();
+		state.ResumeTiming();
+	}
+
+	state.counters["instructions"] = static_cast<double>(num_instructions);
+	state.counters["delta_ratio"] = static_cast<double>(delta_length) / static_cast<double>(std::max<size_t>(1, data.new_data.size()));
+	state.SetBytesProcessed(state.iterations() * data.new_data.size());
+}
+
+static void bm_pipeline_delta_stream(benchmark::State& state, data_shape shape)
+{
+	const auto& data = pipeline_data::get(shape, state.range(0));
+
+	size_t num_instructions = 0;
+	for (auto _ : state)
+	{
+		// new data is read ahead on a background thread while it is searched
+		memory_input_buffer input_buffer(data.new_data);
+		std::istream input(&input_buffer);
+		rd::delta del;
+		rd::delta_builder builder(del);
+		rd::calculate_delta_stream(data.sig, input, builder);
+		num_instructions = del.instructions.size();
+		benchmark::DoNotOptimize(del.instructions.data());
+	}
+
+	state.counters["instructions"] = static_cast<double>(num_instructions);
+	state.SetBytesProcessed(state.iterations() * data.new_data.size());
+}
+
+static void bm_pipeline_patch(benchmark::State& state, data_shape shape)
+{
+	const auto& data = pipeline_data::get(shape, state.range(0));
+	const auto del = rd::calculate_delta(data.sig, data.new_data.data(), data.new_data.size());
+	std::vector<char> patched(del.data_length);
+
+	for (auto _ : state)
+	{
+		rd::patch<char*>(data.old_data.data(), del, patched.data());
+		benchmark::DoNotOptimize(patched.data());
+	}
+
+	state.counters["instructions"] = static_cast<double>(del.instructions.size());
+	state.SetBytesProcessed(state.iterations() * data.new_data.size());
+}
+
+/// <summary>
+/// Longest data of the pipeline benchmarks, ROLLDIFF_BENCH_MAX_LENGTH in bytes with an optional K, M or G suffix. Default is 64M.
+/// </summary>
+inline size_t pipeline_max_data_length()
+{
+	const char* value = std::getenv("ROLLDIFF_BENCH_MAX_LENGTH");
+	if (value == nullptr || *value == '\0')
+	{
+		return 64 << 20;
+	}
+
+	char* suffix = nullptr;
+	size_t result = std::strtoull(value, &suffix, 10);
+	switch (*suffix)
+	{
+	case 'K': case 'k': result <<= 10; break;
+	case 'M': case 'm': result <<= 20; break;
+	case 'G': case 'g': result <<= 30; break;
+	default: break;
+	}
+
+	return result;
+}
+
+inline void register_pipeline_benchmarks(size_t max_data_length)
+{
+	std::vector<int64_t> data_lengths;
+	for (int64_t data_length : { int64_t(1) << 10, int64_t(64) << 10, int64_t(1) << 20, int64_t(16) << 20, int64_t(64) << 20,
+		int64_t(256) << 20, int64_t(1) << 30, int64_t(4) << 30 })
+	{
+		if (static_cast<size_t>(data_length) <= max_data_length)
+		{
+			data_lengths.push_back(data_length);
+		}
+	}
+
+	// benchmarks of the same data run one after another so the data is generated only once
+	for (const auto data_length : data_lengths)
+	{
+		benchmark::RegisterBenchmark("bm_pipeline_signature", bm_pipeline_signature)->Arg(data_length)->Unit(benchmark::kMillisecond);
+		for (const auto shape : { data_shape::identical, data_shape::inserts, data_shape::deletes,
+			data_shape::appends, data_shape::shift, data_shape::random })
+		{
+			const std::string shape_name = data_shape_name(shape);
+			benchmark::RegisterBenchmark(("bm_pipeline_delta/" + shape_name).c_str(), bm_pipeline_delta, shape)
+				->Arg(data_length)->Unit(benchmark::kMillisecond);
+			benchmark::RegisterBenchmark(("bm_pipeline_patch/" + shape_name).c_str(), bm_pipeline_patch, shape)
+				->Arg(data_length)->Unit(benchmark::kMillisecond);
+		}
+		benchmark::RegisterBenchmark("bm_pipeline_delta_stream/inserts", bm_pipeline_delta_stream, data_shape::inserts)
+			->Arg(data_length)->Unit(benchmark::kMillisecond);
+	}
+}
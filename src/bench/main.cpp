@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include "bm_allocations.h"
+#include "bm_delta.h"
+#include "bm_hash.h"
+#include "bm_pipeline.h"
+
+#include <cstdlib>
+#include <new>
+
+// GCC pairs inlined new expressions with these functions and warns that free() gets memory that wasn't malloc()ed,
+// but the replaced operator new allocates with malloc()
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+	++allocation_counter::count;
+	allocation_counter::bytes += size;
+	if (void* result = std::malloc(size == 0 ? 1 : size))
+	{
+		return result;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+// pipeline benchmarks are registered before the command line is parsed, so --benchmark_filter and
+// --benchmark_out=results.json --benchmark_out_format=json apply to them as well
+int main(int argc, char** argv)
+{
+	register_pipeline_benchmarks(pipeline_max_data_length());
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+	{
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace rd
+{
+
+/// <summary>
+/// Parameters of content-defined chunking. Chunks are at least min_length and at most max_length bytes long
+/// (except the last chunk of the data that can be shorter) and their average length is close to average_length.
+/// All lengths equal to 0 mean that the data is cut into chunks of fixed length.
+/// </summary>
+struct cdc_parameters
+{
+	size_t min_length{ 0 };
+	size_t average_length{ 0 };
+	size_t max_length{ 0 };
+
+	bool enabled() const { return average_length > 0; }
+};
+
+inline bool operator==(const cdc_parameters& left, const cdc_parameters& right)
+{
+	return left.min_length == right.min_length && left.average_length == right.average_length && left.max_length == right.max_length;
+}
+
+inline bool operator!=(const cdc_parameters& left, const cdc_parameters& right)
+{
+	return !(left == right);
+}
+
+/// <summary>
+/// Helper functions used internally by content-defined chunking
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Random 64 bit value for every byte value used by the gear hash, generated by SplitMix64.
+	/// The table has to stay the same, otherwise chunks of existing signatures would not be found any more.
+	/// </summary>
+	constexpr std::array<uint64_t, 256> make_gear_table()
+	{
+		std::array<uint64_t, 256> result{};
+		uint64_t state = 0x526f6c6c44696666; // "RollDiff"
+		for (auto& value : result)
+		{
+			state += 0x9e3779b97f4a7c15;
+			uint64_t z = state;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			value = z ^ (z >> 31);
+		}
+
+		return result;
+	}
+
+	constexpr std::array<uint64_t, 256> gear_table = make_gear_table();
+} // namespace impl
+
+/// <summary>
+/// Finds chunk boundaries with the gear rolling hash as described by FastCDC.
+/// Hash of every byte after the minimal length is tested with a mask, the mask has more bits before the average length
+/// and fewer bits after it, so that chunk lengths are concentrated around the average length.
+/// Gear hash shifts its value one bit for every byte, so the tested high bits only depend on the last 64 bytes.
+/// Boundaries therefore follow the content and an insertion only changes the chunks around it, not all chunks after it.
+/// Details: https://www.usenix.org/conference/atc16/technical-sessions/presentation/xia
+/// </summary>
+class cdc_chunker
+{
+public:
+	/// <summary>
+	/// Creates chunker for the given parameters
+	/// </summary>
+	/// <param name="parameters">min_length has to be at least 1, average_length at least 4 and they have to be ordered</param>
+	explicit cdc_chunker(const cdc_parameters& parameters)
+		: parameters(parameters)
+	{
+		if (parameters.min_length == 0 || parameters.average_length < 4 || parameters.min_length > parameters.average_length
+			|| parameters.average_length > parameters.max_length)
+		{
+			throw std::invalid_argument("Invalid content-defined chunking parameters!");
+		}
+
+		size_t bits = 0;
+		while ((size_t(2) << bits) <= parameters.average_length)
+		{
+			++bits;
+		}
+		small_mask = high_bits(bits + 1);
+		large_mask = high_bits(bits - 1);
+	}
+
+	/// <summary>
+	/// Starts a new chunk
+	/// </summary>
+	void reset()
+	{
+		length = 0;
+		hash = 0;
+	}
+
+	/// <summary>
+	/// Adds next byte of the data to the current chunk
+	/// </summary>
+	/// <returns>true if the chunk ends with this byte, the chunker is reset in such case</returns>
+	bool update(char byte)
+	{
+		++length;
+		if (length > parameters.min_length)
+		{
+			hash = (hash << 1) + impl::gear_table[static_cast<uint8_t>(byte)];
+			if ((hash & (length <= parameters.average_length ? small_mask : large_mask)) == 0 || length >= parameters.max_length)
+			{
+				reset();
+				return true;
+			}
+		}
+		else if (length >= parameters.max_length)
+		{
+			reset();
+			return true;
+		}
+
+		return false;
+	}
+
+	/// <summary>
+	/// Returns length of the chunk that starts at the beginning of the data. The chunker has to be reset.
+	/// </summary>
+	/// <param name="data">Pointer to the beginning of the chunk</param>
+	/// <param name="data_length">Length of the rest of the data</param>
+	size_t next_chunk_length(const char* data, size_t data_length) const
+	{
+		const size_t max_length = data_length < parameters.max_length ? data_length : parameters.max_length;
+		if (max_length <= parameters.min_length)
+		{
+			return max_length;
+		}
+
+		uint64_t chunk_hash = 0;
+		size_t i = parameters.min_length;
+		const size_t normal_length = parameters.average_length < max_length ? parameters.average_length : max_length;
+		for (; i < normal_length; ++i)
+		{
+			chunk_hash = (chunk_hash << 1) + impl::gear_table[static_cast<uint8_t>(data[i])];
+			if ((chunk_hash & small_mask) == 0)
+			{
+				return i + 1;
+			}
+		}
+		for (; i < max_length; ++i)
+		{
+			chunk_hash = (chunk_hash << 1) + impl::gear_table[static_cast<uint8_t>(data[i])];
+			if ((chunk_hash & large_mask) == 0)
+			{
+				return i + 1;
+			}
+		}
+
+		return max_length;
+	}
+
+private:
+	static uint64_t high_bits(size_t count)
+	{
+		return count == 0 ? 0 : ~uint64_t(0) << (64 - count);
+	}
+
+	cdc_parameters parameters;
+	uint64_t small_mask{ 0 };
+	uint64_t large_mask{ 0 };
+	size_t length{ 0 };
+	uint64_t hash{ 0 };
+};
+
+}; // namespace rd
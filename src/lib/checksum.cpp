@@ -0,0 +1,190 @@
+#include "checksum.hpp"
+
+#if RD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace rd
+{
+
+namespace
+{
+#if RD_X86_SIMD
+	// Every kernel adds blocks of vector width bytes to the checksum of the preceding data. For a block of n bytes b[0..n):
+	//   A += b[0] + ... + b[n-1]
+	//   B += n * A_before + n * b[0] + (n-1) * b[1] + ... + 1 * b[n-1]
+	// A_before is accumulated in a separate vector and multiplied by n once per run of blocks.
+	// Runs are at most checksum_max_block_length bytes long so none of the 32 bit lanes overflows before the modulo.
+	// The rest of the data that is shorter than one block is passed to the kernel with narrower vectors.
+
+	// weights of the bytes in B: n for the first byte down to 1 for the last one
+	template <size_t Length>
+	struct checksum_weights
+	{
+		constexpr checksum_weights()
+		{
+			for (size_t i = 0; i < Length; ++i)
+			{
+				values[i] = static_cast<int8_t>(Length - i);
+			}
+		}
+
+		alignas(64) int8_t values[Length]{};
+	};
+
+	constexpr checksum_weights<16> weights_16;
+	constexpr checksum_weights<32> weights_32;
+	constexpr checksum_weights<64> weights_64;
+
+	RD_TARGET_SSSE3 uint32_t horizontal_sum(__m128i value)
+	{
+		value = _mm_add_epi32(value, _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+		value = _mm_add_epi32(value, _mm_shuffle_epi32(value, _MM_SHUFFLE(2, 3, 0, 1)));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(value));
+	}
+
+	RD_TARGET_SSSE3 uint32_t update_checksum_ssse3(uint32_t checksum, const char* data, size_t data_length)
+	{
+		constexpr size_t block_length = 16;
+		constexpr size_t max_run_blocks = impl::checksum_max_block_length / block_length;
+		const __m128i weights = _mm_load_si128(reinterpret_cast<const __m128i*>(weights_16.values));
+		const __m128i ones = _mm_set1_epi16(1);
+		const __m128i zero = _mm_setzero_si128();
+
+		uint32_t A = checksum & 0xffff;
+		uint32_t B = checksum >> 16;
+		for (size_t num_blocks = data_length / block_length; num_blocks > 0;)
+		{
+			const size_t run_blocks = num_blocks < max_run_blocks ? num_blocks : max_run_blocks;
+			num_blocks -= run_blocks;
+
+			__m128i sum_a = zero;
+			__m128i sum_b = _mm_cvtsi32_si128(static_cast<int>(B));
+			__m128i previous_a = _mm_cvtsi32_si128(static_cast<int>(A * run_blocks));
+			for (size_t i = 0; i < run_blocks; ++i)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+				previous_a = _mm_add_epi32(previous_a, sum_a);
+				sum_a = _mm_add_epi32(sum_a, _mm_sad_epu8(bytes, zero));
+				sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+				data += block_length;
+			}
+			sum_b = _mm_add_epi32(sum_b, _mm_slli_epi32(previous_a, 4));
+
+			A = (A + horizontal_sum(sum_a)) % impl::checksum_mod;
+			B = horizontal_sum(sum_b) % impl::checksum_mod;
+		}
+
+		return impl::compute_checksum_scalar(data, data_length % block_length, (B << 16) + A);
+	}
+
+	RD_TARGET_AVX2 uint32_t update_checksum_avx2(uint32_t checksum, const char* data, size_t data_length)
+	{
+		constexpr size_t block_length = 32;
+		constexpr size_t max_run_blocks = impl::checksum_max_block_length / block_length;
+		const __m256i weights = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights_32.values));
+		const __m256i ones = _mm256_set1_epi16(1);
+		const __m256i zero = _mm256_setzero_si256();
+
+		uint32_t A = checksum & 0xffff;
+		uint32_t B = checksum >> 16;
+		for (size_t num_blocks = data_length / block_length; num_blocks > 0;)
+		{
+			const size_t run_blocks = num_blocks < max_run_blocks ? num_blocks : max_run_blocks;
+			num_blocks -= run_blocks;
+
+			__m256i sum_a = zero;
+			__m256i sum_b = _mm256_zextsi128_si256(_mm_cvtsi32_si128(static_cast<int>(B)));
+			__m256i previous_a = _mm256_zextsi128_si256(_mm_cvtsi32_si128(static_cast<int>(A * run_blocks)));
+			for (size_t i = 0; i < run_blocks; ++i)
+			{
+				const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+				previous_a = _mm256_add_epi32(previous_a, sum_a);
+				sum_a = _mm256_add_epi32(sum_a, _mm256_sad_epu8(bytes, zero));
+				sum_b = _mm256_add_epi32(sum_b, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+				data += block_length;
+			}
+			sum_b = _mm256_add_epi32(sum_b, _mm256_slli_epi32(previous_a, 5));
+
+			A = (A + horizontal_sum(_mm_add_epi32(_mm256_castsi256_si128(sum_a), _mm256_extracti128_si256(sum_a, 1)))) % impl::checksum_mod;
+			B = horizontal_sum(_mm_add_epi32(_mm256_castsi256_si128(sum_b), _mm256_extracti128_si256(sum_b, 1))) % impl::checksum_mod;
+		}
+
+		return update_checksum_ssse3((B << 16) + A, data, data_length % block_length);
+	}
+
+	// GCC warns that the _mm512_undefined_* values its intrinsics start from may be used uninitialized, they are never read
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+	// lanes are added as unsigned values like in the other kernels, _mm512_reduce_add_epi32 adds signed ints that overflow
+	RD_TARGET_AVX512 uint32_t horizontal_sum(__m512i value)
+	{
+		const __m256i half = _mm256_add_epi32(_mm512_castsi512_si256(value), _mm512_extracti64x4_epi64(value, 1));
+		return horizontal_sum(_mm_add_epi32(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1)));
+	}
+
+	RD_TARGET_AVX512 uint32_t update_checksum_avx512(uint32_t checksum, const char* data, size_t data_length)
+	{
+		constexpr size_t block_length = 64;
+		constexpr size_t max_run_blocks = impl::checksum_max_block_length / block_length;
+		const __m512i weights = _mm512_load_si512(weights_64.values);
+		const __m512i ones = _mm512_set1_epi16(1);
+		const __m512i zero = _mm512_setzero_si512();
+
+		uint32_t A = checksum & 0xffff;
+		uint32_t B = checksum >> 16;
+		for (size_t num_blocks = data_length / block_length; num_blocks > 0;)
+		{
+			const size_t run_blocks = num_blocks < max_run_blocks ? num_blocks : max_run_blocks;
+			num_blocks -= run_blocks;
+
+			__m512i sum_a = zero;
+			__m512i sum_b = _mm512_zextsi128_si512(_mm_cvtsi32_si128(static_cast<int>(B)));
+			__m512i previous_a = _mm512_zextsi128_si512(_mm_cvtsi32_si128(static_cast<int>(A * run_blocks)));
+			for (size_t i = 0; i < run_blocks; ++i)
+			{
+				const __m512i bytes = _mm512_loadu_si512(data);
+				previous_a = _mm512_add_epi32(previous_a, sum_a);
+				sum_a = _mm512_add_epi32(sum_a, _mm512_sad_epu8(bytes, zero));
+				sum_b = _mm512_add_epi32(sum_b, _mm512_madd_epi16(_mm512_maddubs_epi16(bytes, weights), ones));
+				data += block_length;
+			}
+			sum_b = _mm512_add_epi32(sum_b, _mm512_slli_epi32(previous_a, 6));
+
+			A = (A + horizontal_sum(sum_a)) % impl::checksum_mod;
+			B = horizontal_sum(sum_b) % impl::checksum_mod;
+		}
+
+		return update_checksum_avx2((B << 16) + A, data, data_length % block_length);
+	}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+} // namespace
+
+namespace impl
+{
+	uint32_t compute_checksum_at_level(const char* data, size_t data_length, simd_level level)
+	{
+		switch (level)
+		{
+#if RD_X86_SIMD
+		case simd_level::avx512:
+			return update_checksum_avx512(1, data, data_length);
+		case simd_level::avx2:
+			return update_checksum_avx2(1, data, data_length);
+		case simd_level::ssse3:
+			return update_checksum_ssse3(1, data, data_length);
+#endif
+		default:
+			return compute_checksum_scalar(data, data_length);
+		}
+	}
+} // namespace impl
+
+}; // namespace rd
@@ -1,13 +1,75 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include "cpu_features.hpp"
 
 namespace rd
 {
 
+/// <summary>
+/// Helper functions used internally by the checksum
+/// </summary>
+namespace impl
+{
+    constexpr uint32_t checksum_mod = 65521;
+
+    /// <summary>
+    /// Largest number of bytes after which the sums still fit into 32 bits, as in zlib (NMAX).
+    /// Sums are reduced modulo checksum_mod only once per this many bytes instead of for every byte.
+    /// </summary>
+    constexpr size_t checksum_max_block_length = 5552;
+
+    /// <summary>
+    /// Adler32 computed one byte at a time, used for iterators and as the reference for the SIMD kernels.
+    /// </summary>
+    /// <param name="checksum">Checksum of the preceding data, 1 for no data</param>
+    template <typename InIterator>
+    uint32_t compute_checksum_scalar(InIterator&& input, size_t data_length, uint32_t checksum = 1)
+    {
+        uint32_t A = checksum & 0xffff;
+        uint32_t B = checksum >> 16;
+
+        while (data_length > 0)
+        {
+            const size_t block_length = data_length < checksum_max_block_length ? data_length : checksum_max_block_length;
+            for (size_t i = 0; i < block_length; ++i)
+            {
+                A += static_cast<uint8_t>(*input++);
+                B += A;
+            }
+
+            A %= checksum_mod;
+            B %= checksum_mod;
+            data_length -= block_length;
+        }
+
+        return (B << 16) + A;
+    }
+
+    /// <summary>
+    /// Adler32 of the data computed by the kernel of the given level, all levels give the same result.
+    /// </summary>
+    /// <param name="data">Pointer to the beginning of the data</param>
+    /// <param name="data_length">Length of the data</param>
+    /// <param name="level">Level of the kernel, it can't be higher than supported_simd_level()</param>
+    uint32_t compute_checksum_at_level(const char* data, size_t data_length, simd_level level);
+
+    /// <summary>
+    /// Adler32 of data_length zero bytes, A stays 1 and B grows by one with every byte.
+    /// </summary>
+    constexpr uint32_t zero_checksum(size_t data_length)
+    {
+        return (static_cast<uint32_t>(data_length % checksum_mod) << 16) + 1;
+    }
+} // namespace impl
+
 /// <summary>
 /// Adler32 checksum algorithm function.
 /// Should not be used directly for file hash since it can have collisions for similar chunks.
+/// Data in memory is processed by the fastest SIMD kernel the CPU supports.
 /// Details: https://en.wikipedia.org/wiki/Adler-32
 /// </summary>
 /// <typeparam name="InIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
@@ -15,23 +77,71 @@ namespace rd
 /// <param name="data_length">Length of the input</param>
 /// <returns>uint32_t representing checksum of the given data</returns>
 template <typename InIterator>
-uint32_t compute_checksum(InIterator& input, size_t data_length)
+uint32_t compute_checksum(InIterator&& input, size_t data_length)
 {
-    size_t A = 1;
-    size_t B = 0;
+    using iterator_type = std::decay_t<InIterator>;
+    if constexpr (std::is_pointer_v<iterator_type> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<iterator_type>>, char>)
+    {
+        const uint32_t checksum = impl::compute_checksum_at_level(input, data_length, impl::supported_simd_level());
+        input += data_length;
+        return checksum;
+    }
+    else
+    {
+        return impl::compute_checksum_scalar(input, data_length);
+    }
+}
+
+/// <summary>
+/// Adler32 checksum of a fixed size window that can be moved through the data one byte at a time.
+/// Moving the window costs O(1) regardless of the window length, which makes it suitable
+/// as a weak hash for finding chunk candidates at every offset of the data.
+/// value() is always equal to compute_checksum() of the bytes currently inside the window.
+/// </summary>
+class rolling_checksum
+{
+public:
+    /// <summary>
+    /// Computes checksum of the first window_length bytes of the input.
+    /// </summary>
+    /// <typeparam name="InIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+    /// <param name="input">Forward iterator to the beginning of the window. Keep in mind that it will be modified by this function</param>
+    /// <param name="window_length">Length of the window</param>
+    template <typename InIterator>
+    void reset(InIterator&& input, size_t window_length)
+    {
+        const uint32_t checksum = compute_checksum(input, window_length);
+        A = checksum & 0xffff;
+        B = checksum >> 16;
+        length_mod = static_cast<uint32_t>(window_length % mod);
+    }
 
-    constexpr size_t mod = 65521;
-    for (size_t i = 0; i < data_length; ++i)
+    /// <summary>
+    /// Moves the window one byte forward.
+    /// </summary>
+    /// <param name="out">First byte of the current window, it is leaving the window</param>
+    /// <param name="in">Byte right after the current window, it is entering the window</param>
+    void roll(char out, char in)
     {
-        A += *input++;
-        A = A % mod;
+        const uint32_t out_byte = static_cast<uint8_t>(out);
+        const uint32_t in_byte = static_cast<uint8_t>(in);
 
-        B += A;
-        B = B % mod;
+        A = (A + mod - out_byte + in_byte) % mod;
+        B = (B + 2 * mod - (length_mod * out_byte) % mod + A - 1) % mod;
     }
 
-    return static_cast<uint32_t>((B << 16) + A);
-}
+    uint32_t value() const
+    {
+        return (B << 16) + A;
+    }
+
+private:
+    static constexpr uint32_t mod = impl::checksum_mod;
+
+    uint32_t A{ 1 };
+    uint32_t B{ 0 };
+    uint32_t length_mod{ 0 };
+};
 
 
 }; // namespace rd
\ No newline at end of file
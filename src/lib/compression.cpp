@@ -0,0 +1,314 @@
+#include "compression.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef RD_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace rd
+{
+
+namespace
+{
+	// LZ4 block format: sequences of a token (literal length, match length - 4), extra literal length bytes,
+	// literals, 2 byte little-endian offset of the match and extra match length bytes. The last sequence has only literals.
+	constexpr size_t min_match_length = 4;
+	constexpr size_t max_offset = 65535;
+	constexpr size_t last_literals = 5;     // the last bytes are always literals
+	constexpr size_t match_search_end = 12; // no match starts closer to the end, as the LZ4 format requires
+	constexpr uint32_t hash_bits = 14;
+	constexpr size_t copy_step = 16; // copies with room at the end of the buffers are done in steps that may copy a bit more
+
+	inline uint32_t load32(const char* data)
+	{
+		uint32_t value = 0;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t hash_sequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - hash_bits);
+	}
+
+	// sequences are written through a pointer into output that is long enough for the worst case
+	void write_length(char*& output, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			*output++ = static_cast<char>(255);
+		}
+		*output++ = static_cast<char>(length);
+	}
+
+	void write_literals(char*& output, const char* literals, size_t literal_length, uint8_t match_token)
+	{
+		*output++ = static_cast<char>((std::min<size_t>(literal_length, 15) << 4) | match_token);
+		if (literal_length >= 15)
+		{
+			write_length(output, literal_length - 15);
+		}
+		std::memcpy(output, literals, literal_length);
+		output += literal_length;
+	}
+
+	void write_sequence(char*& output, const char* literals, size_t literal_length, size_t offset, size_t match_length)
+	{
+		const size_t extra_match_length = match_length - min_match_length;
+		write_literals(output, literals, literal_length, static_cast<uint8_t>(std::min<size_t>(extra_match_length, 15)));
+		*output++ = static_cast<char>(offset & 0xff);
+		*output++ = static_cast<char>(offset >> 8);
+		if (extra_match_length >= 15)
+		{
+			write_length(output, extra_match_length - 15);
+		}
+	}
+
+	void compress_lz(const char* data, size_t data_length, std::vector<char>& compressed)
+	{
+		compressed.resize(data_length + data_length / 255 + 16);
+		char* output = compressed.data();
+
+		// positions of the last sequences with the same hash, misses make the search skip faster through data that doesn't compress
+		std::vector<uint32_t> table(size_t(1) << hash_bits, 0);
+		size_t anchor = 0;
+		size_t position = 0;
+		size_t misses = 0;
+		while (data_length >= match_search_end && position < data_length - match_search_end)
+		{
+			const uint32_t sequence = load32(data + position);
+			const uint32_t hash = hash_sequence(sequence);
+			size_t candidate = table[hash];
+			table[hash] = static_cast<uint32_t>(position);
+			if (candidate >= position || position - candidate > max_offset || load32(data + candidate) != sequence)
+			{
+				position += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			// the match is extended back into the pending literals and forward up to the last literals
+			while (position > anchor && candidate > 0 && data[position - 1] == data[candidate - 1])
+			{
+				--position;
+				--candidate;
+			}
+			size_t match_length = min_match_length;
+			const size_t match_end_limit = data_length - last_literals;
+			while (position + match_length + sizeof(uint64_t) <= match_end_limit)
+			{
+				uint64_t left = 0;
+				uint64_t right = 0;
+				std::memcpy(&left, data + position + match_length, sizeof(left));
+				std::memcpy(&right, data + candidate + match_length, sizeof(right));
+				if (left != right)
+				{
+					break;
+				}
+				match_length += sizeof(uint64_t);
+			}
+			while (position + match_length < match_end_limit && data[position + match_length] == data[candidate + match_length])
+			{
+				++match_length;
+			}
+
+			write_sequence(output, data + anchor, position - anchor, position - candidate, match_length);
+			position += match_length;
+			anchor = position;
+			if (position < data_length - match_search_end)
+			{
+				table[hash_sequence(load32(data + position - 2))] = static_cast<uint32_t>(position - 2);
+			}
+		}
+
+		write_literals(output, data + anchor, data_length - anchor, 0);
+		compressed.resize(output - compressed.data());
+	}
+
+	size_t read_length(const uint8_t*& input, const uint8_t* input_end)
+	{
+		size_t length = 0;
+		for (;;)
+		{
+			if (input == input_end)
+			{
+				throw std::runtime_error("Compressed block is corrupted!");
+			}
+			const uint8_t byte = *input++;
+			length += byte;
+			if (byte != 255)
+			{
+				return length;
+			}
+		}
+	}
+
+	void decompress_lz(const char* compressed, size_t compressed_length, char* data, size_t data_length)
+	{
+		auto input = reinterpret_cast<const uint8_t*>(compressed);
+		const auto input_end = input + compressed_length;
+		char* output = data;
+		char* const output_end = data + data_length;
+		for (;;)
+		{
+			if (input == input_end)
+			{
+				throw std::runtime_error("Compressed block is corrupted!");
+			}
+			const uint8_t token = *input++;
+
+			size_t literal_length = token >> 4;
+			if (literal_length == 15)
+			{
+				literal_length += read_length(input, input_end);
+			}
+			if (literal_length > static_cast<size_t>(input_end - input) || literal_length > static_cast<size_t>(output_end - output))
+			{
+				throw std::runtime_error("Compressed block is corrupted!");
+			}
+			if (literal_length + copy_step <= static_cast<size_t>(input_end - input) && literal_length + copy_step <= static_cast<size_t>(output_end - output))
+			{
+				for (size_t i = 0; i < literal_length; i += copy_step)
+				{
+					std::memcpy(output + i, input + i, copy_step);
+				}
+			}
+			else
+			{
+				std::memcpy(output, input, literal_length);
+			}
+			output += literal_length;
+			input += literal_length;
+			if (input == input_end)
+			{
+				break;
+			}
+
+			if (input_end - input < 2)
+			{
+				throw std::runtime_error("Compressed block is corrupted!");
+			}
+			const size_t offset = input[0] | (size_t(input[1]) << 8);
+			input += 2;
+			size_t match_length = token & 15;
+			if (match_length == 15)
+			{
+				match_length += read_length(input, input_end);
+			}
+			match_length += min_match_length;
+			if (offset == 0 || offset > static_cast<size_t>(output - data) || match_length > static_cast<size_t>(output_end - output))
+			{
+				throw std::runtime_error("Compressed block is corrupted!");
+			}
+
+			const char* match = output - offset;
+			if (offset >= copy_step && match_length + copy_step <= static_cast<size_t>(output_end - output))
+			{
+				for (size_t i = 0; i < match_length; i += copy_step)
+				{
+					std::memcpy(output + i, match + i, copy_step);
+				}
+			}
+			else if (offset >= match_length)
+			{
+				std::memcpy(output, match, match_length);
+			}
+			else
+			{
+				// overlapping match repeats the last 'offset' bytes, the repeated part doubles with every copy
+				for (size_t i = 0; i < match_length;)
+				{
+					const size_t length = std::min(offset + i, match_length - i);
+					std::memcpy(output + i, match, length);
+					i += length;
+				}
+			}
+			output += match_length;
+		}
+
+		if (output != output_end)
+		{
+			throw std::runtime_error("Compressed block is corrupted!");
+		}
+	}
+} // namespace
+
+bool is_codec_available(codec literal_codec)
+{
+	switch (literal_codec)
+	{
+	case codec::none:
+	case codec::lz:
+		return true;
+	case codec::zstd:
+#ifdef RD_WITH_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
+
+bool compress_block(codec literal_codec, const char* data, size_t data_length, std::vector<char>& compressed)
+{
+	switch (literal_codec)
+	{
+	case codec::none:
+		return false;
+	case codec::lz:
+		compress_lz(data, data_length, compressed);
+		break;
+#ifdef RD_WITH_ZSTD
+	case codec::zstd:
+	{
+		// level 3 is the default of zstd, it keeps compression fast enough for deltas written while they are calculated
+		compressed.resize(ZSTD_compressBound(data_length));
+		const size_t length = ZSTD_compress(compressed.data(), compressed.size(), data, data_length, 3);
+		if (ZSTD_isError(length))
+		{
+			throw std::runtime_error("Unable to compress block!");
+		}
+		compressed.resize(length);
+		break;
+	}
+#endif
+	default:
+		throw std::invalid_argument("Codec is not available in this build!");
+	}
+
+	return compressed.size() < data_length;
+}
+
+void decompress_block(codec literal_codec, const char* compressed, size_t compressed_length, char* data, size_t data_length)
+{
+	switch (literal_codec)
+	{
+	case codec::none:
+		if (compressed_length != data_length)
+		{
+			throw std::runtime_error("Compressed block is corrupted!");
+		}
+		std::memcpy(data, compressed, data_length);
+		break;
+	case codec::lz:
+		decompress_lz(compressed, compressed_length, data, data_length);
+		break;
+#ifdef RD_WITH_ZSTD
+	case codec::zstd:
+		if (ZSTD_decompress(data, data_length, compressed, compressed_length) != data_length)
+		{
+			throw std::runtime_error("Compressed block is corrupted!");
+		}
+		break;
+#endif
+	default:
+		throw std::runtime_error("Block is compressed by a codec that is not available in this build!");
+	}
+}
+
+}; // namespace rd
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace rd
+{
+
+/// <summary>
+/// Codecs of the blocks of literal data in compressed deltas
+/// none: data is stored as it is
+/// lz: in-tree LZ77 codec writing the LZ4 block format, it decompresses at memory speed, far above disk speed
+/// zstd: Zstandard, smaller but slower, available only if the library was built with it (see is_codec_available)
+/// </summary>
+enum class codec : uint8_t
+{
+	none = 0,
+	lz = 1,
+	zstd = 2
+};
+
+/// <summary>
+/// Returns true if blocks can be compressed and decompressed by the codec in this build
+/// </summary>
+bool is_codec_available(codec literal_codec);
+
+/// <summary>
+/// Compresses a block of data.
+/// Throws std::invalid_argument if the codec is not available.
+/// </summary>
+/// <param name="literal_codec">Codec of the block</param>
+/// <param name="data">Data of the block</param>
+/// <param name="data_length">Length of the data</param>
+/// <param name="compressed">Output buffer, resized to the length of the compressed block</param>
+/// <returns>false if the compressed block isn't shorter than the data, the block should be stored without compression then</returns>
+bool compress_block(codec literal_codec, const char* data, size_t data_length, std::vector<char>& compressed);
+
+/// <summary>
+/// Decompresses a block to exactly data_length bytes. Every read and write of the decoder is checked,
+/// so corrupted blocks can't access memory outside of the buffers.
+/// Throws std::runtime_error if the block is corrupted or the codec is not available.
+/// </summary>
+/// <param name="literal_codec">Codec of the block</param>
+/// <param name="compressed">Compressed block</param>
+/// <param name="compressed_length">Length of the compressed block</param>
+/// <param name="data">Output buffer for data_length bytes</param>
+/// <param name="data_length">Length of the data before compression</param>
+void decompress_block(codec literal_codec, const char* compressed, size_t compressed_length, char* data, size_t data_length);
+
+}; // namespace rd
@@ -0,0 +1,110 @@
+#include "cpu_features.hpp"
+
+#if RD_X86_SIMD
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace rd
+{
+
+namespace
+{
+#if RD_X86_SIMD
+	struct cpuid_registers
+	{
+		uint32_t eax{ 0 };
+		uint32_t ebx{ 0 };
+		uint32_t ecx{ 0 };
+		uint32_t edx{ 0 };
+	};
+
+	cpuid_registers cpuid(uint32_t leaf, uint32_t subleaf)
+	{
+		cpuid_registers result;
+#if defined(_MSC_VER) && !defined(__clang__)
+		int registers[4];
+		__cpuidex(registers, static_cast<int>(leaf), static_cast<int>(subleaf));
+		result.eax = static_cast<uint32_t>(registers[0]);
+		result.ebx = static_cast<uint32_t>(registers[1]);
+		result.ecx = static_cast<uint32_t>(registers[2]);
+		result.edx = static_cast<uint32_t>(registers[3]);
+#else
+		__cpuid_count(leaf, subleaf, result.eax, result.ebx, result.ecx, result.edx);
+#endif
+		return result;
+	}
+
+	// register state enabled by the operating system, it has to be checked before AVX registers are used
+	uint64_t xgetbv()
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		return _xgetbv(0);
+#else
+		uint32_t low = 0;
+		uint32_t high = 0;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+	}
+
+	bool has_bit(uint32_t value, int bit)
+	{
+		return (value >> bit) & 1;
+	}
+
+	impl::simd_level detect_simd_level()
+	{
+		const uint32_t max_leaf = cpuid(0, 0).eax;
+		if (max_leaf < 1)
+		{
+			return impl::simd_level::scalar;
+		}
+
+		const auto features = cpuid(1, 0);
+		if (!has_bit(features.ecx, 9)) // SSSE3
+		{
+			return impl::simd_level::scalar;
+		}
+
+		// AVX needs the OS to save YMM registers (XCR0 bits 1 and 2)
+		if (max_leaf < 7 || !has_bit(features.ecx, 27) || !has_bit(features.ecx, 28)) // OSXSAVE, AVX
+		{
+			return impl::simd_level::ssse3;
+		}
+		const uint64_t os_state = xgetbv();
+		const auto extended_features = cpuid(7, 0);
+		if ((os_state & 0x6) != 0x6 || !has_bit(extended_features.ebx, 5)) // AVX2
+		{
+			return impl::simd_level::ssse3;
+		}
+
+		// AVX-512 needs opmask and ZMM state too (XCR0 bits 5, 6 and 7)
+		if ((os_state & 0xe0) != 0xe0 || !has_bit(extended_features.ebx, 16) || !has_bit(extended_features.ebx, 30)) // AVX512F, AVX512BW
+		{
+			return impl::simd_level::avx2;
+		}
+
+		return impl::simd_level::avx512;
+	}
+#else
+	impl::simd_level detect_simd_level()
+	{
+		return impl::simd_level::scalar;
+	}
+#endif
+} // namespace
+
+namespace impl
+{
+	simd_level supported_simd_level()
+	{
+		static const simd_level level = detect_simd_level();
+		return level;
+	}
+} // namespace impl
+
+}; // namespace rd
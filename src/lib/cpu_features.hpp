@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// SIMD kernels are compiled only for x86, with instruction sets enabled per function so that the rest of the library
+// doesn't require them and the kernels are selected at runtime.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RD_X86_SIMD 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define RD_TARGET_SSSE3
+#define RD_TARGET_AVX2
+#define RD_TARGET_AVX512
+#else
+#define RD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define RD_TARGET_AVX2 __attribute__((target("avx2")))
+#define RD_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+#else
+#define RD_X86_SIMD 0
+#endif
+
+namespace rd
+{
+
+/// <summary>
+/// Helper functions used internally by the hashing kernels
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Instruction sets used by the hashing kernels, every level includes the previous ones
+	/// </summary>
+	enum class simd_level : uint8_t
+	{
+		scalar,
+		ssse3,
+		avx2,
+		avx512
+	};
+
+	/// <summary>
+	/// Returns the best level supported by both the CPU (cpuid) and the operating system (saved register state).
+	/// It is detected once, kernels of higher levels must not be called.
+	/// </summary>
+	simd_level supported_simd_level();
+} // namespace impl
+
+}; // namespace rd
@@ -1,11 +1,57 @@
 #include "delta.hpp"
 #include "hash.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
 
 
 
 namespace rd
 {
 
+namespace
+{
+	const char* opcode_name(delta::opcode command)
+	{
+		switch (command)
+		{
+		case delta::opcode::copy_data:
+			return "COPY_DATA";
+		case delta::opcode::copy_chunk:
+			return "COPY_CHUNK";
+		default:
+			return "ZERO_FILL";
+		}
+	}
+
+	void append_varint(std::vector<char>& output, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			output.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		output.push_back(static_cast<char>(value));
+	}
+
+	inline uint64_t zigzag_encode(uint64_t value)
+	{
+		return (value << 1) ^ (0 - (value >> 63));
+	}
+
+	inline uint64_t zigzag_decode(uint64_t value)
+	{
+		return (value >> 1) ^ (0 - (value & 1));
+	}
+
+	// maximal length of a varint encoded 64 bit value
+	constexpr size_t max_varint_length = 10;
+} // namespace
+
 std::ostream& operator<<(std::ostream& os, const delta& del)
 {
 	os << del.data_length;
@@ -13,8 +59,11 @@ std::ostream& operator<<(std::ostream& os, const delta& del)
 
 	for (const auto& i : del.instructions)
 	{
-		os << i.command.c_str() << i.start_index << i.chunk_id << i.data_length;
-		std::copy(i.data.cbegin(), i.data.cend(), std::ostream_iterator<char>(os));
+		os << opcode_name(i.command) << i.start_index << i.chunk_id << i.data_length;
+		if (i.command == delta::opcode::copy_data)
+		{
+			std::copy_n(del.data(i), i.data_length, std::ostream_iterator<char>(os));
+		}
 	}
 
 	return os;
@@ -31,64 +80,798 @@ std::istream& operator>>(std::istream& is, delta& del)
 	for (size_t i = 0; i < num_instructions; ++i)
 	{
 		delta::instruction new_instruction;
-		is >> new_instruction.command;
+		std::string command;
+		is >> command;
+		if (command == opcode_name(delta::opcode::copy_data))
+		{
+			new_instruction.command = delta::opcode::copy_data;
+		}
+		else if (command == opcode_name(delta::opcode::copy_chunk))
+		{
+			new_instruction.command = delta::opcode::copy_chunk;
+		}
+		else if (command == opcode_name(delta::opcode::zero_fill))
+		{
+			new_instruction.command = delta::opcode::zero_fill;
+		}
+		else
+		{
+			throw std::runtime_error("Unknown command in delta file: " + command);
+		}
 		is >> new_instruction.start_index;
 		is >> new_instruction.chunk_id;
 		is >> new_instruction.data_length;
 
-		new_instruction.data.reserve(new_instruction.data_length);
-		std::copy_n(std::istream_iterator<char>(is), new_instruction.data_length, std::back_inserter(new_instruction.data));
+		if (new_instruction.command == delta::opcode::copy_data)
+		{
+			new_instruction.data_offset = del.literals.size();
+			std::copy_n(std::istream_iterator<char>(is), new_instruction.data_length, std::back_inserter(del.literals));
+		}
+		del.instructions.push_back(new_instruction);
 	}
 
 	return is;
 }
 
-std::ostream& delta::write_to_binary_file(std::ostream& os, const delta& del)
+std::ostream& delta::write_to_binary_file(std::ostream& os, const delta& del, codec literal_codec)
 {
-	os.write(reinterpret_cast<const char*>(&del.data_length), sizeof(del.data_length));
-	size_t num_instructions = del.instructions.size();
-	os.write(reinterpret_cast<const char*>(&num_instructions), sizeof(num_instructions));
-	
+	delta_writer writer(os, del.data_length, delta_writer::num_written_instructions(del), literal_codec);
 	for (const auto& i : del.instructions)
 	{
-		char command = i.command == "COPY_DATA" ? 0 : 1;
-		os.write(&command, sizeof(char));
-
-		os.write(reinterpret_cast<const char*>(&i.start_index), sizeof(i.start_index));
-		os.write(reinterpret_cast<const char*>(&i.chunk_id), sizeof(i.chunk_id));
-		
-		os.write(reinterpret_cast<const char*>(&i.data_length), sizeof(i.data_length));
-		os.write(i.data.data(), sizeof(char) * (i.command == "COPY_DATA" ? i.data_length : 0));
+		switch (i.command)
+		{
+		case opcode::copy_data:
+			writer.copy_data(i.start_index, i.data_length, del.data(i));
+			break;
+		case opcode::copy_chunk:
+			writer.copy_chunk(i.chunk_id, i.start_index, i.data_length);
+			break;
+		case opcode::zero_fill:
+			writer.zero_fill(i.start_index, i.data_length);
+			break;
+		}
 	}
+	writer.finish();
 
 	return os;
 }
+
 std::istream& delta::read_from_binary_file(std::istream& is, delta& del)
 {
-	is.read(reinterpret_cast<char*>(&del.data_length), sizeof(del.data_length));
-	size_t num_instructions = 0;
-	is.read(reinterpret_cast<char*>(&num_instructions), sizeof(num_instructions));
-	del.instructions.reserve(num_instructions);
-	
-	for (size_t i = 0; i < num_instructions; ++i)
+	delta_reader reader(is);
+	// lengths of a streamed delta are known after its last instruction
+	if (!reader.is_streamed())
 	{
-		delta::instruction new_instruction;
+		del.instructions.reserve(reader.num_instructions());
+	}
 
-		char command = '\0';
-		is.read(&command, sizeof(char));
-		new_instruction.command = command == 0 ? "COPY_DATA" : "COPY_CHUNK";
+	delta::instruction new_instruction;
+	while (reader.next(new_instruction))
+	{
+		if (new_instruction.command == opcode::copy_data)
+		{
+			new_instruction.data_offset = del.literals.size();
+			del.literals.resize(del.literals.size() + new_instruction.data_length);
+			reader.read_data(del.literals.data() + new_instruction.data_offset, new_instruction.data_length);
+		}
 
-		is.read(reinterpret_cast<char*>(&new_instruction.start_index), sizeof(new_instruction.start_index));
-		is.read(reinterpret_cast<char*>(&new_instruction.chunk_id), sizeof(new_instruction.chunk_id));
+		del.instructions.push_back(new_instruction);
+	}
+	del.data_length = reader.data_length();
 
-		is.read(reinterpret_cast<char*>(&new_instruction.data_length), sizeof(new_instruction.data_length));
-		new_instruction.data.resize(new_instruction.data_length);
-		is.read(new_instruction.data.data(), sizeof(char) * (command == 0 ? new_instruction.data_length : 0));
+	return is;
+}
 
-		del.instructions.push_back(std::move(new_instruction));
+delta_writer::delta_writer(std::ostream& os, codec literal_codec)
+	: os(os), literal_codec(literal_codec)
+{
+	if (!is_codec_available(literal_codec))
+	{
+		throw std::invalid_argument("Codec is not available in this build!");
 	}
+	buffer.reserve(buffer_size);
 
-	return is;
+	// header is completed in finish(), streams that can't seek get a streamed delta with the lengths at the end instead
+	header_position = os.tellp();
+	streamed = header_position == std::ostream::pos_type(-1);
+	if (streamed)
+	{
+		data_length = delta_format::unknown_length;
+		num_instructions = delta_format::unknown_length;
+		write_header();
+		data_length = 0;
+		num_instructions = 0;
+	}
+	else
+	{
+		write_header();
+	}
+
+	// literal blocks are written before the buffered instructions, so the header can't wait in the buffer
+	flush_buffer();
+}
+
+delta_writer::delta_writer(std::ostream& os, size_t data_length, size_t num_instructions, codec literal_codec)
+	: os(os), literal_codec(literal_codec), header_known(true), data_length(data_length), num_instructions(num_instructions)
+{
+	if (!is_codec_available(literal_codec))
+	{
+		throw std::invalid_argument("Codec is not available in this build!");
+	}
+	buffer.reserve(buffer_size);
+
+	write_header();
+	flush_buffer();
+}
+
+void delta_writer::copy_data(size_t, size_t data_length, const char* data)
+{
+	write_range();
+
+	reserve_buffer(1 + max_varint_length);
+	buffer.push_back(static_cast<char>(delta_format::copy_data));
+	write_varint(data_length);
+
+	if (literal_codec != codec::none)
+	{
+		// the data goes to the literal blocks, a full block is written together with the instructions before it
+		for (size_t done = 0; done < data_length;)
+		{
+			const size_t length = std::min(data_length - done, delta_format::literal_block_length - literal_block.size());
+			literal_block.insert(literal_block.end(), data + done, data + done + length);
+			done += length;
+			if (literal_block.size() == delta_format::literal_block_length)
+			{
+				flush_buffer();
+			}
+		}
+	}
+	else
+	{
+		if (buffer.size() + data_length > buffer_size)
+		{
+			flush_buffer();
+		}
+
+		if (data_length > buffer_size)
+		{
+			os.write(data, data_length);
+		}
+		else
+		{
+			buffer.insert(buffer.end(), data, data + data_length);
+		}
+	}
+
+	if (!header_known)
+	{
+		this->data_length += data_length;
+		++num_instructions;
+	}
+}
+
+namespace impl
+{
+	bool pending_copy::extend(size_t chunk_id, size_t start_index, size_t data_length)
+	{
+		if (count == 0 || start_index != this->start_index + count * chunk_length)
+		{
+			return false;
+		}
+
+		if (!joined && data_length == chunk_length && chunk_id == this->chunk_id + count)
+		{
+			++count;
+			return true;
+		}
+
+		// chunks of different lengths can't be a range, a single copy grows by them instead
+		if (count == 1)
+		{
+			chunk_length += data_length;
+			joined = true;
+			return true;
+		}
+
+		return false;
+	}
+
+	void pending_copy::reset(size_t chunk_id, size_t start_index, size_t data_length)
+	{
+		this->chunk_id = chunk_id;
+		this->start_index = start_index;
+		chunk_length = data_length;
+		count = 1;
+		joined = false;
+	}
+} // namespace impl
+
+void delta_writer::copy_chunk(size_t chunk_id, size_t start_index, size_t data_length)
+{
+	if (!range.extend(chunk_id, start_index, data_length))
+	{
+		write_range();
+		range.reset(chunk_id, start_index, data_length);
+	}
+
+	if (!header_known)
+	{
+		this->data_length += data_length;
+	}
+}
+
+void delta_writer::zero_fill(size_t, size_t data_length)
+{
+	write_range();
+
+	reserve_buffer(1 + max_varint_length);
+	buffer.push_back(static_cast<char>(delta_format::zero_fill));
+	write_varint(data_length);
+
+	if (!header_known)
+	{
+		this->data_length += data_length;
+		++num_instructions;
+	}
+}
+
+void delta_writer::finish()
+{
+	write_range();
+	flush_buffer();
+
+	if (streamed)
+	{
+		reserve_buffer(1 + 2 * sizeof(uint64_t));
+		buffer.push_back(static_cast<char>(delta_format::end));
+		write_fixed(data_length);
+		write_fixed(num_instructions);
+		flush_buffer();
+	}
+	else if (!header_known)
+	{
+		const auto end_position = os.tellp();
+		if (header_position == std::ostream::pos_type(-1) || end_position == std::ostream::pos_type(-1))
+		{
+			throw std::runtime_error("Unable to write delta header, output stream is not seekable!");
+		}
+
+		os.seekp(header_position);
+		write_header();
+		flush_buffer();
+		os.seekp(end_position);
+		header_known = true;
+	}
+
+	os.flush();
+	if (!os)
+	{
+		throw std::runtime_error("Unable to write delta!");
+	}
+}
+
+void delta_writer::write_header()
+{
+	buffer.insert(buffer.end(), std::begin(delta_format::magic), std::end(delta_format::magic));
+	buffer.push_back(static_cast<char>(literal_codec != codec::none ? delta_format::compressed_version : delta_format::version));
+	write_fixed(data_length);
+	write_fixed(num_instructions);
+}
+
+void delta_writer::write_range()
+{
+	if (range.count == 0)
+	{
+		return;
+	}
+	if (!header_known)
+	{
+		num_instructions += range.count;
+	}
+
+	reserve_buffer(1 + 4 * max_varint_length);
+
+	const bool same_length = range.chunk_length == previous_chunk_length;
+	uint8_t opcode = range.count > 1 ? delta_format::copy_range : delta_format::copy_chunk;
+	if (same_length)
+	{
+		opcode |= delta_format::same_length;
+	}
+	buffer.push_back(static_cast<char>(opcode));
+
+	// unsigned arithmetic wraps around, zigzag turns the difference into a small number for both directions
+	const size_t predicted_start_index = previous_start_index + (range.chunk_id - previous_chunk_id) * previous_chunk_length;
+	write_varint(zigzag_encode(range.chunk_id - (previous_chunk_id + 1)));
+	write_varint(zigzag_encode(range.start_index - predicted_start_index));
+	if (!same_length)
+	{
+		write_varint(range.chunk_length);
+	}
+	if (range.count > 1)
+	{
+		write_varint(range.count);
+	}
+
+	previous_chunk_id = range.chunk_id + range.count - 1;
+	previous_start_index = range.start_index + (range.count - 1) * range.chunk_length;
+	previous_chunk_length = range.chunk_length;
+	range.count = 0;
+}
+
+size_t delta_writer::num_written_instructions(const delta& del)
+{
+	size_t result = 0;
+	impl::pending_copy pending;
+	for (const auto& i : del.instructions)
+	{
+		if (i.command != delta::opcode::copy_chunk)
+		{
+			result += pending.count + 1;
+			pending.count = 0;
+		}
+		else if (!pending.extend(i.chunk_id, i.start_index, i.data_length))
+		{
+			result += pending.count;
+			pending.reset(i.chunk_id, i.start_index, i.data_length);
+		}
+	}
+
+	return result + pending.count;
+}
+
+void delta_writer::write_fixed(uint64_t value)
+{
+	for (size_t i = 0; i < sizeof(value); ++i)
+	{
+		buffer.push_back(static_cast<char>(value >> (8 * i)));
+	}
+}
+
+void delta_writer::write_varint(uint64_t value)
+{
+	append_varint(buffer, value);
+}
+
+void delta_writer::reserve_buffer(size_t length)
+{
+	if (buffer.size() + length > buffer_size)
+	{
+		flush_buffer();
+	}
+}
+
+void delta_writer::flush_buffer()
+{
+	write_literals();
+	os.write(buffer.data(), buffer.size());
+	buffer.clear();
+}
+
+void delta_writer::write_literals()
+{
+	if (literal_block.empty())
+	{
+		return;
+	}
+
+	// blocks that don't get shorter are stored as they are
+	const bool is_compressed = compress_block(literal_codec, literal_block.data(), literal_block.size(), compressed_block);
+	const auto& stored_block = is_compressed ? compressed_block : literal_block;
+
+	std::vector<char> record;
+	record.push_back(static_cast<char>(delta_format::literals));
+	record.push_back(static_cast<char>(is_compressed ? literal_codec : codec::none));
+	append_varint(record, literal_block.size());
+	append_varint(record, stored_block.size());
+	os.write(record.data(), record.size());
+	os.write(stored_block.data(), stored_block.size());
+	literal_block.clear();
+}
+
+delta_reader::delta_reader(std::istream& is)
+	: is(is)
+{
+	char magic[sizeof(delta_format::magic)];
+	read(magic, sizeof(magic));
+
+	if (std::equal(std::begin(magic), std::end(magic), std::begin(delta_format::magic)))
+	{
+		char version = 0;
+		read(&version, sizeof(version));
+		if (static_cast<uint8_t>(version) != delta_format::version && static_cast<uint8_t>(version) != delta_format::compressed_version)
+		{
+			throw std::runtime_error("Unsupported delta version!");
+		}
+		compressed = static_cast<uint8_t>(version) == delta_format::compressed_version;
+
+		header_data_length = read_fixed();
+		header_num_instructions = read_fixed();
+		streamed = header_data_length == delta_format::unknown_length && header_num_instructions == delta_format::unknown_length;
+	}
+	else
+	{
+		// legacy files start directly with the 8 byte data length
+		legacy = true;
+		char rest[sizeof(uint64_t) - sizeof(magic)];
+		read(rest, sizeof(rest));
+
+		uint64_t value = 0;
+		for (size_t i = sizeof(uint64_t); i-- > 0;)
+		{
+			value = (value << 8) | static_cast<uint8_t>(i < sizeof(magic) ? magic[i] : rest[i - sizeof(magic)]);
+		}
+		header_data_length = value;
+		header_num_instructions = read_fixed();
+	}
+}
+
+bool delta_reader::next(delta::instruction& instruction)
+{
+	if (remaining_instruction_data > 0)
+	{
+		if (compressed)
+		{
+			take_literals(nullptr, remaining_instruction_data);
+		}
+		else
+		{
+			is.ignore(static_cast<std::streamsize>(remaining_instruction_data));
+		}
+		remaining_instruction_data = 0;
+	}
+
+	if (instructions_read == header_num_instructions)
+	{
+		if (data_length_read != header_data_length || literal_position != literal_block.size())
+		{
+			throw std::runtime_error("Delta file is corrupted, its instructions don't match its data length!");
+		}
+		return false;
+	}
+
+	if (legacy)
+	{
+		return next_legacy(instruction);
+	}
+
+	instruction.data_offset = 0;
+	if (remaining_range_chunks > 0)
+	{
+		instruction.command = delta::opcode::copy_chunk;
+		instruction.chunk_id = previous_chunk_id + 1;
+		instruction.start_index = previous_start_index + previous_chunk_length;
+		instruction.data_length = previous_chunk_length;
+		--remaining_range_chunks;
+	}
+	else
+	{
+		char opcode = 0;
+		read(&opcode, sizeof(opcode));
+		while (compressed && static_cast<uint8_t>(opcode) == delta_format::literals)
+		{
+			read_literals();
+			read(&opcode, sizeof(opcode));
+		}
+		if (streamed && static_cast<uint8_t>(opcode) == delta_format::end)
+		{
+			// lengths of a streamed delta are known at its end
+			header_data_length = read_fixed();
+			header_num_instructions = read_fixed();
+			streamed = false;
+			if (header_data_length != data_length_read || header_num_instructions != instructions_read
+				|| literal_position != literal_block.size())
+			{
+				throw std::runtime_error("Delta file is corrupted, its instructions don't match its data length!");
+			}
+			return false;
+		}
+
+		switch (static_cast<uint8_t>(opcode) & delta_format::opcode_mask)
+		{
+		case delta_format::copy_data:
+			instruction.command = delta::opcode::copy_data;
+			instruction.chunk_id = 0;
+			instruction.start_index = data_length_read;
+			instruction.data_length = read_varint();
+			break;
+		case delta_format::zero_fill:
+			instruction.command = delta::opcode::zero_fill;
+			instruction.chunk_id = 0;
+			instruction.start_index = data_length_read;
+			instruction.data_length = read_varint();
+			break;
+		case delta_format::copy_chunk:
+		case delta_format::copy_range:
+		{
+			instruction.command = delta::opcode::copy_chunk;
+			instruction.chunk_id = previous_chunk_id + 1 + zigzag_decode(read_varint());
+			instruction.start_index = previous_start_index + (instruction.chunk_id - previous_chunk_id) * previous_chunk_length
+				+ zigzag_decode(read_varint());
+			instruction.data_length = (static_cast<uint8_t>(opcode) & delta_format::same_length) ? previous_chunk_length : read_varint();
+
+			if ((static_cast<uint8_t>(opcode) & delta_format::opcode_mask) == delta_format::copy_range)
+			{
+				const uint64_t count = read_varint();
+				if (count < 2 || count - 1 > header_num_instructions - instructions_read - 1)
+				{
+					throw std::runtime_error("Delta file is corrupted, invalid chunk range!");
+				}
+				remaining_range_chunks = count - 1;
+			}
+			break;
+		}
+		default:
+			throw std::runtime_error("Delta file is corrupted, unknown instruction!");
+		}
+	}
+
+	if (instruction.data_length > header_data_length - data_length_read)
+	{
+		throw std::runtime_error("Delta file is corrupted, its instructions don't match its data length!");
+	}
+	data_length_read += instruction.data_length;
+	++instructions_read;
+
+	if (instruction.command == delta::opcode::copy_data)
+	{
+		remaining_instruction_data = instruction.data_length;
+	}
+	else if (instruction.command == delta::opcode::copy_chunk)
+	{
+		previous_chunk_id = instruction.chunk_id;
+		previous_start_index = instruction.start_index;
+		previous_chunk_length = instruction.data_length;
+	}
+
+	return true;
+}
+
+size_t delta_reader::read_data(char* buffer, size_t length)
+{
+	length = std::min(length, remaining_instruction_data);
+	if (compressed)
+	{
+		take_literals(buffer, length);
+	}
+	else
+	{
+		read(buffer, length);
+	}
+	remaining_instruction_data -= length;
+
+	return length;
+}
+
+void delta_reader::read_literals()
+{
+	if (literal_position != literal_block.size())
+	{
+		throw std::runtime_error("Delta file is corrupted, its literal data doesn't match its instructions!");
+	}
+
+	char block_codec = 0;
+	read(&block_codec, sizeof(block_codec));
+	const uint64_t length = read_varint();
+	const uint64_t stored_length = read_varint();
+	if (length == 0 || length > delta_format::max_literal_block_length || stored_length > length)
+	{
+		throw std::runtime_error("Delta file is corrupted, invalid literal block!");
+	}
+
+	literal_block.resize(length);
+	literal_position = 0;
+	if (static_cast<codec>(block_codec) == codec::none && stored_length == length)
+	{
+		read(literal_block.data(), length);
+	}
+	else
+	{
+		compressed_block.resize(stored_length);
+		read(compressed_block.data(), stored_length);
+		decompress_block(static_cast<codec>(block_codec), compressed_block.data(), stored_length, literal_block.data(), length);
+	}
+}
+
+void delta_reader::take_literals(char* buffer, size_t length)
+{
+	for (size_t done = 0; done < length;)
+	{
+		if (literal_position == literal_block.size())
+		{
+			// data that continues past its block is followed directly by the next block
+			char opcode = 0;
+			read(&opcode, sizeof(opcode));
+			if (static_cast<uint8_t>(opcode) != delta_format::literals)
+			{
+				throw std::runtime_error("Delta file is corrupted, literal block is missing!");
+			}
+			read_literals();
+		}
+
+		const size_t taken = std::min(length - done, literal_block.size() - literal_position);
+		if (buffer != nullptr)
+		{
+			std::memcpy(buffer + done, literal_block.data() + literal_position, taken);
+		}
+		literal_position += taken;
+		done += taken;
+	}
+}
+
+bool delta_reader::next_legacy(delta::instruction& instruction)
+{
+	char command = '\0';
+	read(&command, sizeof(char));
+	if (command != 0 && command != 1)
+	{
+		throw std::runtime_error("Delta file is corrupted, unknown instruction!");
+	}
+	instruction.command = command == 0 ? delta::opcode::copy_data : delta::opcode::copy_chunk;
+
+	instruction.start_index = read_fixed();
+	instruction.chunk_id = read_fixed();
+	instruction.data_length = read_fixed();
+	instruction.data_offset = 0;
+
+	if (instruction.data_length > header_data_length - data_length_read)
+	{
+		throw std::runtime_error("Delta file is corrupted, its instructions don't match its data length!");
+	}
+	data_length_read += instruction.data_length;
+	remaining_instruction_data = command == 0 ? instruction.data_length : 0;
+	++instructions_read;
+
+	return true;
+}
+
+void delta_reader::read(char* buffer, size_t length)
+{
+	is.read(buffer, static_cast<std::streamsize>(length));
+	if (static_cast<size_t>(is.gcount()) != length)
+	{
+		throw std::runtime_error("Delta file is truncated!");
+	}
+}
+
+uint64_t delta_reader::read_fixed()
+{
+	uint8_t bytes[sizeof(uint64_t)];
+	read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+
+	uint64_t value = 0;
+	for (size_t i = sizeof(bytes); i-- > 0;)
+	{
+		value = (value << 8) | bytes[i];
+	}
+
+	return value;
+}
+
+uint64_t delta_reader::read_varint()
+{
+	uint64_t value = 0;
+	for (size_t shift = 0; shift < 64; shift += 7)
+	{
+		char byte = 0;
+		read(&byte, sizeof(byte));
+		value |= static_cast<uint64_t>(static_cast<uint8_t>(byte) & 0x7f) << shift;
+		if ((static_cast<uint8_t>(byte) & 0x80) == 0)
+		{
+			return value;
+		}
+	}
+
+	throw std::runtime_error("Delta file is corrupted, invalid number!");
+}
+
+namespace impl
+{
+	signature_index::signature_index(const signature_view& sig)
+	{
+		if (sig.size() == 0)
+		{
+			throw std::invalid_argument("Signature is empty! ");
+		}
+
+		if (sig.strong_hash_length() > blake2b::max_digest_length)
+		{
+			throw std::invalid_argument("Signature has invalid strong hashes! ");
+		}
+
+		// candidates with the same checksum are next to each other, in the order of the original data
+		std::vector<std::pair<uint32_t, size_t>> checksum_chunk_ids(sig.size());
+		for (size_t i = 0; i < sig.size(); ++i)
+		{
+			checksum_chunk_ids[i] = { sig.checksum(i), i };
+		}
+		std::sort(checksum_chunk_ids.begin(), checksum_chunk_ids.end());
+
+		candidates.resize(sig.size());
+		size_t num_checksums = 0;
+		for (size_t i = 0; i < checksum_chunk_ids.size(); ++i)
+		{
+			const auto chunk_id = checksum_chunk_ids[i].second;
+			candidates[i] = { chunk_id, sig.length(chunk_id), sig.hash(chunk_id) };
+			if (sig.cdc().enabled() && (candidates[i].length == 0 || candidates[i].length > sig.cdc().max_length))
+			{
+				throw std::invalid_argument("Signature has invalid chunks! ");
+			}
+			chunk_lengths.push_back(candidates[i].length);
+			if (i == 0 || checksum_chunk_ids[i].first != checksum_chunk_ids[i - 1].first)
+			{
+				++num_checksums;
+			}
+		}
+
+		// we are trying to match longer chunks first
+		std::sort(chunk_lengths.begin(), chunk_lengths.end(), std::greater<size_t>());
+		chunk_lengths.erase(std::unique(chunk_lengths.begin(), chunk_lengths.end()), chunk_lengths.end());
+		max_chunk_length = chunk_lengths.front();
+		min_chunk_length = chunk_lengths.back();
+
+		// table is at most half full so probe sequences are short, the filter has 16 bits for every checksum
+		uint32_t table_bits = 1;
+		while (table_bits < 32 && (size_t(1) << table_bits) < 2 * num_checksums)
+		{
+			++table_bits;
+		}
+		uint32_t filter_bits = 6;
+		while (filter_bits < 32 && (size_t(1) << filter_bits) < 16 * num_checksums)
+		{
+			++filter_bits;
+		}
+		table.resize(size_t(1) << table_bits);
+		table_shift = 32 - table_bits;
+		table_mask = static_cast<uint32_t>(table.size() - 1);
+		filter.resize((size_t(1) << filter_bits) / 64);
+		filter_shift = 32 - filter_bits;
+
+		for (size_t first = 0; first < checksum_chunk_ids.size();)
+		{
+			const uint32_t checksum = checksum_chunk_ids[first].first;
+			size_t last = first + 1;
+			while (last < checksum_chunk_ids.size() && checksum_chunk_ids[last].first == checksum)
+			{
+				++last;
+			}
+
+			const uint32_t hashed = hash_checksum(checksum);
+			const uint32_t bit = hashed >> filter_shift;
+			filter[bit / 64] |= uint64_t(1) << (bit % 64);
+
+			uint32_t position = hashed >> table_shift;
+			while (table[position].count != 0)
+			{
+				position = (position + 1) & table_mask;
+			}
+			table[position] = { checksum, static_cast<uint32_t>(last - first), first };
+
+			first = last;
+		}
+	}
+} // namespace impl
+
+delta_stats& delta_stats::operator+=(const delta_stats& other)
+{
+	bytes_scanned += other.bytes_scanned;
+	weak_probes += other.weak_probes;
+	weak_hits += other.weak_hits;
+	strong_confirmations += other.strong_confirmations;
+	false_positives += other.false_positives;
+	literal_bytes += other.literal_bytes;
+	matched_bytes += other.matched_bytes;
+	zero_bytes += other.zero_bytes;
+
+	return *this;
+}
+
+delta calculate_delta_parallel(const signature_view& sig, const char* input, size_t input_length, size_t num_threads, size_t segment_length)
+{
+	delta result;
+	delta_builder builder(result);
+	calculate_delta_parallel(sig, input, input_length, builder, num_threads, segment_length);
+
+	return result;
 }
 
 }; // namespace rd
@@ -0,0 +1,175 @@
+#include "hash.hpp"
+
+#include <cstdint>
+#include <type_traits>
+
+#if RD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace rd
+{
+
+namespace
+{
+	void compute_hashes_scalar(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes)
+	{
+		for (size_t i = 0; i < num_chunks; ++i)
+		{
+			hashes[i] = compute_hash(data + i * chunk_length, chunk_length);
+		}
+	}
+
+#if RD_X86_SIMD
+	// Lane k of a vector holds the hash of chunk k. Four bytes of every chunk are gathered at once and added one by one,
+	// bytes are extended to 32 bits with the sign of char so that the result is the same as compute_hash() gives.
+	// Offsets of the chunks are 32 bit so chunks that are too long for them are hashed by the scalar kernel.
+	constexpr bool char_is_signed = std::is_signed_v<char>;
+
+	template <int Byte>
+	RD_TARGET_AVX2 __m256i extract_byte(__m256i words)
+	{
+		const __m256i shifted = _mm256_slli_epi32(words, 24 - 8 * Byte);
+		return char_is_signed ? _mm256_srai_epi32(shifted, 24) : _mm256_srli_epi32(shifted, 24);
+	}
+
+	RD_TARGET_AVX2 __m256i add_byte(__m256i hash, __m256i byte)
+	{
+		hash = _mm256_add_epi32(hash, byte);
+		hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 10));
+		return _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 6));
+	}
+
+	RD_TARGET_AVX2 void compute_hashes_avx2(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes)
+	{
+		constexpr size_t lanes = 8;
+		if (chunk_length > INT32_MAX / lanes)
+		{
+			compute_hashes_scalar(data, chunk_length, num_chunks, hashes);
+			return;
+		}
+
+		const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(chunk_length)));
+		for (; num_chunks >= lanes; num_chunks -= lanes, data += lanes * chunk_length, hashes += lanes)
+		{
+			__m256i hash = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 4 <= chunk_length; i += 4)
+			{
+				const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(data + i), offsets, 1);
+				hash = add_byte(hash, extract_byte<0>(words));
+				hash = add_byte(hash, extract_byte<1>(words));
+				hash = add_byte(hash, extract_byte<2>(words));
+				hash = add_byte(hash, extract_byte<3>(words));
+			}
+			// gathering 4 bytes would read past the end of the last chunk
+			for (; i < chunk_length; ++i)
+			{
+				int bytes[lanes];
+				for (size_t k = 0; k < lanes; ++k)
+				{
+					bytes[k] = data[k * chunk_length + i];
+				}
+				hash = add_byte(hash, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes)));
+			}
+
+			hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 3));
+			hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 11));
+			hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 15));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(hashes), hash);
+		}
+
+		compute_hashes_scalar(data, chunk_length, num_chunks, hashes);
+	}
+
+	// shifts and gathers of GCC start from _mm512_undefined_* values, -O2 reports them as maybe uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+	template <int Byte>
+	RD_TARGET_AVX512 __m512i extract_byte(__m512i words)
+	{
+		const __m512i shifted = _mm512_slli_epi32(words, 24 - 8 * Byte);
+		return char_is_signed ? _mm512_srai_epi32(shifted, 24) : _mm512_srli_epi32(shifted, 24);
+	}
+
+	RD_TARGET_AVX512 __m512i add_byte(__m512i hash, __m512i byte)
+	{
+		hash = _mm512_add_epi32(hash, byte);
+		hash = _mm512_add_epi32(hash, _mm512_slli_epi32(hash, 10));
+		return _mm512_xor_si512(hash, _mm512_srli_epi32(hash, 6));
+	}
+
+	RD_TARGET_AVX512 void compute_hashes_avx512(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes)
+	{
+		constexpr size_t lanes = 16;
+		if (chunk_length > INT32_MAX / lanes)
+		{
+			compute_hashes_scalar(data, chunk_length, num_chunks, hashes);
+			return;
+		}
+
+		const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(static_cast<int>(chunk_length)));
+		for (; num_chunks >= lanes; num_chunks -= lanes, data += lanes * chunk_length, hashes += lanes)
+		{
+			__m512i hash = _mm512_setzero_si512();
+			size_t i = 0;
+			for (; i + 4 <= chunk_length; i += 4)
+			{
+				const __m512i words = _mm512_i32gather_epi32(offsets, data + i, 1);
+				hash = add_byte(hash, extract_byte<0>(words));
+				hash = add_byte(hash, extract_byte<1>(words));
+				hash = add_byte(hash, extract_byte<2>(words));
+				hash = add_byte(hash, extract_byte<3>(words));
+			}
+			// gathering 4 bytes would read past the end of the last chunk
+			for (; i < chunk_length; ++i)
+			{
+				int bytes[lanes];
+				for (size_t k = 0; k < lanes; ++k)
+				{
+					bytes[k] = data[k * chunk_length + i];
+				}
+				hash = add_byte(hash, _mm512_loadu_si512(bytes));
+			}
+
+			hash = _mm512_add_epi32(hash, _mm512_slli_epi32(hash, 3));
+			hash = _mm512_xor_si512(hash, _mm512_srli_epi32(hash, 11));
+			hash = _mm512_add_epi32(hash, _mm512_slli_epi32(hash, 15));
+			_mm512_storeu_si512(hashes, hash);
+		}
+
+		compute_hashes_avx2(data, chunk_length, num_chunks, hashes);
+	}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+} // namespace
+
+namespace impl
+{
+	void compute_hashes_at_level(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes, simd_level level)
+	{
+		switch (level)
+		{
+#if RD_X86_SIMD
+		case simd_level::avx512:
+			compute_hashes_avx512(data, chunk_length, num_chunks, hashes);
+			break;
+		case simd_level::avx2:
+			compute_hashes_avx2(data, chunk_length, num_chunks, hashes);
+			break;
+#endif
+		default:
+			compute_hashes_scalar(data, chunk_length, num_chunks, hashes);
+			break;
+		}
+	}
+} // namespace impl
+
+}; // namespace rd
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+
+#include "cpu_features.hpp"
 
 namespace rd
 {
@@ -15,7 +18,7 @@ namespace rd
 /// <param name="data_length">Length of the input</param>
 /// <returns>uint32_t representing hash of the given data</returns>
 template <typename InIterator>
-uint32_t compute_hash(InIterator& input, size_t data_length)
+uint32_t compute_hash(InIterator&& input, size_t data_length)
 {
     size_t i = 0;
     uint32_t hash = 0;
@@ -33,5 +36,30 @@ uint32_t compute_hash(InIterator& input, size_t data_length)
     return hash;
 }
 
+/// <summary>
+/// Helper functions used internally by the hash
+/// </summary>
+namespace impl
+{
+    /// <summary>
+    /// Jenkins hashes of consecutive chunks computed by the kernel of the given level, all levels give the same result.
+    /// </summary>
+    /// <param name="level">Level of the kernel, it can't be higher than supported_simd_level()</param>
+    void compute_hashes_at_level(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes, simd_level level);
+} // namespace impl
+
+/// <summary>
+/// Computes Jenkins hash of every chunk of consecutive chunks of the same length, hashes[i] = compute_hash(data + i * chunk_length, chunk_length).
+/// The hash has to process bytes one by one, so SIMD kernels hash several chunks at once instead, one chunk in every lane.
+/// </summary>
+/// <param name="data">Pointer to the beginning of the first chunk</param>
+/// <param name="chunk_length">Length of every chunk</param>
+/// <param name="num_chunks">Number of chunks</param>
+/// <param name="hashes">Output array for num_chunks hashes</param>
+inline void compute_hashes(const char* data, size_t chunk_length, size_t num_chunks, uint32_t* hashes)
+{
+    impl::compute_hashes_at_level(data, chunk_length, num_chunks, hashes, impl::supported_simd_level());
+}
+
 
 }; // namespace rd
\ No newline at end of file
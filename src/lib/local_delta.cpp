@@ -0,0 +1,59 @@
+#include "local_delta.hpp"
+
+namespace rd
+{
+
+namespace impl
+{
+	original_index::original_index(const char* original, size_t original_length, size_t block_length)
+		: block_length(block_length)
+	{
+		const size_t num_blocks = original_length / block_length;
+		if (num_blocks == 0)
+		{
+			return;
+		}
+		if (num_blocks >= UINT32_MAX)
+		{
+			throw std::invalid_argument("Original data has too many blocks, the block length has to be longer!");
+		}
+
+		// at most two thirds of the slots are used so the chains stay short
+		size_t num_slots = 1;
+		while (num_slots < num_blocks + num_blocks / 2)
+		{
+			num_slots *= 2;
+		}
+		slots.assign(num_slots, slot{ 0, 0 });
+		mask = num_slots - 1;
+
+		const block_hasher hasher(block_length);
+		for (size_t block = 0; block < num_blocks; ++block)
+		{
+			const uint32_t hash = hasher.hash(original + block * block_length);
+			size_t same_hash = 0;
+			size_t i = slot_index(hash);
+			for (; slots[i].block != 0 && same_hash < max_block_candidates; i = (i + 1) & mask)
+			{
+				same_hash += slots[i].hash == hash;
+			}
+
+			// the first blocks with the same hash are kept, they are as good as the later ones
+			if (same_hash < max_block_candidates)
+			{
+				slots[i] = slot{ hash, static_cast<uint32_t>(block + 1) };
+			}
+		}
+	}
+} // namespace impl
+
+delta calculate_local_delta(const char* original, size_t original_length, const char* input, size_t input_length, local_delta_options options)
+{
+	delta result;
+	delta_builder builder(result);
+	calculate_local_delta(original, original_length, input, input_length, builder, options);
+
+	return result;
+}
+
+}; // namespace rd
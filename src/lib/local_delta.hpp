@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include "delta.hpp"
+#include "progress.hpp"
+#include "zeros.hpp"
+
+namespace rd
+{
+
+/// <summary>
+/// Settings of calculate_local_delta
+/// block_length: Length of the blocks of the original data in the index. A block starts every block_length bytes,
+/// so every run of data common to both files that is at least 2 * block_length - 1 bytes long is found, at any offset.
+/// Shorter blocks find shorter runs but make a bigger index, it takes 12 to 24 bytes per block.
+/// </summary>
+struct local_delta_options
+{
+	size_t block_length{ 16 };
+};
+
+/// <summary>
+/// Helper functions used internally by the local delta
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Polynomial hash of blocks that can be rolled one byte forward
+	/// </summary>
+	class block_hasher
+	{
+	public:
+		explicit block_hasher(size_t block_length)
+			: block_length(block_length)
+		{
+			for (size_t i = 1; i < block_length; ++i)
+			{
+				first_byte_factor *= multiplier;
+			}
+		}
+
+		uint32_t hash(const char* data) const
+		{
+			uint32_t result = 0;
+			for (size_t i = 0; i < block_length; ++i)
+			{
+				result = result * multiplier + static_cast<uint8_t>(data[i]);
+			}
+			return result;
+		}
+
+		/// <summary>
+		/// Hash of the block one byte further, 'removed' is the first byte of the old block and 'added' the byte after it
+		/// </summary>
+		uint32_t roll(uint32_t hash, char removed, char added) const
+		{
+			return (hash - static_cast<uint8_t>(removed) * first_byte_factor) * multiplier + static_cast<uint8_t>(added);
+		}
+
+	private:
+		static constexpr uint32_t multiplier = 0x01000193;
+
+		size_t block_length;
+		uint32_t first_byte_factor{ 1 };
+	};
+
+	/// <summary>
+	/// Hash table of the blocks of the original data that start at multiples of the block length.
+	/// Slots are open addressed with linear probing and keep up to max_block_candidates blocks with the same hash,
+	/// so data repeated many times like runs of zeros doesn't make long chains.
+	/// </summary>
+	class original_index
+	{
+	public:
+		static constexpr size_t max_block_candidates = 8;
+
+		original_index(const char* original, size_t original_length, size_t block_length);
+
+		/// <summary>
+		/// Calls function(position) with positions of the blocks of the original data with the given hash
+		/// </summary>
+		template <typename Function>
+		void for_each_candidate(uint32_t hash, Function function) const
+		{
+			if (slots.empty())
+			{
+				return;
+			}
+
+			for (size_t i = slot_index(hash); slots[i].block != 0; i = (i + 1) & mask)
+			{
+				if (slots[i].hash == hash)
+				{
+					function(static_cast<size_t>(slots[i].block - 1) * block_length);
+				}
+			}
+		}
+
+	private:
+		struct slot
+		{
+			uint32_t hash;
+			uint32_t block; // index of the block + 1, 0 is an empty slot
+		};
+
+		size_t slot_index(uint32_t hash) const
+		{
+			return static_cast<size_t>((hash * uint64_t(0x9E3779B97F4A7C15)) >> 32) & mask;
+		}
+
+		size_t block_length;
+		size_t mask{ 0 };
+		std::vector<slot> slots;
+	};
+} // namespace impl
+
+/// <summary>
+/// Calculates delta of the modified data against the original data when both are available, like two local files,
+/// and passes its instructions to the sink. No signature is needed: the original data is indexed in blocks directly,
+/// every position of the modified data is looked up and matches are extended byte by byte in both directions,
+/// so COPY_CHUNK instructions copy runs of any length from any offset of the original data.
+/// Runs of zeros become ZERO_FILL. The delta is applied by patch like any other delta.
+/// Counters of the stats: weak_probes are lookups, weak_hits blocks with the same hash, false_positives the blocks
+/// that turned out different and strong_confirmations copied matches.
+/// </summary>
+/// <typeparam name="DeltaSink">Delta sink, see delta_builder</typeparam>
+/// <param name="original">Pointer to the beginning of the original data</param>
+/// <param name="original_length">Length of the original data</param>
+/// <param name="input">Pointer to the beginning of the modified data</param>
+/// <param name="input_length">Length of the modified data</param>
+/// <param name="sink">Delta sink that receives the instructions</param>
+/// <param name="options">Length of the indexed blocks</param>
+/// <param name="progress">Optional callback that receives the number of searched bytes of the modified data</param>
+/// <returns>counters and times of the calculation</returns>
+template <typename DeltaSink>
+delta_stats calculate_local_delta(const char* original, size_t original_length, const char* input, size_t input_length, DeltaSink& sink,
+	const local_delta_options& options = {}, const progress_callback& progress = {})
+{
+	if ((original == nullptr && original_length > 0) || (input == nullptr && input_length > 0))
+	{
+		throw std::invalid_argument("original or input parameter is nullptr!");
+	}
+	if (options.block_length == 0)
+	{
+		throw std::invalid_argument("Block length can't be 0!");
+	}
+
+	delta_stats stats;
+	auto start = std::chrono::steady_clock::now();
+	const size_t block_length = options.block_length;
+	const impl::original_index index(original, original_length, block_length);
+	const impl::block_hasher hasher(block_length);
+	stats.index_seconds = impl::seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	impl::stats_sink<DeltaSink> counting_sink(sink, stats);
+	impl::progress_tracker tracker(progress, input_length);
+	const std::vector<char> zero_block(block_length, '\0');
+	const uint32_t zero_hash = hasher.hash(zero_block.data());
+
+	size_t data_index = 0; // beginning of the data that wasn't passed to the sink yet
+	size_t position = 0;
+	uint32_t hash = 0;
+	bool hash_valid = false;
+	while (position + block_length <= input_length)
+	{
+		if (!hash_valid)
+		{
+			hash = hasher.hash(input + position);
+			hash_valid = true;
+		}
+
+		// runs of zeros are checked first like in calculate_delta, they are written as holes even if the original has them too
+		if (hash == zero_hash && is_zero(input + position, block_length))
+		{
+			if (position > data_index)
+			{
+				counting_sink.copy_data(data_index, position - data_index, input + data_index);
+			}
+			const size_t run_length = zero_run_length(input + position, input_length - position);
+			counting_sink.zero_fill(position, run_length);
+			position += run_length;
+			data_index = position;
+			hash_valid = false;
+			tracker.update(position);
+			continue;
+		}
+
+		// the longest match of the candidates, extended backward only over the data that wasn't passed to the sink
+		++stats.weak_probes;
+		size_t match_original = 0;
+		size_t match_backward = 0;
+		size_t match_length = 0;
+		index.for_each_candidate(hash, [&](size_t candidate)
+		{
+			++stats.weak_hits;
+			if (std::memcmp(input + position, original + candidate, block_length) != 0)
+			{
+				++stats.false_positives;
+				return;
+			}
+
+			const size_t forward = block_length + impl::common_prefix_length(input + position + block_length, original + candidate + block_length,
+				std::min(input_length - position, original_length - candidate) - block_length);
+			const size_t backward_limit = std::min(position - data_index, candidate);
+			const size_t backward = impl::common_suffix_length(input + position - backward_limit, original + candidate - backward_limit, backward_limit);
+			if (forward + backward > match_length)
+			{
+				match_original = candidate;
+				match_backward = backward;
+				match_length = forward + backward;
+			}
+		});
+
+		if (match_length > 0)
+		{
+			++stats.strong_confirmations;
+			const size_t match_begin = position - match_backward;
+			if (match_begin > data_index)
+			{
+				counting_sink.copy_data(data_index, match_begin - data_index, input + data_index);
+			}
+			// copies are numbered in order, the delta writer then predicts every copy to continue where the previous one ended
+			counting_sink.copy_chunk(stats.strong_confirmations - 1, match_original - match_backward, match_length);
+			position = match_begin + match_length;
+			data_index = position;
+			hash_valid = false;
+			tracker.update(position);
+			continue;
+		}
+
+		if (position + block_length < input_length)
+		{
+			hash = hasher.roll(hash, input[position], input[position + block_length]);
+		}
+		++position;
+		tracker.update(position);
+	}
+
+	if (data_index < input_length)
+	{
+		counting_sink.copy_data(data_index, input_length - data_index, input + data_index);
+	}
+	stats.bytes_scanned = input_length;
+	tracker.finish();
+	stats.scan_seconds = impl::seconds_since(start);
+
+	return stats;
+}
+
+/// <summary>
+/// Creates delta object of the modified data against the original data, see calculate_local_delta with a sink
+/// </summary>
+delta calculate_local_delta(const char* original, size_t original_length, const char* input, size_t input_length,
+	local_delta_options options = {});
+
+}; // namespace rd
@@ -0,0 +1,232 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rd
+{
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+
+		std::swap(mapping_data, other.mapping_data);
+		std::swap(mapping_size, other.mapping_size);
+#ifdef _WIN32
+		std::swap(file_handle, other.file_handle);
+		std::swap(mapping_handle, other.mapping_handle);
+#else
+		std::swap(file_descriptor, other.file_descriptor);
+#endif
+	}
+
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool mapped_file::open_read(const std::string& file_name)
+{
+	close();
+
+	file_handle = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (GetFileType(file_handle) != FILE_TYPE_DISK || !GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	mapping_data = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (mapping_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	mapping_size = static_cast<size_t>(file_size.QuadPart);
+
+	return true;
+}
+
+bool mapped_file::create(const std::string& file_name, size_t size)
+{
+	close();
+
+	if (size == 0)
+	{
+		return false;
+	}
+
+	file_handle = CreateFileA(file_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		return false;
+	}
+
+	const auto size64 = static_cast<uint64_t>(size);
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64 & 0xffffffff), nullptr);
+	if (mapping_handle == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	mapping_data = static_cast<char*>(MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, 0));
+	if (mapping_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	mapping_size = size;
+
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (mapping_data != nullptr)
+	{
+		UnmapViewOfFile(mapping_data);
+	}
+	if (mapping_handle != nullptr)
+	{
+		CloseHandle(mapping_handle);
+	}
+	if (file_handle != nullptr)
+	{
+		CloseHandle(file_handle);
+	}
+
+	mapping_data = nullptr;
+	mapping_size = 0;
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+}
+
+#else
+
+bool mapped_file::open_read(const std::string& file_name)
+{
+	close();
+
+	file_descriptor = ::open(file_name.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode) || file_status.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	const auto file_size = static_cast<size_t>(file_status.st_size);
+	void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+	mapping_data = static_cast<char*>(mapping);
+	mapping_size = file_size;
+
+	return true;
+}
+
+bool mapped_file::create(const std::string& file_name, size_t size)
+{
+	close();
+
+	if (size == 0)
+	{
+		return false;
+	}
+
+	file_descriptor = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode)
+		|| ftruncate(file_descriptor, static_cast<off_t>(size)) != 0)
+	{
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	mapping_data = static_cast<char*>(mapping);
+	mapping_size = size;
+
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (mapping_data != nullptr)
+	{
+		munmap(mapping_data, mapping_size);
+	}
+	if (file_descriptor >= 0)
+	{
+		::close(file_descriptor);
+	}
+
+	mapping_data = nullptr;
+	mapping_size = 0;
+	file_descriptor = -1;
+}
+
+#endif
+
+}; // namespace rd
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace rd
+{
+
+/// <summary>
+/// File mapped into memory so that its content can be used as a contiguous array.
+/// Only regular, non-empty files can be mapped. For everything else (pipes, devices, empty files...)
+/// open functions return false and the caller should fall back to streams.
+/// The mapping is released when the object is destroyed.
+/// </summary>
+class mapped_file
+{
+public:
+	mapped_file() = default;
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file(mapped_file&& other) noexcept;
+	mapped_file& operator=(mapped_file&& other) noexcept;
+
+	/// <summary>
+	/// Maps the whole existing file for reading
+	/// </summary>
+	/// <param name="file_name">Path to the file</param>
+	/// <returns>true if the file was mapped</returns>
+	bool open_read(const std::string& file_name);
+
+	/// <summary>
+	/// Creates the file (or truncates an existing one) with the given size and maps it for writing
+	/// </summary>
+	/// <param name="file_name">Path to the file</param>
+	/// <param name="size">Size of the new file in bytes</param>
+	/// <returns>true if the file was created and mapped</returns>
+	bool create(const std::string& file_name, size_t size);
+
+	/// <summary>
+	/// Releases the mapping and closes the file
+	/// </summary>
+	void close();
+
+	bool is_open() const { return mapping_data != nullptr; }
+	const char* data() const { return mapping_data; }
+	char* data() { return mapping_data; }
+	size_t size() const { return mapping_size; }
+
+private:
+	char* mapping_data{ nullptr };
+	size_t mapping_size{ 0 };
+
+#ifdef _WIN32
+	void* file_handle{ nullptr };
+	void* mapping_handle{ nullptr };
+#else
+	int file_descriptor{ -1 };
+#endif
+};
+
+}; // namespace rd
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rd
+{
+
+/// <summary>
+/// Returns number of threads to use for the requested number of threads. 0 means all hardware threads.
+/// </summary>
+inline size_t resolve_thread_count(size_t num_threads)
+{
+	if (num_threads == 0)
+	{
+		num_threads = std::thread::hardware_concurrency();
+	}
+
+	return num_threads == 0 ? 1 : num_threads;
+}
+
+/// <summary>
+/// Runs task(i) for every i in [0, task_count) on a pool of worker threads.
+/// Workers take the next task index as soon as they finish the previous one so uneven tasks are balanced.
+/// If a task throws, remaining tasks are skipped and the first exception is rethrown in the calling thread.
+/// </summary>
+/// <typeparam name="Task">Callable with signature void(size_t)</typeparam>
+/// <param name="task_count">Number of tasks</param>
+/// <param name="num_threads">Number of worker threads, 0 means all hardware threads</param>
+/// <param name="task">Task to run</param>
+template <typename Task>
+void parallel_for(size_t task_count, size_t num_threads, const Task& task)
+{
+	num_threads = std::min(resolve_thread_count(num_threads), task_count);
+	if (num_threads <= 1)
+	{
+		for (size_t i = 0; i < task_count; ++i)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next_task{ 0 };
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto worker = [&]()
+	{
+		for (size_t i = next_task++; i < task_count; i = next_task++)
+		{
+			try
+			{
+				task(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				next_task = task_count;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(num_threads - 1);
+	for (size_t i = 1; i < num_threads; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+	worker();
+
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+}; // namespace rd
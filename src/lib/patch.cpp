@@ -0,0 +1,200 @@
+#include "patch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rd
+{
+
+namespace
+{
+	/// <summary>
+	/// Collects writes to consecutive positions of the file and writes them at once
+	/// </summary>
+	class write_buffer
+	{
+	public:
+		explicit write_buffer(random_access_file& file)
+			: file(file)
+		{
+			buffer.reserve(impl::patch_buffer_size * 16);
+		}
+
+		/// <summary>
+		/// Returns buffer for length bytes that are written to the given position
+		/// </summary>
+		char* append(size_t position, size_t length)
+		{
+			if (position != buffer_position + buffer.size() || buffer.size() + length > buffer.capacity())
+			{
+				flush();
+				buffer_position = position;
+			}
+			buffer.resize(buffer.size() + length);
+
+			return buffer.data() + buffer.size() - length;
+		}
+
+		/// <summary>
+		/// Counts bytes that were written to the file directly
+		/// </summary>
+		void add_written(size_t length)
+		{
+			bytes_written += length;
+		}
+
+		void flush()
+		{
+			file.write_at(buffer_position, buffer.data(), buffer.size());
+			bytes_written += buffer.size();
+			buffer.clear();
+		}
+
+		size_t bytes_written{ 0 };
+
+	private:
+		random_access_file& file;
+		std::vector<char> buffer;
+		size_t buffer_position{ 0 };
+	};
+} // namespace
+
+in_place_stats patch_in_place(const std::string& file_name, std::istream& delta_stream, const progress_callback& progress)
+{
+	const auto delta_start = delta_stream.tellg();
+	if (delta_start == std::istream::pos_type(-1))
+	{
+		throw std::invalid_argument("Delta has to be seekable to be applied in place!");
+	}
+
+	random_access_file file;
+	if (!file.open(file_name, true))
+	{
+		throw std::runtime_error("Unable to open file '" + file_name + "' for writing!");
+	}
+	const size_t original_length = file.size();
+
+	// nothing is written until the whole delta is known to be applicable in place,
+	// moved chunks are collected to be applied before the data in the order of in_place_checker
+	struct moved_chunk
+	{
+		size_t target;
+		size_t source;
+		size_t length;
+	};
+	std::vector<moved_chunk> moved_forward;
+	std::vector<moved_chunk> moved_backward;
+	{
+		delta_reader reader(delta_stream);
+		impl::in_place_checker checker;
+		delta::instruction instruction;
+		while (reader.next(instruction))
+		{
+			if (instruction.command == delta::opcode::copy_data || instruction.command == delta::opcode::zero_fill)
+			{
+				checker.add_data(instruction.data_length);
+				continue;
+			}
+
+			if (instruction.start_index > original_length || instruction.data_length > original_length - instruction.start_index)
+			{
+				throw std::runtime_error("Delta doesn't match the original data!");
+			}
+			if (!checker.can_copy(instruction.start_index, instruction.data_length, checker.position()))
+			{
+				throw std::runtime_error("Delta can't be applied in place!");
+			}
+			const moved_chunk chunk{ checker.position(), instruction.start_index, instruction.data_length };
+			if (chunk.source < chunk.target)
+			{
+				moved_forward.push_back(chunk);
+			}
+			else if (chunk.source > chunk.target)
+			{
+				moved_backward.push_back(chunk);
+			}
+			checker.add_chunk(instruction.start_index, instruction.data_length);
+		}
+	}
+
+	delta_stream.clear();
+	delta_stream.seekg(delta_start);
+	delta_reader reader(delta_stream);
+	impl::progress_tracker tracker(progress, reader.is_streamed() ? 0 : reader.data_length());
+	in_place_stats stats;
+	write_buffer writes(file);
+	size_t bytes_done = 0;
+
+	// chunks moved forward go from the last one, each of them in pieces from its end, so a chunk that overlaps
+	// its own target reads every piece before it is overwritten
+	std::vector<char> piece(impl::patch_buffer_size);
+	for (auto chunk = moved_forward.rbegin(); chunk != moved_forward.rend(); ++chunk)
+	{
+		for (size_t remaining = chunk->length; remaining > 0;)
+		{
+			const size_t length = std::min(remaining, impl::patch_buffer_size);
+			remaining -= length;
+			file.read_at(chunk->source + remaining, piece.data(), length);
+			file.write_at(chunk->target + remaining, piece.data(), length);
+			stats.bytes_read += length;
+			writes.add_written(length);
+		}
+		bytes_done += chunk->length;
+		tracker.update(bytes_done);
+	}
+
+	// chunks moved backward go from the first one in pieces from the front, for the same reason
+	for (const auto& chunk : moved_backward)
+	{
+		for (size_t done = 0; done < chunk.length;)
+		{
+			const size_t length = std::min(chunk.length - done, impl::patch_buffer_size);
+			file.read_at(chunk.source + done, writes.append(chunk.target + done, length), length);
+			stats.bytes_read += length;
+			done += length;
+		}
+		bytes_done += chunk.length;
+		tracker.update(bytes_done);
+	}
+
+	// data and runs of zeros are written last, chunks that stay at their position are already in the file
+	size_t output_position = 0;
+	delta::instruction instruction;
+	while (reader.next(instruction))
+	{
+		if (instruction.command == delta::opcode::zero_fill)
+		{
+			stats.zero_bytes += instruction.data_length;
+			writes.add_written(file.zero_range(output_position, instruction.data_length));
+		}
+		else if (instruction.command == delta::opcode::copy_data)
+		{
+			for (size_t done = 0; done < instruction.data_length;)
+			{
+				const size_t length = std::min(instruction.data_length - done, impl::patch_buffer_size);
+				if (reader.read_data(writes.append(output_position + done, length), length) != length)
+				{
+					throw std::runtime_error("Delta file is corrupted, missing data!");
+				}
+				done += length;
+			}
+		}
+
+		if (instruction.command != delta::opcode::copy_chunk || instruction.start_index == output_position)
+		{
+			bytes_done += instruction.data_length;
+			tracker.update(bytes_done);
+		}
+		output_position += instruction.data_length;
+	}
+	writes.flush();
+	file.resize(output_position);
+	tracker.finish(output_position);
+
+	stats.data_length = output_position;
+	stats.bytes_written = writes.bytes_written;
+
+	return stats;
+}
+
+}; // namespace rd
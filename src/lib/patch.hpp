@@ -4,12 +4,82 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 
 #include "signature.hpp"
 #include "delta.hpp"
+#include "progress.hpp"
+#include "random_access_file.hpp"
+#include "zeros.hpp"
 
 namespace rd
 {
+
+namespace impl
+{
+	/// <summary>
+	/// Length of the blocks of memory outputs that are checked before zeros are stored to them
+	/// </summary>
+	constexpr size_t zero_check_length = 4096;
+
+	/// <summary>
+	/// Writes a run of zero bytes to the output. Memory outputs are stored only where they aren't zero already,
+	/// so pages of a new file mapped for the output stay holes instead of being allocated for zeros.
+	/// </summary>
+	template <typename OutIterator>
+	OutIterator write_zeros(OutIterator output, size_t length)
+	{
+		if constexpr (std::is_same_v<OutIterator, char*>)
+		{
+			for (size_t done = 0; done < length; done += zero_check_length)
+			{
+				const size_t block_length = std::min(length - done, zero_check_length);
+				if (!is_zero(output + done, block_length))
+				{
+					std::fill_n(output + done, block_length, '\0');
+				}
+			}
+			return output + length;
+		}
+		else
+		{
+			return std::fill_n(output, length, '\0');
+		}
+	}
+
+	/// <summary>
+	/// Copies data to the output, blocks of zeros are written to memory outputs by write_zeros
+	/// </summary>
+	template <typename OutIterator>
+	OutIterator copy_to_output(const char* data, size_t length, OutIterator output)
+	{
+		if constexpr (std::is_same_v<OutIterator, char*>)
+		{
+			for (size_t done = 0; done < length; done += zero_check_length)
+			{
+				const size_t block_length = std::min(length - done, zero_check_length);
+				if (is_zero(data + done, block_length))
+				{
+					write_zeros(output + done, block_length);
+				}
+				else
+				{
+					std::copy_n(data + done, block_length, output + done);
+				}
+			}
+			return output + length;
+		}
+		else
+		{
+			return std::copy_n(data, length, output);
+		}
+	}
+} // namespace impl
+
 /// <summary>
 /// Applies delta to the original file to create updated file. 
 /// </summary>
@@ -17,25 +87,260 @@ namespace rd
 /// <param name="original">Pointer to original data array</param>
 /// <param name="del">Delta structure used for patching</param>
 /// <param name="output">Iterator to the output data</param>
+/// <param name="progress">Optional callback that receives the number of written bytes</param>
 template <typename OutIterator>
-void patch(const char* original, const delta& del, OutIterator output)
+void patch(const char* original, const delta& del, OutIterator output, const progress_callback& progress = {})
 {
+	impl::progress_tracker tracker(progress, del.data_length);
+	size_t output_position = 0;
 	for (const auto& instruction : del.instructions)
 	{
-		if (instruction.command == "COPY_DATA")
+		switch (instruction.command)
+		{
+		case delta::opcode::copy_data:
+			output = std::copy_n(del.data(instruction), instruction.data_length, output);
+			break;
+		case delta::opcode::copy_chunk:
+			output = std::copy_n(original + instruction.start_index, instruction.data_length, output);
+			break;
+		case delta::opcode::zero_fill:
+			output = impl::write_zeros(output, instruction.data_length);
+			break;
+		default:
+			throw std::invalid_argument("Unknown command in delta file!");
+		}
+		output_position += instruction.data_length;
+		tracker.update(output_position);
+	}
+	tracker.finish();
+};
+
+namespace impl
+{
+	/// <summary>
+	/// Size of the buffer used for copying data of streamed instructions
+	/// </summary>
+	constexpr size_t patch_buffer_size = 64 * 1024;
+
+	/// <summary>
+	/// Length of the output that is put together in memory before it is written.
+	/// Chunks of the original file copied to one batch are read sorted by their position in the file.
+	/// </summary>
+	constexpr size_t patch_batch_length = 8 * 1024 * 1024;
+
+	/// <summary>
+	/// Chunks of the original file that are closer than this are read at once, reading the gap is cheaper than another seek
+	/// </summary>
+	constexpr size_t patch_read_gap = 64 * 1024;
+
+	/// <summary>
+	/// Copies data of the current COPY_DATA instruction from the reader to the output
+	/// </summary>
+	template <typename OutIterator>
+	OutIterator copy_instruction_data(delta_reader& reader, std::vector<char>& buffer, OutIterator output)
+	{
+		for (size_t length = reader.read_data(buffer.data(), buffer.size()); length > 0;
+			length = reader.read_data(buffer.data(), buffer.size()))
 		{
-			output = std::copy(instruction.data.cbegin(), instruction.data.cend(), output);
+			output = std::copy_n(buffer.cbegin(), length, output);
 		}
-		else if (instruction.command == "COPY_CHUNK")
+
+		return output;
+	}
+
+	/// <summary>
+	/// Gives instructions of a delta in memory the same way as delta_reader reads them from a delta file
+	/// </summary>
+	class delta_instruction_source
+	{
+	public:
+		explicit delta_instruction_source(const delta& del)
+			: del(del)
 		{
-			output = std::copy_n(original + instruction.start_index, instruction.data_length, output);
 		}
-		else
+
+		bool next(delta::instruction& instruction)
+		{
+			if (index == del.instructions.size())
+			{
+				return false;
+			}
+
+			instruction = del.instructions[index++];
+			if (instruction.command == delta::opcode::copy_data)
+			{
+				data = del.data(instruction);
+				remaining_data = instruction.data_length;
+			}
+			else if (instruction.command != delta::opcode::copy_chunk && instruction.command != delta::opcode::zero_fill)
+			{
+				throw std::invalid_argument("Unknown command in delta file!");
+			}
+
+			return true;
+		}
+
+		size_t read_data(char* buffer, size_t length)
 		{
-			throw std::invalid_argument("Unknown command in delta file: " + instruction.command);
+			length = std::min(length, remaining_data);
+			std::copy_n(data, length, buffer);
+			data += length;
+			remaining_data -= length;
+
+			return length;
+		}
+
+	private:
+		const delta& del;
+		size_t index{ 0 };
+		const char* data{ nullptr };
+		size_t remaining_data{ 0 };
+	};
+
+	/// <summary>
+	/// Reads the original data from a file stream at arbitrary positions
+	/// </summary>
+	class stream_reader
+	{
+	public:
+		explicit stream_reader(std::ifstream& original)
+			: original(original)
+		{
+		}
+
+		void operator()(size_t position, char* data, size_t length) const
+		{
+			original.clear();
+			original.seekg(static_cast<std::streamoff>(position), original.beg);
+			original.read(data, static_cast<std::streamsize>(length));
+			if (static_cast<size_t>(original.gcount()) != length)
+			{
+				throw std::runtime_error("Delta doesn't match the original data!");
+			}
+		}
+
+	private:
+		std::ifstream& original;
+	};
+
+	/// <summary>
+	/// Chunk of the original file that is copied to a batch of the output
+	/// </summary>
+	struct chunk_read
+	{
+		size_t position{ 0 }; // position in the original file
+		size_t length{ 0 };
+		size_t target{ 0 };   // position in the batch
+	};
+
+	/// <summary>
+	/// Reads chunks of one batch in the order of their positions in the original file.
+	/// Runs of chunks that follow each other both in the file and in the batch are read at once straight into the batch,
+	/// other chunks close to each other are read at once into the span buffer and copied from there.
+	/// </summary>
+	template <typename ReadAt>
+	void read_chunks(const ReadAt& read_at, std::vector<chunk_read>& reads, char* batch, std::vector<char>& span)
+	{
+		std::sort(reads.begin(), reads.end(), [](const chunk_read& left, const chunk_read& right)
+		{
+			return left.position != right.position ? left.position < right.position : left.target < right.target;
+		});
+
+		for (size_t first = 0; first < reads.size();)
+		{
+			const size_t span_begin = reads[first].position;
+			size_t span_end = span_begin + reads[first].length;
+			bool contiguous = true;
+			size_t last = first + 1;
+			for (; last < reads.size() && reads[last].position <= span_end + patch_read_gap
+				&& reads[last].position + reads[last].length - span_begin <= patch_batch_length; ++last)
+			{
+				contiguous = contiguous && reads[last].position == span_end
+					&& reads[last].target == reads[last - 1].target + reads[last - 1].length;
+				span_end = std::max(span_end, reads[last].position + reads[last].length);
+			}
+
+			if (contiguous)
+			{
+				read_at(span_begin, batch + reads[first].target, span_end - span_begin);
+			}
+			else
+			{
+				span.resize(span_end - span_begin);
+				read_at(span_begin, span.data(), span.size());
+				for (size_t i = first; i < last; ++i)
+				{
+					std::copy_n(span.data() + (reads[i].position - span_begin), reads[i].length, batch + reads[i].target);
+				}
+			}
+			first = last;
 		}
 	}
-};
+
+	/// <summary>
+	/// Applies instructions to an original file that is read at arbitrary positions.
+	/// Output is put together in batches: literal data is read into the batch right away and chunks are collected,
+	/// then read sorted by their position in the original file and coalesced into large reads (see read_chunks).
+	/// Runs of zeros are filled in the batch and skipped when memory outputs are written (see copy_to_output).
+	/// </summary>
+	/// <typeparam name="InstructionSource">delta_reader or delta_instruction_source</typeparam>
+	/// <typeparam name="ReadAt">Callable with signature void(size_t position, char* data, size_t length), reads the original file</typeparam>
+	/// <returns>length of the output</returns>
+	template <typename InstructionSource, typename ReadAt, typename OutIterator>
+	size_t patch_in_batches(InstructionSource& source, const ReadAt& read_at, size_t batch_length, OutIterator output, progress_tracker& tracker)
+	{
+		std::vector<char> batch(std::max<size_t>(1, batch_length));
+		std::vector<char> span;
+		std::vector<chunk_read> reads;
+		size_t used = 0;
+		size_t output_position = 0;
+		auto write_batch = [&]()
+		{
+			read_chunks(read_at, reads, batch.data(), span);
+			reads.clear();
+			output = copy_to_output(batch.data(), used, output);
+			output_position += used;
+			used = 0;
+			tracker.update(output_position);
+		};
+
+		delta::instruction instruction;
+		while (source.next(instruction))
+		{
+			// instructions longer than the rest of the batch are split
+			for (size_t done = 0; done < instruction.data_length;)
+			{
+				if (used == batch.size())
+				{
+					write_batch();
+				}
+
+				size_t length = std::min(instruction.data_length - done, batch.size() - used);
+				if (instruction.command == delta::opcode::copy_data)
+				{
+					length = source.read_data(batch.data() + used, length);
+					if (length == 0)
+					{
+						throw std::runtime_error("Delta file is corrupted, missing data!");
+					}
+				}
+				else if (instruction.command == delta::opcode::zero_fill)
+				{
+					std::fill_n(batch.data() + used, length, '\0');
+				}
+				else
+				{
+					reads.push_back({ instruction.start_index + done, length, used });
+				}
+				used += length;
+				done += length;
+			}
+		}
+		write_batch();
+
+		return output_position;
+	}
+}
 
 /// <summary>
 /// Applies delta to the original file to create updated file.
@@ -44,25 +349,134 @@ void patch(const char* original, const delta& del, OutIterator output)
 /// <param name="original">Input file stream of the original data</param>
 /// <param name="del">Delta structure used for patching</param>
 /// <param name="output">Iterator to the output data</param>
+/// <param name="progress">Optional callback that receives the number of written bytes</param>
 template <typename OutIterator>
-void patch(std::ifstream& original, const delta& del, OutIterator output)
+void patch(std::ifstream& original, const delta& del, OutIterator output, const progress_callback& progress = {})
 {
-	for (const auto& instruction : del.instructions)
+	// chunks are read in batches sorted by their position, see impl::patch_in_batches
+	impl::delta_instruction_source source(del);
+	impl::progress_tracker tracker(progress, del.data_length);
+	impl::patch_in_batches(source, impl::stream_reader(original), std::min(del.data_length, impl::patch_batch_length), output, tracker);
+	tracker.finish();
+};
+
+/// <summary>
+/// Applies delta to the original file to create updated file. Instructions are read from the delta file
+/// while patching, so the delta is never loaded into memory as a whole.
+/// </summary>
+/// <typeparam name="OutIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+/// <param name="original">Pointer to original data array</param>
+/// <param name="original_length">Length of the original data, chunks outside of it are rejected</param>
+/// <param name="reader">Reader of the delta file</param>
+/// <param name="output">Iterator to the output data</param>
+/// <param name="progress">Optional callback that receives the number of written bytes</param>
+template <typename OutIterator>
+void patch(const char* original, size_t original_length, delta_reader& reader, OutIterator output, const progress_callback& progress = {})
+{
+	std::vector<char> buffer(impl::patch_buffer_size);
+	impl::progress_tracker tracker(progress, reader.is_streamed() ? 0 : reader.data_length());
+	size_t output_position = 0;
+	delta::instruction instruction;
+	while (reader.next(instruction))
 	{
-		if (instruction.command == "COPY_DATA")
+		if (instruction.command == delta::opcode::copy_data)
 		{
-			output = std::copy(instruction.data.cbegin(), instruction.data.cend(), output);
+			output = impl::copy_instruction_data(reader, buffer, output);
 		}
-		else if (instruction.command == "COPY_CHUNK")
+		else if (instruction.command == delta::opcode::zero_fill)
 		{
-			original.seekg(instruction.start_index, original.beg);
-			output = std::copy_n(std::istreambuf_iterator<char>(original), instruction.data_length, output);
+			output = impl::write_zeros(output, instruction.data_length);
 		}
 		else
 		{
-			throw std::invalid_argument("Unknown command in delta file: " + instruction.command);
+			if (instruction.start_index > original_length || instruction.data_length > original_length - instruction.start_index)
+			{
+				throw std::runtime_error("Delta doesn't match the original data!");
+			}
+			output = std::copy_n(original + instruction.start_index, instruction.data_length, output);
 		}
+		output_position += instruction.data_length;
+		tracker.update(output_position);
 	}
+	tracker.finish(output_position);
 };
 
+/// <summary>
+/// Applies delta to the original file to create updated file. Instructions are read from the delta file
+/// while patching, so the delta is never loaded into memory as a whole.
+/// </summary>
+/// <typeparam name="OutIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+/// <param name="original">Input file stream of the original data</param>
+/// <param name="reader">Reader of the delta file</param>
+/// <param name="output">Iterator to the output data</param>
+/// <param name="progress">Optional callback that receives the number of written bytes</param>
+template <typename OutIterator>
+void patch(std::ifstream& original, delta_reader& reader, OutIterator output, const progress_callback& progress = {})
+{
+	// chunks are read in batches sorted by their position, see impl::patch_in_batches
+	const size_t data_length = reader.is_streamed() ? 0 : reader.data_length();
+	impl::progress_tracker tracker(progress, data_length);
+	const size_t batch_length = reader.is_streamed() ? impl::patch_batch_length : std::min(data_length, impl::patch_batch_length);
+	tracker.finish(impl::patch_in_batches(reader, impl::stream_reader(original), batch_length, output, tracker));
+};
+
+/// <summary>
+/// Applies delta to the original file to create updated file. Instructions are read from the delta file
+/// while patching, so the delta is never loaded into memory as a whole.
+/// Output is put together in batches of a few megabytes and the chunks of every batch are read from the original file
+/// with a few large positional reads in the order of the file, which avoids a seek for every chunk.
+/// </summary>
+/// <typeparam name="OutIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+/// <param name="original">Original file, chunks outside of it are rejected</param>
+/// <param name="reader">Reader of the delta file</param>
+/// <param name="output">Iterator to the output data</param>
+/// <param name="progress">Optional callback that receives the number of written bytes</param>
+template <typename OutIterator>
+void patch(const random_access_file& original, delta_reader& reader, OutIterator output, const progress_callback& progress = {})
+{
+	auto read_at = [&original](size_t position, char* data, size_t length)
+	{
+		if (position > original.size() || length > original.size() - position)
+		{
+			throw std::runtime_error("Delta doesn't match the original data!");
+		}
+		original.read_at(position, data, length);
+	};
+
+	const size_t data_length = reader.is_streamed() ? 0 : reader.data_length();
+	impl::progress_tracker tracker(progress, data_length);
+	const size_t batch_length = reader.is_streamed() ? impl::patch_batch_length : std::min(data_length, impl::patch_batch_length);
+	tracker.finish(impl::patch_in_batches(reader, read_at, batch_length, output, tracker));
+};
+
+/// <summary>
+/// Counts of an in-place patch
+/// </summary>
+struct in_place_stats
+{
+	size_t data_length{ 0 };   // length of the patched file
+	size_t bytes_written{ 0 }; // bytes written to the file, chunks that stay at their position are not written
+	size_t bytes_read{ 0 };    // bytes of moved chunks read from the file
+	size_t zero_bytes{ 0 };    // bytes of runs of zeros, deallocated where the file system supports holes and written otherwise
+};
+
+/// <summary>
+/// Applies delta to the original file in place, without a second copy of the file. Only regions that change are written,
+/// with positional writes, so the I/O grows with the size of the change instead of the size of the file.
+/// Runs of zeros punch holes into the file where the file system supports it.
+/// Moved chunks are copied first, those moved forward from the last one and then those moved backward from the first one,
+/// and the data and runs of zeros are written after them. Every chunk has to be copied before its data is overwritten
+/// in this order (see impl::in_place_checker), which deltas created with in_place_sink guarantee.
+/// Chunks that stay at their position are neither read nor written.
+/// The delta is checked in a first pass and rejected before the file is touched if it can't be applied in place,
+/// so the delta stream has to be seekable. The file is truncated or extended to the length of the patched data at the end.
+/// Throws std::invalid_argument if the delta stream can't seek and std::runtime_error if the delta doesn't fit the file,
+/// can't be applied in place or the file can't be read or written.
+/// </summary>
+/// <param name="file_name">Path to the original file that is patched</param>
+/// <param name="delta_stream">Seekable stream of the delta file</param>
+/// <param name="progress">Optional callback that receives the number of bytes of the patched data</param>
+/// <returns>counts of the patch</returns>
+in_place_stats patch_in_place(const std::string& file_name, std::istream& delta_stream, const progress_callback& progress = {});
+
 }; // namespace rd
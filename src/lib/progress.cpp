@@ -0,0 +1,34 @@
+#include "progress.hpp"
+
+#include <algorithm>
+
+namespace rd
+{
+
+namespace impl
+{
+	void progress_tracker::finish(size_t bytes_done)
+	{
+		if (callback != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(report_mutex);
+			next_report = SIZE_MAX;
+			(*callback)(bytes_done, bytes_done);
+		}
+	}
+
+	void progress_tracker::report(size_t bytes_done)
+	{
+		std::lock_guard<std::mutex> lock(report_mutex);
+		// parallel parts can finish in any order, reports that are not past the last one are skipped
+		if (bytes_done < next_report)
+		{
+			return;
+		}
+
+		next_report = (bytes_done / progress_interval + 1) * progress_interval;
+		(*callback)(total == 0 ? bytes_done : std::min(bytes_done, total), total);
+	}
+} // namespace impl
+
+}; // namespace rd
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace rd
+{
+
+/// <summary>
+/// Callback that receives progress of a long calculation: bytes of the input processed so far and length of the input.
+/// It is called about once per progress_interval bytes and once more with the whole length when the calculation is done.
+/// bytes_total is 0 while the length of the input is not known, for example when a stream is read until its end;
+/// the last call then gets the number of processed bytes as both values.
+/// Parallel functions call it from one thread at a time, but not necessarily from the calling thread.
+/// </summary>
+using progress_callback = std::function<void(size_t bytes_done, size_t bytes_total)>;
+
+/// <summary>
+/// Amount of processed data between two calls of the progress callback
+/// </summary>
+constexpr size_t progress_interval = 4 * 1024 * 1024;
+
+/// <summary>
+/// Helper functions used internally by functions that report progress
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Calls the progress callback whenever processed data crosses the next multiple of progress_interval.
+	/// Without a callback the next report position is never reached, so checking it in a hot loop is a single comparison.
+	/// </summary>
+	class progress_tracker
+	{
+	public:
+		progress_tracker() = default;
+
+		progress_tracker(const progress_callback& callback, size_t total)
+			: callback(callback ? &callback : nullptr), total(total), next_report(callback ? progress_interval : SIZE_MAX)
+		{
+		}
+
+		progress_tracker(const progress_tracker&) = delete;
+		progress_tracker& operator=(const progress_tracker&) = delete;
+
+		/// <summary>
+		/// Sets position of the processed data, used by sequential functions
+		/// </summary>
+		void update(size_t bytes_done)
+		{
+			if (bytes_done >= next_report)
+			{
+				report(bytes_done);
+			}
+		}
+
+		/// <summary>
+		/// Adds length of a processed part of the data, can be called from any thread
+		/// </summary>
+		void add(size_t bytes)
+		{
+			if (callback != nullptr)
+			{
+				report(bytes_added.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+			}
+		}
+
+		/// <summary>
+		/// Reports that all data was processed
+		/// </summary>
+		void finish()
+		{
+			finish(total);
+		}
+
+		/// <summary>
+		/// Reports that all data was processed, used when the length of the data wasn't known in advance
+		/// </summary>
+		void finish(size_t bytes_done);
+
+	private:
+		void report(size_t bytes_done);
+
+		const progress_callback* callback{ nullptr };
+		size_t total{ 0 };
+		size_t next_report{ SIZE_MAX };
+		std::atomic<size_t> bytes_added{ 0 };
+		std::mutex report_mutex;
+	};
+} // namespace impl
+
+}; // namespace rd
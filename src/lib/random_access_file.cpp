@@ -0,0 +1,252 @@
+#include "random_access_file.hpp"
+#include "zeros.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rd
+{
+
+random_access_file::~random_access_file()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool random_access_file::open(const std::string& file_name, bool writable)
+{
+	close();
+
+	file_handle = CreateFileA(file_name.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, writable ? 0 : FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (GetFileType(file_handle) != FILE_TYPE_DISK || !GetFileSizeEx(file_handle, &size))
+	{
+		close();
+		return false;
+	}
+	file_size = static_cast<size_t>(size.QuadPart);
+
+	return true;
+}
+
+void random_access_file::close()
+{
+	if (file_handle != nullptr)
+	{
+		CloseHandle(file_handle);
+	}
+
+	file_handle = nullptr;
+	file_size = 0;
+}
+
+bool random_access_file::is_open() const
+{
+	return file_handle != nullptr;
+}
+
+void random_access_file::read_at(size_t position, char* data, size_t data_length) const
+{
+	if (position > file_size || data_length > file_size - position)
+	{
+		throw std::runtime_error("Read past the end of the file!");
+	}
+
+	while (data_length > 0)
+	{
+		OVERLAPPED overlapped{};
+		const auto position64 = static_cast<uint64_t>(position);
+		overlapped.Offset = static_cast<DWORD>(position64 & 0xffffffff);
+		overlapped.OffsetHigh = static_cast<DWORD>(position64 >> 32);
+		DWORD length_read = 0;
+		const auto length = static_cast<DWORD>(std::min<size_t>(data_length, 1 << 30));
+		if (!ReadFile(file_handle, data, length, &length_read, &overlapped) || length_read == 0)
+		{
+			throw std::runtime_error("Unable to read the file!");
+		}
+		position += length_read;
+		data += length_read;
+		data_length -= length_read;
+	}
+}
+
+void random_access_file::write_at(size_t position, const char* data, size_t data_length)
+{
+	const size_t end = position + data_length;
+	while (data_length > 0)
+	{
+		OVERLAPPED overlapped{};
+		const auto position64 = static_cast<uint64_t>(position);
+		overlapped.Offset = static_cast<DWORD>(position64 & 0xffffffff);
+		overlapped.OffsetHigh = static_cast<DWORD>(position64 >> 32);
+		DWORD length_written = 0;
+		const auto length = static_cast<DWORD>(std::min<size_t>(data_length, 1 << 30));
+		if (!WriteFile(file_handle, data, length, &length_written, &overlapped) || length_written == 0)
+		{
+			throw std::runtime_error("Unable to write the file!");
+		}
+		position += length_written;
+		data += length_written;
+		data_length -= length_written;
+	}
+	file_size = std::max(file_size, end);
+}
+
+void random_access_file::resize(size_t size)
+{
+	LARGE_INTEGER end;
+	end.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(file_handle, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle))
+	{
+		throw std::runtime_error("Unable to change size of the file!");
+	}
+	file_size = size;
+}
+
+#else
+
+bool random_access_file::open(const std::string& file_name, bool writable)
+{
+	close();
+
+	file_descriptor = ::open(file_name.c_str(), writable ? O_RDWR : O_RDONLY);
+	if (file_descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode))
+	{
+		close();
+		return false;
+	}
+	file_size = static_cast<size_t>(file_status.st_size);
+
+	return true;
+}
+
+void random_access_file::close()
+{
+	if (file_descriptor >= 0)
+	{
+		::close(file_descriptor);
+	}
+
+	file_descriptor = -1;
+	file_size = 0;
+}
+
+bool random_access_file::is_open() const
+{
+	return file_descriptor >= 0;
+}
+
+void random_access_file::read_at(size_t position, char* data, size_t data_length) const
+{
+	if (position > file_size || data_length > file_size - position)
+	{
+		throw std::runtime_error("Read past the end of the file!");
+	}
+
+	// pread can return less than requested, for example when it is interrupted by a signal
+	while (data_length > 0)
+	{
+		const auto length_read = pread(file_descriptor, data, std::min<size_t>(data_length, 1 << 30), static_cast<off_t>(position));
+		if (length_read < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (length_read <= 0)
+		{
+			throw std::runtime_error("Unable to read the file!");
+		}
+		position += static_cast<size_t>(length_read);
+		data += length_read;
+		data_length -= static_cast<size_t>(length_read);
+	}
+}
+
+void random_access_file::write_at(size_t position, const char* data, size_t data_length)
+{
+	const size_t end = position + data_length;
+	while (data_length > 0)
+	{
+		const auto length_written = pwrite(file_descriptor, data, std::min<size_t>(data_length, 1 << 30), static_cast<off_t>(position));
+		if (length_written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (length_written <= 0)
+		{
+			throw std::runtime_error("Unable to write the file!");
+		}
+		position += static_cast<size_t>(length_written);
+		data += length_written;
+		data_length -= static_cast<size_t>(length_written);
+	}
+	file_size = std::max(file_size, end);
+}
+
+void random_access_file::resize(size_t size)
+{
+	if (ftruncate(file_descriptor, static_cast<off_t>(size)) != 0)
+	{
+		throw std::runtime_error("Unable to change size of the file!");
+	}
+	file_size = size;
+}
+
+#endif
+
+size_t random_access_file::zero_range(size_t position, size_t data_length)
+{
+	const size_t end = position + data_length;
+	if (end > file_size)
+	{
+		// extended part of a file reads as zeros
+		const size_t inside_end = std::max(position, file_size);
+		resize(end);
+		data_length = inside_end - position;
+	}
+
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+	if (data_length > 0 && fallocate(file_descriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		static_cast<off_t>(position), static_cast<off_t>(data_length)) == 0)
+	{
+		return 0;
+	}
+#endif
+
+	// file systems without holes get the zeros written
+	for (size_t done = 0; done < data_length;)
+	{
+		const size_t length = std::min(data_length - done, impl::zero_block_length);
+		write_at(position + done, impl::zero_block(), length);
+		done += length;
+	}
+
+	return data_length;
+}
+
+}; // namespace rd
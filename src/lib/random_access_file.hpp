@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace rd
+{
+
+/// <summary>
+/// Regular file read and written at arbitrary positions with positional reads and writes (pread, pwrite), without a shared
+/// file position, so reads don't go through a stream buffer and don't need a seek each.
+/// The file is closed when the object is destroyed.
+/// </summary>
+class random_access_file
+{
+public:
+	random_access_file() = default;
+	~random_access_file();
+
+	random_access_file(const random_access_file&) = delete;
+	random_access_file& operator=(const random_access_file&) = delete;
+
+	/// <summary>
+	/// Opens existing regular file
+	/// </summary>
+	/// <param name="file_name">Path to the file</param>
+	/// <param name="writable">Opens the file for writing as well</param>
+	/// <returns>true if the file was opened</returns>
+	bool open(const std::string& file_name, bool writable = false);
+
+	/// <summary>
+	/// Closes the file
+	/// </summary>
+	void close();
+
+	bool is_open() const;
+	size_t size() const { return file_size; }
+
+	/// <summary>
+	/// Reads data_length bytes from the given position of the file.
+	/// Throws std::runtime_error if the range is outside of the file or the file can't be read.
+	/// </summary>
+	void read_at(size_t position, char* data, size_t data_length) const;
+
+	/// <summary>
+	/// Writes data_length bytes to the given position of the file, the file grows if it is written past its end.
+	/// Throws std::runtime_error if the file can't be written.
+	/// </summary>
+	void write_at(size_t position, const char* data, size_t data_length);
+
+	/// <summary>
+	/// Makes data_length bytes at the given position read as zeros. Where the file system supports it the range is deallocated
+	/// (a hole is punched), otherwise zeros are written. Part of the range past the end of the file extends the file with a hole.
+	/// Throws std::runtime_error if the file can't be written.
+	/// </summary>
+	/// <returns>number of bytes that had to be written as zeros</returns>
+	size_t zero_range(size_t position, size_t data_length);
+
+	/// <summary>
+	/// Truncates or extends the file to the given size. Throws std::runtime_error if the size can't be changed.
+	/// </summary>
+	void resize(size_t size);
+
+private:
+	size_t file_size{ 0 };
+
+#ifdef _WIN32
+	void* file_handle{ nullptr };
+#else
+	int file_descriptor{ -1 };
+#endif
+};
+
+}; // namespace rd
@@ -0,0 +1,179 @@
+#include "read_ahead.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace rd
+{
+
+namespace impl
+{
+	read_ahead::read_ahead(std::istream& input, size_t block_length, size_t num_blocks, size_t prefix_length)
+		: input(input), block_length_(block_length), prefix_length_(prefix_length)
+	{
+		if (block_length == 0 || num_blocks < 2)
+		{
+			throw std::invalid_argument("Invalid blocks of read-ahead!");
+		}
+
+		blocks.resize(num_blocks);
+		for (auto& block : blocks)
+		{
+			block.resize(prefix_length + block_length);
+		}
+		lengths.resize(num_blocks);
+		reader = std::thread(&read_ahead::read_blocks, this);
+	}
+
+	read_ahead::~read_ahead()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		block_released.notify_one();
+		reader.join();
+	}
+
+	char* read_ahead::acquire(size_t& length)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		block_filled.wait(lock, [this] { return num_filled > 0 || stream_ended; });
+		if (num_filled == 0)
+		{
+			if (error)
+			{
+				std::rethrow_exception(error);
+			}
+			length = 0;
+			return nullptr;
+		}
+
+		const size_t index = next_acquired;
+		next_acquired = (next_acquired + 1) % blocks.size();
+		--num_filled;
+		length = lengths[index];
+		return blocks[index].data() + prefix_length_;
+	}
+
+	void read_ahead::release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--num_used;
+		}
+		block_released.notify_one();
+	}
+
+	void read_ahead::read_blocks()
+	{
+		// blocks are filled in the order of the ring, the consumer acquires and releases them in the same order
+		for (size_t index = 0;; index = (index + 1) % blocks.size())
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				block_released.wait(lock, [this] { return num_used < blocks.size() || stopping; });
+				if (stopping)
+				{
+					return;
+				}
+				++num_used;
+			}
+
+			size_t length = 0;
+			std::exception_ptr read_error;
+			try
+			{
+				input.read(blocks[index].data() + prefix_length_, static_cast<std::streamsize>(block_length_));
+				if (input.bad())
+				{
+					throw std::runtime_error("Unable to read input data!");
+				}
+				length = static_cast<size_t>(input.gcount());
+			}
+			catch (...)
+			{
+				read_error = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (read_error)
+				{
+					error = read_error;
+					stream_ended = true;
+				}
+				else
+				{
+					lengths[index] = length;
+					++num_filled;
+					stream_ended = length < block_length_;
+				}
+			}
+			block_filled.notify_one();
+			if (read_error || length < block_length_)
+			{
+				return;
+			}
+		}
+	}
+
+	stream_window::stream_window(std::istream& input, size_t capacity)
+		: reader(input, std::max(read_ahead_block_length, capacity), 3, capacity)
+	{
+	}
+
+	void stream_window::require(size_t keep_from, size_t end)
+	{
+		while (end > window_end && input_length == SIZE_MAX)
+		{
+			size_t length = 0;
+			char* block = reader.acquire(length);
+
+			// data that has to be kept is usually short and is copied in front of the next block
+			keep_from = std::clamp(keep_from, window_start, window_end);
+			const size_t kept = window_end - keep_from;
+			const bool fits_in_prefix = kept <= reader.prefix_length();
+			const char* new_window = nullptr;
+			if (fits_in_prefix)
+			{
+				std::copy_n(at(keep_from), kept, block - kept);
+				new_window = block - kept;
+			}
+			else
+			{
+				if (window == joined.data())
+				{
+					joined.erase(joined.begin(), joined.begin() + (keep_from - window_start));
+				}
+				else
+				{
+					joined.assign(at(keep_from), at(keep_from) + kept);
+				}
+				joined.insert(joined.end(), block, block + length);
+				new_window = joined.data();
+			}
+
+			// the previous block isn't needed any more, neither is the new one if it was copied
+			if (holding_block)
+			{
+				reader.release();
+			}
+			holding_block = fits_in_prefix;
+			if (!holding_block)
+			{
+				reader.release();
+			}
+
+			window = new_window;
+			window_start = keep_from;
+			window_end = keep_from + kept + length;
+			if (length < reader.block_length())
+			{
+				input_length = window_end;
+			}
+		}
+	}
+} // namespace impl
+
+}; // namespace rd
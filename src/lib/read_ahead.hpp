@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rd
+{
+
+/// <summary>
+/// Helper classes used internally by functions that read streams until their end
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Length of the blocks read ahead from streams
+	/// </summary>
+	constexpr size_t read_ahead_block_length = 1024 * 1024;
+
+	/// <summary>
+	/// Reads a stream on a background thread into a ring of blocks, so reading the next blocks overlaps with processing of the current one.
+	/// Blocks are acquired in the order of the stream and go back to the ring when they are released.
+	/// Every block has room for 'prefix_length' bytes in front of its data, the consumer can put the end of the previous block there
+	/// so that data crossing the border of two blocks is contiguous without moving the whole block.
+	/// </summary>
+	class read_ahead
+	{
+	public:
+		/// <param name="input">Stream that is read until its end</param>
+		/// <param name="block_length">Length of the blocks, all blocks but the last one are full</param>
+		/// <param name="num_blocks">Number of blocks in the ring, at least 2</param>
+		/// <param name="prefix_length">Room in front of the data of every block</param>
+		read_ahead(std::istream& input, size_t block_length, size_t num_blocks = 3, size_t prefix_length = 0);
+
+		/// <summary>
+		/// Stops reading, waits for a read that is in progress to finish
+		/// </summary>
+		~read_ahead();
+
+		read_ahead(const read_ahead&) = delete;
+		read_ahead& operator=(const read_ahead&) = delete;
+
+		/// <summary>
+		/// Waits for the next block and returns pointer to its data, which is preceded by prefix_length bytes that can be overwritten.
+		/// The block is shorter than block_length only at the end of the stream. When the stream has no more blocks
+		/// it returns nullptr and length 0 and nothing is acquired. At most num_blocks - 1 blocks can be held at the same time.
+		/// Throws std::runtime_error if the stream failed.
+		/// </summary>
+		char* acquire(size_t& length);
+
+		/// <summary>
+		/// Returns the oldest acquired block to the ring
+		/// </summary>
+		void release();
+
+		size_t block_length() const { return block_length_; }
+		size_t prefix_length() const { return prefix_length_; }
+
+	private:
+		void read_blocks();
+
+		std::istream& input;
+		size_t block_length_{ 0 };
+		size_t prefix_length_{ 0 };
+		std::vector<std::vector<char>> blocks;
+		std::vector<size_t> lengths;
+
+		std::mutex mutex;
+		std::condition_variable block_filled;
+		std::condition_variable block_released;
+		size_t num_used{ 0 };        // blocks being filled, filled or acquired
+		size_t num_filled{ 0 };      // filled blocks that weren't acquired yet
+		size_t next_acquired{ 0 };   // index of the block returned by the next acquire()
+		bool stream_ended{ false };  // no more blocks will be filled
+		bool stopping{ false };
+		std::exception_ptr error;
+		std::thread reader;
+	};
+
+	/// <summary>
+	/// Keeps part of the data read from a stream whose length is not known in advance.
+	/// The stream is read ahead in large blocks on a background thread; when the window reaches the next block,
+	/// only the data that has to be kept is copied in front of it, so the window moves without shifting the buffered data.
+	/// The length of the data is known once the end of the stream was reached.
+	/// </summary>
+	class stream_window
+	{
+	public:
+		/// <param name="input">Stream that is read until its end</param>
+		/// <param name="capacity">Longest range that is required at once</param>
+		stream_window(std::istream& input, size_t capacity);
+
+		stream_window(const stream_window&) = delete;
+		stream_window& operator=(const stream_window&) = delete;
+
+		const char* at(size_t position) const
+		{
+			return window + (position - window_start);
+		}
+
+		/// <summary>
+		/// Length of the data, SIZE_MAX until the end of the stream was reached.
+		/// Data up to the end requested by the last call of 'require' is available even if the length is not known yet.
+		/// </summary>
+		size_t length() const
+		{
+			return input_length;
+		}
+
+		/// <summary>
+		/// Makes sure that input data in range [keep_from, end) is in the window, or the data up to the end of the stream if it is shorter.
+		/// Data before 'keep_from' can be discarded. Throws std::runtime_error if the stream fails.
+		/// </summary>
+		void require(size_t keep_from, size_t end);
+
+	private:
+		read_ahead reader;
+		size_t input_length{ SIZE_MAX };
+
+		const char* window{ nullptr };
+		size_t window_start{ 0 }; // position of the first byte of the window in the input data
+		size_t window_end{ 0 };
+		bool holding_block{ false };
+		std::vector<char> joined; // window when the kept data doesn't fit in front of the next block
+	};
+} // namespace impl
+
+}; // namespace rd
@@ -1,11 +1,18 @@
 #include "signature.hpp"
+#include "parallel.hpp"
+#include "read_ahead.hpp"
+#include "zeros.hpp"
+
+#include <algorithm>
+#include <stdexcept>
 
 namespace rd
 {
 
 bool operator==(const chunk& left, const chunk& right)
 {
-	return left.start_position == right.start_position && left.length == right.length && left.hash == right.hash;
+	return left.start_position == right.start_position && left.length == right.length && left.hash == right.hash
+		&& left.checksum == right.checksum;
 }
 
 bool operator!=(const chunk& left, const chunk& right)
@@ -15,7 +22,7 @@ bool operator!=(const chunk& left, const chunk& right)
 
 std::ostream& operator<<(std::ostream& os, const chunk& ch)
 {
-	os << "(" << ch.start_position << " " << ch.length << " " << ch.hash << ")";
+	os << "(" << ch.start_position << " " << ch.length << " " << ch.hash << " " << ch.checksum << ")";
 
 	return os;
 }
@@ -35,7 +42,7 @@ bool operator==(const signature& left, const signature& right)
 		}
 	}
 
-	return true;
+	return left.strong_hash_length == right.strong_hash_length && left.strong_hashes == right.strong_hashes && left.cdc == right.cdc;
 }
 
 bool operator!=(const signature& left, const signature& right)
@@ -43,38 +50,652 @@ bool operator!=(const signature& left, const signature& right)
 	return !(left == right);
 }
 
+namespace
+{
+	inline bool is_little_endian()
+	{
+		const uint16_t value = 1;
+		return *reinterpret_cast<const uint8_t*>(&value) == 1;
+	}
+
+	inline void store_little_endian(uint8_t* data, uint64_t value, size_t length)
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			data[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	inline uint64_t load_little_endian(const uint8_t* data, size_t length)
+	{
+		uint64_t value = 0;
+		for (size_t i = length; i-- > 0;)
+		{
+			value = (value << 8) | data[i];
+		}
+
+		return value;
+	}
+
+	/// <summary>
+	/// Values from the header of a signature file
+	/// </summary>
+	struct signature_header
+	{
+		size_t chunk_length{ 0 };
+		size_t data_length{ 0 };
+		size_t strong_hash_length{ 0 };
+		size_t num_chunks{ 0 };
+		cdc_parameters cdc{};
+	};
+
+	signature_header parse_header(const uint8_t* header)
+	{
+		if (header[4] != signature_format::version)
+		{
+			throw std::runtime_error("Unsupported signature version!");
+		}
+
+		const bool content_defined = header[5] == signature_format::content_defined_chunking;
+		if ((!content_defined && header[5] != signature_format::fixed_chunking) || header[6] != signature_format::adler32_checksum
+			|| header[7] != signature_format::jenkins_hash)
+		{
+			throw std::runtime_error("Unsupported hash algorithm in signature file!");
+		}
+
+		signature_header result;
+		result.strong_hash_length = header[9];
+		const bool has_strong_hash = header[8] == signature_format::blake2b_strong_hash;
+		if ((!has_strong_hash && header[8] != signature_format::no_strong_hash) || has_strong_hash != (result.strong_hash_length > 0)
+			|| result.strong_hash_length > blake2b::max_digest_length)
+		{
+			throw std::runtime_error("Invalid strong hash in signature file!");
+		}
+
+		result.chunk_length = load_little_endian(header + 16, 8);
+		result.data_length = load_little_endian(header + 24, 8);
+		if (result.chunk_length == 0 && result.data_length > 0)
+		{
+			throw std::runtime_error("Invalid chunk length in signature file!");
+		}
+
+		if (content_defined)
+		{
+			// chunks are counted in the block that follows the header
+			result.cdc.average_length = result.chunk_length;
+		}
+		else
+		{
+			result.num_chunks = result.data_length == 0 ? 0 : (result.data_length - 1) / result.chunk_length + 1;
+		}
+
+		return result;
+	}
+
+	void parse_cdc_block(const uint8_t* block, signature_header& info)
+	{
+		info.num_chunks = load_little_endian(block, 8);
+		info.cdc.min_length = load_little_endian(block + 8, 8);
+		info.cdc.average_length = load_little_endian(block + 16, 8);
+		info.cdc.max_length = load_little_endian(block + 24, 8);
+
+		if (info.cdc.min_length == 0 || info.cdc.average_length < 4 || info.cdc.min_length > info.cdc.average_length
+			|| info.cdc.average_length > info.cdc.max_length)
+		{
+			throw std::runtime_error("Invalid content-defined chunking parameters in signature file!");
+		}
+
+		if (info.num_chunks > info.data_length || (info.num_chunks == 0) != (info.data_length == 0))
+		{
+			throw std::runtime_error("Invalid number of chunks in signature file!");
+		}
+	}
+
+	void store_cdc_block(uint8_t* block, size_t num_chunks, const cdc_parameters& cdc)
+	{
+		store_little_endian(block, num_chunks, 8);
+		store_little_endian(block + 8, cdc.min_length, 8);
+		store_little_endian(block + 16, cdc.average_length, 8);
+		store_little_endian(block + 24, cdc.max_length, 8);
+	}
+
+	void read(std::istream& is, void* data, size_t length)
+	{
+		is.read(static_cast<char*>(data), static_cast<std::streamsize>(length));
+		if (static_cast<size_t>(is.gcount()) != length)
+		{
+			throw std::runtime_error("Signature file is truncated!");
+		}
+	}
+
+	void read_legacy(std::istream& is, size_t num_chunks, signature& sig)
+	{
+		read(is, &sig.strong_hash_length, sizeof(sig.strong_hash_length));
+		if (sig.strong_hash_length > blake2b::max_digest_length)
+		{
+			throw std::runtime_error("Invalid strong hash length in signature file!");
+		}
+		sig.chunks.clear();
+		sig.chunks.reserve(num_chunks);
+		sig.strong_hashes.resize(num_chunks * sig.strong_hash_length);
+
+		for (size_t i = 0; i < num_chunks; ++i)
+		{
+			chunk new_chunk;
+
+			read(is, &new_chunk.start_position, sizeof(new_chunk.start_position));
+			read(is, &new_chunk.length, sizeof(new_chunk.length));
+			read(is, &new_chunk.hash, sizeof(new_chunk.hash));
+			read(is, &new_chunk.checksum, sizeof(new_chunk.checksum));
+			read(is, sig.strong_hashes.data() + i * sig.strong_hash_length, sig.strong_hash_length);
+
+			sig.chunks.push_back(new_chunk);
+		}
+	}
+} // namespace
+
+signature_view::signature_view(const signature& sig)
+	: chunks(sig.chunks.data()), num_chunks(sig.chunks.size()), cdc_chunking(sig.cdc), strong_hashes(sig.strong_hashes.data()),
+	hash_length(sig.strong_hash_length)
+{
+	if (sig.strong_hash_length > blake2b::max_digest_length || sig.strong_hashes.size() != sig.chunks.size() * sig.strong_hash_length)
+	{
+		throw std::invalid_argument("Signature has invalid strong hashes! ");
+	}
+}
+
+signature_view::signature_view(size_t chunk_length, size_t data_length, const uint32_t* checksums, const uint32_t* hashes,
+	const uint8_t* strong_hashes, size_t strong_hash_length)
+	: num_chunks(data_length == 0 ? 0 : (data_length - 1) / chunk_length + 1), chunk_length(chunk_length), data_length(data_length),
+	checksums(checksums), hashes(hashes), strong_hashes(strong_hashes), hash_length(strong_hash_length)
+{
+}
+
+signature_view::signature_view(const cdc_parameters& cdc, size_t num_chunks, size_t data_length, const uint64_t* start_positions,
+	const uint32_t* checksums, const uint32_t* hashes, const uint8_t* strong_hashes, size_t strong_hash_length)
+	: num_chunks(num_chunks), data_length(data_length), cdc_chunking(cdc), start_positions(start_positions),
+	checksums(checksums), hashes(hashes), strong_hashes(strong_hashes), hash_length(strong_hash_length)
+{
+}
+
 std::ostream& signature::write_to_binary_file(std::ostream& os, const signature& sig)
 {
-	size_t num_chunks = sig.chunks.size();
-	os.write(reinterpret_cast<const char*>(&num_chunks), sizeof(num_chunks));
+	const size_t num_chunks = sig.chunks.size();
+	const bool content_defined = sig.cdc.enabled();
+	const size_t chunk_length = content_defined ? sig.cdc.average_length : (num_chunks > 0 ? sig.chunks.front().length : 0);
+	size_t data_length = 0;
+	for (size_t i = 0; i < num_chunks; ++i)
+	{
+		const auto& ch = sig.chunks[i];
+		if (ch.start_position != data_length || ch.length == 0)
+		{
+			throw std::invalid_argument("Signature chunks have to follow each other!");
+		}
+		if (!content_defined && (ch.length > chunk_length || (i + 1 < num_chunks && ch.length != chunk_length)))
+		{
+			throw std::invalid_argument("Chunks of a signature without content-defined chunking have to have the same length!");
+		}
+		data_length += ch.length;
+	}
+
+	if (sig.strong_hash_length > blake2b::max_digest_length || sig.strong_hashes.size() != num_chunks * sig.strong_hash_length)
+	{
+		throw std::invalid_argument("Signature has invalid strong hashes! ");
+	}
+
+	uint8_t header[signature_format::header_length]{};
+	std::copy(std::begin(signature_format::magic), std::end(signature_format::magic), header);
+	header[4] = signature_format::version;
+	header[5] = content_defined ? signature_format::content_defined_chunking : signature_format::fixed_chunking;
+	header[6] = signature_format::adler32_checksum;
+	header[7] = signature_format::jenkins_hash;
+	header[8] = sig.strong_hash_length > 0 ? signature_format::blake2b_strong_hash : signature_format::no_strong_hash;
+	header[9] = static_cast<uint8_t>(sig.strong_hash_length);
+	store_little_endian(header + 16, chunk_length, 8);
+	store_little_endian(header + 24, data_length, 8);
+	os.write(reinterpret_cast<const char*>(header), sizeof(header));
 
-	for (const auto& ch : sig.chunks)
+	// values are written as arrays so that they can be used in place when the file is mapped
+	if (content_defined)
 	{
-		os.write(reinterpret_cast<const char*>(&ch.start_position), sizeof(ch.start_position));
-		os.write(reinterpret_cast<const char*>(&ch.length), sizeof(ch.length));
-		os.write(reinterpret_cast<const char*>(&ch.hash), sizeof(ch.hash));
+		uint8_t block[signature_format::cdc_block_length];
+		store_cdc_block(block, num_chunks, sig.cdc);
+		os.write(reinterpret_cast<const char*>(block), sizeof(block));
+
+		std::vector<uint8_t> start_positions(num_chunks * sizeof(uint64_t));
+		for (size_t i = 0; i < num_chunks; ++i)
+		{
+			store_little_endian(start_positions.data() + i * sizeof(uint64_t), sig.chunks[i].start_position, sizeof(uint64_t));
+		}
+		os.write(reinterpret_cast<const char*>(start_positions.data()), start_positions.size());
+	}
+
+	std::vector<uint8_t> values(num_chunks * sizeof(uint32_t));
+	for (size_t i = 0; i < num_chunks; ++i)
+	{
+		store_little_endian(values.data() + i * sizeof(uint32_t), sig.chunks[i].checksum, sizeof(uint32_t));
 	}
+	os.write(reinterpret_cast<const char*>(values.data()), values.size());
+
+	for (size_t i = 0; i < num_chunks; ++i)
+	{
+		store_little_endian(values.data() + i * sizeof(uint32_t), sig.chunks[i].hash, sizeof(uint32_t));
+	}
+	os.write(reinterpret_cast<const char*>(values.data()), values.size());
+
+	os.write(reinterpret_cast<const char*>(sig.strong_hashes.data()), sig.strong_hashes.size());
 
 	return os;
 }
+
 std::istream& signature::read_from_binary_file(std::istream& is, signature& sig)
 {
-	size_t num_chunks = 0;
-	is.read(reinterpret_cast<char*>(&num_chunks), sizeof(num_chunks));
-	sig.chunks.reserve(num_chunks);
+	uint8_t header[signature_format::header_length];
+	read(is, header, sizeof(signature_format::magic));
 
-	for (size_t i = 0; i < num_chunks; ++i)
+	if (!std::equal(std::begin(signature_format::magic), std::end(signature_format::magic), header))
 	{
-		chunk new_chunk;
-		
-		is.read(reinterpret_cast<char*>(&new_chunk.start_position), sizeof(new_chunk.start_position));
-		is.read(reinterpret_cast<char*>(&new_chunk.length), sizeof(new_chunk.length));
-		is.read(reinterpret_cast<char*>(&new_chunk.hash), sizeof(new_chunk.hash));
+		// legacy files start directly with the 8 byte number of chunks
+		read(is, header + sizeof(signature_format::magic), sizeof(uint64_t) - sizeof(signature_format::magic));
+		read_legacy(is, load_little_endian(header, sizeof(uint64_t)), sig);
 
-		sig.chunks.push_back(new_chunk);
+		return is;
+	}
+
+	read(is, header + sizeof(signature_format::magic), sizeof(header) - sizeof(signature_format::magic));
+	auto info = parse_header(header);
+
+	std::vector<uint8_t> start_positions;
+	if (info.cdc.enabled())
+	{
+		uint8_t block[signature_format::cdc_block_length];
+		read(is, block, sizeof(block));
+		parse_cdc_block(block, info);
+
+		start_positions.resize(info.num_chunks * sizeof(uint64_t));
+		read(is, start_positions.data(), start_positions.size());
+	}
+	sig.cdc = info.cdc;
+
+	std::vector<uint8_t> checksums(info.num_chunks * sizeof(uint32_t));
+	std::vector<uint8_t> hashes(info.num_chunks * sizeof(uint32_t));
+	read(is, checksums.data(), checksums.size());
+	read(is, hashes.data(), hashes.size());
+	sig.strong_hash_length = info.strong_hash_length;
+	sig.strong_hashes.resize(info.num_chunks * info.strong_hash_length);
+	read(is, sig.strong_hashes.data(), sig.strong_hashes.size());
+
+	sig.chunks.resize(info.num_chunks);
+	for (size_t i = 0; i < info.num_chunks; ++i)
+	{
+		auto& ch = sig.chunks[i];
+		if (info.cdc.enabled())
+		{
+			ch.start_position = load_little_endian(start_positions.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+			const size_t end = i + 1 < info.num_chunks
+				? load_little_endian(start_positions.data() + (i + 1) * sizeof(uint64_t), sizeof(uint64_t)) : info.data_length;
+			if ((i == 0 && ch.start_position != 0) || end <= ch.start_position || end > info.data_length)
+			{
+				throw std::runtime_error("Invalid chunk position in signature file!");
+			}
+			ch.length = end - ch.start_position;
+		}
+		else
+		{
+			ch.start_position = i * info.chunk_length;
+			ch.length = std::min(info.chunk_length, info.data_length - ch.start_position);
+		}
+		ch.checksum = static_cast<uint32_t>(load_little_endian(checksums.data() + i * sizeof(uint32_t), sizeof(uint32_t)));
+		ch.hash = static_cast<uint32_t>(load_little_endian(hashes.data() + i * sizeof(uint32_t), sizeof(uint32_t)));
 	}
 
 	return is;
 }
-	
+
+bool mapped_signature::open(const std::string& file_name)
+{
+	file.close();
+	sig_view = signature_view();
+
+	// values in the file are little-endian so they can be used in place only on little-endian machines
+	if (!is_little_endian() || !file.open_read(file_name))
+	{
+		return false;
+	}
+
+	const auto data = reinterpret_cast<const uint8_t*>(file.data());
+	if (file.size() < sizeof(signature_format::magic)
+		|| !std::equal(std::begin(signature_format::magic), std::end(signature_format::magic), data))
+	{
+		file.close();
+		return false;
+	}
+
+	if (file.size() < signature_format::header_length)
+	{
+		file.close();
+		throw std::runtime_error("Signature file is truncated!");
+	}
+
+	signature_header info;
+	size_t values_offset = signature_format::header_length;
+	try
+	{
+		info = parse_header(data);
+		if (info.cdc.enabled())
+		{
+			if (file.size() < signature_format::header_length + signature_format::cdc_block_length)
+			{
+				throw std::runtime_error("Signature file is truncated!");
+			}
+			parse_cdc_block(data + signature_format::header_length, info);
+			values_offset += signature_format::cdc_block_length;
+		}
+	}
+	catch (...)
+	{
+		file.close();
+		throw;
+	}
+
+	const size_t chunk_record_length = 2 * sizeof(uint32_t) + info.strong_hash_length + (info.cdc.enabled() ? sizeof(uint64_t) : 0);
+	const size_t values_length = file.size() - values_offset;
+	if (info.num_chunks > values_length / chunk_record_length || info.num_chunks * chunk_record_length != values_length)
+	{
+		file.close();
+		throw std::runtime_error("Signature file is corrupted, its size doesn't match its header!");
+	}
+
+	// positions of content-defined chunks are checked when the signature is indexed
+	const auto start_positions = reinterpret_cast<const uint64_t*>(data + values_offset);
+	const auto checksums = reinterpret_cast<const uint32_t*>(data + values_offset + (info.cdc.enabled() ? info.num_chunks * sizeof(uint64_t) : 0));
+	const auto hashes = checksums + info.num_chunks;
+	const auto strong_hashes = reinterpret_cast<const uint8_t*>(hashes + info.num_chunks);
+	if (info.cdc.enabled())
+	{
+		sig_view = signature_view(info.cdc, info.num_chunks, info.data_length, start_positions, checksums, hashes, strong_hashes, info.strong_hash_length);
+	}
+	else
+	{
+		sig_view = signature_view(info.chunk_length, info.data_length, checksums, hashes, strong_hashes, info.strong_hash_length);
+	}
+
+	return true;
+}
+
+namespace impl
+{
+	void compute_equal_chunk_hashes(const char* data, size_t chunk_length, chunk* chunks, size_t num_chunks,
+		uint8_t* strong_hashes, size_t strong_hash_length)
+	{
+		// chunks of zeros, like holes of sparse files, all have the same hashes, which are computed only once
+		bool zero_hashes_computed = false;
+		chunk zero_chunk;
+		uint8_t zero_strong_hash[blake2b::max_digest_length];
+		auto copy_zero_hashes = [&](size_t index)
+		{
+			if (!zero_hashes_computed)
+			{
+				const std::vector<char> zeros(chunk_length);
+				zero_chunk.hash = compute_hash(zeros.data(), chunk_length);
+				zero_chunk.checksum = zero_checksum(chunk_length);
+				if (strong_hash_length > 0)
+				{
+					compute_strong_hash(zeros.data(), chunk_length, zero_strong_hash, strong_hash_length);
+				}
+				zero_hashes_computed = true;
+			}
+
+			chunks[index].hash = zero_chunk.hash;
+			chunks[index].checksum = zero_chunk.checksum;
+			std::copy_n(zero_strong_hash, strong_hash_length, strong_hashes + index * strong_hash_length);
+		};
+
+		// batches are small enough to stay in the cache while all three hashes read them
+		constexpr size_t batch_length = 64;
+		uint32_t hashes[batch_length];
+		for (size_t first = 0; first < num_chunks;)
+		{
+			if (is_zero(data + first * chunk_length, chunk_length))
+			{
+				copy_zero_hashes(first);
+				++first;
+				continue;
+			}
+
+			// batch ends before the next chunk of zeros
+			size_t count = 1;
+			while (count < batch_length && first + count < num_chunks && !is_zero(data + (first + count) * chunk_length, chunk_length))
+			{
+				++count;
+			}
+
+			const char* batch_data = data + first * chunk_length;
+			compute_hashes(batch_data, chunk_length, count, hashes);
+			if (strong_hash_length > 0)
+			{
+				compute_strong_hashes(batch_data, chunk_length, count, strong_hashes + first * strong_hash_length, strong_hash_length);
+			}
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				chunks[first + i].hash = hashes[i];
+				chunks[first + i].checksum = compute_checksum(batch_data + i * chunk_length, chunk_length);
+			}
+			first += count;
+		}
+	}
+} // namespace impl
+
+signature calculate_signature_stream(std::istream& input, size_t chunk_length, size_t strong_hash_length, const progress_callback& progress)
+{
+	if (chunk_length == 0)
+	{
+		throw std::invalid_argument("chunk_length parameter is 0!");
+	}
+
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
+	}
+
+	signature result;
+	result.strong_hash_length = strong_hash_length;
+	impl::progress_tracker tracker(progress, 0);
+
+	// blocks have whole chunks so only the last block can end with a shorter chunk,
+	// they are read on a background thread while the previous block is hashed
+	const size_t chunks_per_block = std::max<size_t>(1, impl::read_ahead_block_length / chunk_length);
+	impl::read_ahead reader(input, chunks_per_block * chunk_length);
+	std::vector<char> chunk_buffer;
+	size_t data_length = 0;
+	for (size_t length = reader.block_length(); length == reader.block_length();)
+	{
+		const char* block = reader.acquire(length);
+		const size_t first_chunk = result.chunks.size();
+		const size_t num_chunks = (length + chunk_length - 1) / chunk_length;
+		result.chunks.resize(first_chunk + num_chunks);
+		result.strong_hashes.resize(result.chunks.size() * strong_hash_length);
+		for (size_t i = 0; i < num_chunks; ++i)
+		{
+			auto& ch = result.chunks[first_chunk + i];
+			ch.start_position = data_length + i * chunk_length;
+			ch.length = std::min(chunk_length, length - i * chunk_length);
+		}
+
+		const size_t num_whole_chunks = length / chunk_length;
+		uint8_t* strong_hashes = result.strong_hashes.data() + first_chunk * strong_hash_length;
+		impl::compute_equal_chunk_hashes(block, chunk_length, result.chunks.data() + first_chunk, num_whole_chunks,
+			strong_hashes, strong_hash_length);
+		if (num_whole_chunks < num_chunks)
+		{
+			const char* chunk_data = block + num_whole_chunks * chunk_length;
+			impl::compute_chunk_hashes(chunk_data, result.chunks[first_chunk + num_whole_chunks],
+				strong_hashes + num_whole_chunks * strong_hash_length, strong_hash_length, chunk_buffer);
+		}
+		reader.release();
+
+		data_length += length;
+		tracker.update(data_length);
+	}
+	tracker.finish(data_length);
+
+	return result;
+}
+
+signature calculate_signature_cdc_stream(std::istream& input, const cdc_parameters& cdc, size_t strong_hash_length, const progress_callback& progress)
+{
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
+	}
+
+	const cdc_chunker chunker(cdc);
+	signature result;
+	result.strong_hash_length = strong_hash_length;
+	result.cdc = cdc;
+	impl::progress_tracker tracker(progress, 0);
+
+	// boundary of a chunk is found only when the longest chunk is in the window or the stream has ended
+	impl::stream_window window(input, cdc.max_length);
+	std::vector<char> chunk_buffer;
+	size_t data_index = 0;
+	while (true)
+	{
+		window.require(data_index, data_index + cdc.max_length);
+		if (data_index >= window.length())
+		{
+			break;
+		}
+
+		chunk new_chunk;
+		new_chunk.start_position = data_index;
+		const char* chunk_data = window.at(data_index);
+		new_chunk.length = chunker.next_chunk_length(chunk_data, std::min(window.length() - data_index, cdc.max_length));
+		result.strong_hashes.resize((result.chunks.size() + 1) * strong_hash_length);
+		impl::compute_chunk_hashes(chunk_data, new_chunk, result.strong_hashes.data() + result.chunks.size() * strong_hash_length,
+			strong_hash_length, chunk_buffer);
+		result.chunks.push_back(new_chunk);
+
+		data_index += new_chunk.length;
+		tracker.update(data_index);
+	}
+	tracker.finish(data_index);
+
+	return result;
+}
+
+signature calculate_signature_parallel(const char* data, size_t data_length, size_t chunk_length, size_t strong_hash_length, size_t num_threads,
+	const progress_callback& progress)
+{
+	if (data == nullptr)
+	{
+		throw std::invalid_argument("data parameter is nullptr!");
+	}
+
+	if (chunk_length == 0)
+	{
+		throw std::invalid_argument("chunk_length parameter is 0!");
+	}
+
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
+	}
+
+	signature result;
+	result.strong_hash_length = strong_hash_length;
+	const size_t num_chunks = (data_length + chunk_length - 1) / chunk_length;
+	result.chunks.resize(num_chunks);
+	result.strong_hashes.resize(num_chunks * strong_hash_length);
+
+	// every task hashes about 1 MB of data so that threads are kept busy until the end
+	constexpr size_t task_data_length = 1024 * 1024;
+	const size_t chunks_per_task = std::max<size_t>(1, task_data_length / chunk_length);
+	const size_t num_tasks = (num_chunks + chunks_per_task - 1) / chunks_per_task;
+	impl::progress_tracker tracker(progress, data_length);
+
+	parallel_for(num_tasks, num_threads, [&](size_t task_index)
+	{
+		const size_t first_chunk = task_index * chunks_per_task;
+		const size_t last_chunk = std::min(first_chunk + chunks_per_task, num_chunks);
+		for (size_t i = first_chunk; i < last_chunk; ++i)
+		{
+			auto& ch = result.chunks[i];
+			ch.start_position = i * chunk_length;
+			ch.length = std::min(chunk_length, data_length - ch.start_position);
+		}
+
+		// only the last chunk of the data can be shorter
+		const size_t last_whole_chunk = std::min(last_chunk, data_length / chunk_length);
+		impl::compute_equal_chunk_hashes(data + first_chunk * chunk_length, chunk_length, result.chunks.data() + first_chunk,
+			last_whole_chunk - first_chunk, result.strong_hashes.data() + first_chunk * strong_hash_length, strong_hash_length);
+		if (last_whole_chunk < last_chunk)
+		{
+			std::vector<char> chunk_buffer;
+			const char* chunk_data = data + last_whole_chunk * chunk_length;
+			impl::compute_chunk_hashes(chunk_data, result.chunks[last_whole_chunk], result.strong_hashes.data() + last_whole_chunk * strong_hash_length,
+				strong_hash_length, chunk_buffer);
+		}
+		tracker.add(std::min(last_chunk * chunk_length, data_length) - first_chunk * chunk_length);
+	});
+	tracker.finish();
+
+	return result;
+}
+
+signature calculate_signature_cdc_parallel(const char* data, size_t data_length, const cdc_parameters& cdc, size_t strong_hash_length, size_t num_threads,
+	const progress_callback& progress)
+{
+	if (data == nullptr)
+	{
+		throw std::invalid_argument("data parameter is nullptr!");
+	}
+
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
+	}
+
+	// boundaries depend on the previous ones so they are found sequentially, it is much faster than hashing anyway
+	const cdc_chunker chunker(cdc);
+	signature result;
+	result.strong_hash_length = strong_hash_length;
+	result.cdc = cdc;
+	result.chunks.reserve(data_length / cdc.average_length + 1);
+	for (size_t data_index = 0; data_index < data_length;)
+	{
+		chunk new_chunk;
+		new_chunk.start_position = data_index;
+		new_chunk.length = chunker.next_chunk_length(data + data_index, data_length - data_index);
+		data_index += new_chunk.length;
+		result.chunks.push_back(new_chunk);
+	}
+	result.strong_hashes.resize(result.chunks.size() * strong_hash_length);
+
+	// every task hashes about 1 MB of data so that threads are kept busy until the end
+	constexpr size_t task_data_length = 1024 * 1024;
+	const size_t chunks_per_task = std::max<size_t>(1, task_data_length / cdc.average_length);
+	const size_t num_tasks = (result.chunks.size() + chunks_per_task - 1) / chunks_per_task;
+	impl::progress_tracker tracker(progress, data_length);
+
+	parallel_for(num_tasks, num_threads, [&](size_t task_index)
+	{
+		std::vector<char> chunk_buffer;
+		const size_t first_chunk = task_index * chunks_per_task;
+		const size_t last_chunk = std::min(first_chunk + chunks_per_task, result.chunks.size());
+		for (size_t i = first_chunk; i < last_chunk; ++i)
+		{
+			auto& ch = result.chunks[i];
+			const char* chunk_data = data + ch.start_position;
+			impl::compute_chunk_hashes(chunk_data, ch, result.strong_hashes.data() + i * strong_hash_length,
+				strong_hash_length, chunk_buffer);
+		}
+		tracker.add(result.chunks[last_chunk - 1].start_position + result.chunks[last_chunk - 1].length - result.chunks[first_chunk].start_position);
+	});
+	tracker.finish();
+
+	return result;
+}
+
 }; // namespace rd
@@ -4,29 +4,59 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
 
 #include "hash.hpp"
+#include "checksum.hpp"
+#include "strong_hash.hpp"
+#include "mapped_file.hpp"
+#include "cdc.hpp"
+#include "progress.hpp"
 
 namespace rd
 {
 
 /// <summary>
 /// Basic building block of a data sequence
+/// hash: Jenkins hash of the chunk. Used to confirm that the chunk was really found.
+/// checksum: Adler32 checksum of the chunk. Weak hash that can be rolled through the data.
 /// </summary>
 struct chunk
 {
 	size_t start_position{0};
 	size_t length{0};
 	uint32_t hash{0};
+	uint32_t checksum{0};
 };
 
+/// <summary>
+/// Default length of the strong hash of every chunk in bytes.
+/// </summary>
+constexpr size_t default_strong_hash_length = 16;
+
 /// <summary>
 /// Structure describing data sequence.	
 /// Consists of a sequence of chunks.
+/// strong_hash_length: Length of the strong hash of every chunk in bytes. 0 means that chunks don't have strong hashes.
+/// strong_hashes: Strong hashes of all chunks stored one after another.
+/// cdc: Parameters of content-defined chunking if the chunks were created by it, otherwise chunks have fixed length.
 /// </summary>
 struct signature
 {
 	std::vector<chunk> chunks{};
+	size_t strong_hash_length{ 0 };
+	std::vector<uint8_t> strong_hashes{};
+	cdc_parameters cdc{};
+
+	/// <summary>
+	/// Returns pointer to the strong hash of the given chunk
+	/// </summary>
+	const uint8_t* strong_hash(size_t chunk_id) const
+	{
+		return strong_hashes.data() + chunk_id * strong_hash_length;
+	}
 
 	/// <summary>
 	/// Writes given signature object to a binary file
@@ -46,6 +76,144 @@ struct signature
 };
 
 
+/// <summary>
+/// Binary signature format written by signature::write_to_binary_file. All multi-byte values are little-endian.
+///   header (32 bytes): magic "RDSG" (4), version (1), chunking id (1), checksum id (1), hash id (1),
+///                      strong hash id (1), strong hash length (1), reserved (6), chunk length (8), data length (8)
+///   checksums of all chunks (4 bytes each), hashes of all chunks (4 bytes each), strong hashes of all chunks
+/// Chunk positions and lengths are not stored, they follow from the chunk length and the data length.
+/// Content-defined chunks don't have fixed length, so for them the header is followed by a block with
+/// the number of chunks (8), minimal (8), average (8) and maximal (8) chunk length and by start positions of all chunks (8 bytes each).
+/// The arrays are aligned so the file can be mapped into memory and used in place, see mapped_signature.
+/// Files written before this format (no magic, every chunk with its position and length) can still be read.
+/// </summary>
+namespace signature_format
+{
+	constexpr char magic[4] = { 'R', 'D', 'S', 'G' };
+	constexpr uint8_t version = 2;
+	constexpr size_t header_length = 32;
+
+	constexpr uint8_t fixed_chunking = 0;
+	constexpr uint8_t content_defined_chunking = 1;
+	constexpr size_t cdc_block_length = 32;
+	constexpr uint8_t adler32_checksum = 1;
+	constexpr uint8_t jenkins_hash = 1;
+	constexpr uint8_t no_strong_hash = 0;
+	constexpr uint8_t blake2b_strong_hash = 1;
+};
+
+/// <summary>
+/// Read-only view of signature chunks used while calculating delta.
+/// It either refers to a signature object or to packed arrays of hashes of fixed length chunks,
+/// for example arrays in a mapped signature file. The viewed data has to outlive the view.
+/// </summary>
+class signature_view
+{
+public:
+	signature_view() = default;
+
+	/// <summary>
+	/// Creates view of the signature object
+	/// </summary>
+	signature_view(const signature& sig);
+
+	/// <summary>
+	/// Creates view of packed arrays of fixed length chunks
+	/// </summary>
+	/// <param name="chunk_length">Length of every chunk except the last one that can be shorter</param>
+	/// <param name="data_length">Length of the original data</param>
+	/// <param name="checksums">Checksum of every chunk</param>
+	/// <param name="hashes">Hash of every chunk</param>
+	/// <param name="strong_hashes">Strong hashes of all chunks stored one after another</param>
+	/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes</param>
+	signature_view(size_t chunk_length, size_t data_length, const uint32_t* checksums, const uint32_t* hashes,
+		const uint8_t* strong_hashes, size_t strong_hash_length);
+
+	/// <summary>
+	/// Creates view of packed arrays of content-defined chunks
+	/// </summary>
+	/// <param name="cdc">Parameters of content-defined chunking</param>
+	/// <param name="num_chunks">Number of chunks</param>
+	/// <param name="data_length">Length of the original data</param>
+	/// <param name="start_positions">Start position of every chunk</param>
+	/// <param name="checksums">Checksum of every chunk</param>
+	/// <param name="hashes">Hash of every chunk</param>
+	/// <param name="strong_hashes">Strong hashes of all chunks stored one after another</param>
+	/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes</param>
+	signature_view(const cdc_parameters& cdc, size_t num_chunks, size_t data_length, const uint64_t* start_positions,
+		const uint32_t* checksums, const uint32_t* hashes, const uint8_t* strong_hashes, size_t strong_hash_length);
+
+	size_t size() const { return num_chunks; }
+	size_t strong_hash_length() const { return hash_length; }
+	const cdc_parameters& cdc() const { return cdc_chunking; }
+
+	size_t start_position(size_t chunk_id) const
+	{
+		if (chunks != nullptr)
+		{
+			return chunks[chunk_id].start_position;
+		}
+
+		return start_positions != nullptr ? static_cast<size_t>(start_positions[chunk_id]) : chunk_id * chunk_length;
+	}
+
+	size_t length(size_t chunk_id) const
+	{
+		if (chunks != nullptr)
+		{
+			return chunks[chunk_id].length;
+		}
+
+		if (start_positions != nullptr)
+		{
+			const size_t end = chunk_id + 1 < num_chunks ? static_cast<size_t>(start_positions[chunk_id + 1]) : data_length;
+			return end - static_cast<size_t>(start_positions[chunk_id]);
+		}
+
+		return std::min(chunk_length, data_length - chunk_id * chunk_length);
+	}
+	uint32_t checksum(size_t chunk_id) const { return chunks != nullptr ? chunks[chunk_id].checksum : checksums[chunk_id]; }
+	uint32_t hash(size_t chunk_id) const { return chunks != nullptr ? chunks[chunk_id].hash : hashes[chunk_id]; }
+	const uint8_t* strong_hash(size_t chunk_id) const { return strong_hashes + chunk_id * hash_length; }
+
+private:
+	const chunk* chunks{ nullptr };
+	size_t num_chunks{ 0 };
+	size_t chunk_length{ 0 };
+	size_t data_length{ 0 };
+	cdc_parameters cdc_chunking{};
+	const uint64_t* start_positions{ nullptr };
+	const uint32_t* checksums{ nullptr };
+	const uint32_t* hashes{ nullptr };
+	const uint8_t* strong_hashes{ nullptr };
+	size_t hash_length{ 0 };
+};
+
+/// <summary>
+/// Signature file mapped into memory. Hashes are used in place, the file is not parsed.
+/// </summary>
+class mapped_signature
+{
+public:
+	/// <summary>
+	/// Maps signature file
+	/// </summary>
+	/// <param name="file_name">Path to the file</param>
+	/// <returns>
+	/// true if the file was mapped. false if it can't be mapped, is in the legacy format
+	/// or the machine is not little-endian, in such case signature::read_from_binary_file has to be used.
+	/// Throws std::runtime_error if the file is corrupted.
+	/// </returns>
+	bool open(const std::string& file_name);
+
+	bool is_open() const { return file.is_open(); }
+	const signature_view& view() const { return sig_view; }
+
+private:
+	mapped_file file;
+	signature_view sig_view;
+};
+
 bool operator==(const chunk& left, const chunk& right);
 bool operator!=(const chunk& left, const chunk& right);
 std::ostream& operator<<(std::ostream& os, const chunk& sig);
@@ -53,6 +221,52 @@ std::ostream& operator<<(std::ostream& os, const chunk& sig);
 bool operator==(const signature& left, const signature& right);
 bool operator!=(const signature& left, const signature& right);
 
+/// <summary>
+/// Helper functions used internally by signature functions 
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Computes hash, checksum and optionally strong hash of the given chunk.
+	/// Every byte is read from the input only once so stream iterators can be used as well.
+	/// </summary>
+	template <typename InputIter>
+	void compute_chunk_hashes(InputIter& data, chunk& ch, uint8_t* strong_hash, size_t strong_hash_length, std::vector<char>& chunk_buffer)
+	{
+		if constexpr (std::is_pointer_v<InputIter>)
+		{
+			ch.hash = compute_hash(InputIter(data), ch.length);
+			if (strong_hash_length > 0)
+			{
+				compute_strong_hash(InputIter(data), ch.length, strong_hash, strong_hash_length);
+			}
+			ch.checksum = compute_checksum(data, ch.length);
+		}
+		else
+		{
+			chunk_buffer.resize(ch.length);
+			for (size_t i = 0; i < ch.length; ++i)
+			{
+				chunk_buffer[i] = *data++;
+			}
+
+			ch.hash = compute_hash(chunk_buffer.data(), ch.length);
+			ch.checksum = compute_checksum(chunk_buffer.data(), ch.length);
+			if (strong_hash_length > 0)
+			{
+				compute_strong_hash(chunk_buffer.data(), ch.length, strong_hash, strong_hash_length);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Computes hash, checksum and optionally strong hash of consecutive chunks that all have the same length.
+	/// Hashes and strong hashes of several chunks are computed at once by the SIMD kernels.
+	/// </summary>
+	void compute_equal_chunk_hashes(const char* data, size_t chunk_length, chunk* chunks, size_t num_chunks,
+		uint8_t* strong_hashes, size_t strong_hash_length);
+} // namespace impl
+
 /// <summary>
 /// Creates a signature of the given data
 /// </summary>
@@ -60,18 +274,61 @@ bool operator!=(const signature& left, const signature& right);
 /// <param name="data">Forward iterator to the beginning of the input data.</param>
 /// <param name="data_length">Length of the input</param>
 /// <param name="chunk_length">How big should each chunk be</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
 /// <returns></returns>
 template <typename InputIter>
-signature calculate_signature(InputIter data, size_t data_length, size_t chunk_length)
+signature calculate_signature(InputIter data, size_t data_length, size_t chunk_length, size_t strong_hash_length = default_strong_hash_length,
+	const progress_callback& progress = {})
 {
-	if (!*data)
+	if constexpr (std::is_pointer_v<InputIter>)
+	{
+		if (data == nullptr)
+		{
+			throw std::invalid_argument("data parameter is nullptr!");
+		}
+	}
+
+	if (chunk_length == 0)
 	{
-		throw std::invalid_argument("data parameter is nullptr!");
+		throw std::invalid_argument("chunk_length parameter is 0!");
+	}
+
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
 	}
 
 	signature result;
+	result.strong_hash_length = strong_hash_length;
+	result.chunks.reserve(data_length / chunk_length + 1);
+	result.strong_hashes.resize((data_length / chunk_length + 1) * strong_hash_length);
+	std::vector<char> chunk_buffer;
+	impl::progress_tracker tracker(progress, data_length);
 
 	size_t data_index = 0;
+	if constexpr (std::is_pointer_v<InputIter> && std::is_same_v<std::remove_cv_t<std::remove_pointer_t<InputIter>>, char>)
+	{
+		// whole chunks of data in memory are hashed several at once, in parts of about progress_interval bytes
+		const size_t num_whole_chunks = data_length / chunk_length;
+		result.chunks.resize(num_whole_chunks);
+		for (size_t i = 0; i < num_whole_chunks; ++i)
+		{
+			result.chunks[i].start_position = i * chunk_length;
+			result.chunks[i].length = chunk_length;
+		}
+		const size_t chunks_per_part = std::max<size_t>(1, progress_interval / chunk_length);
+		for (size_t first_chunk = 0; first_chunk < num_whole_chunks; first_chunk += chunks_per_part)
+		{
+			const size_t part_chunks = std::min(chunks_per_part, num_whole_chunks - first_chunk);
+			impl::compute_equal_chunk_hashes(data + first_chunk * chunk_length, chunk_length, result.chunks.data() + first_chunk, part_chunks,
+				result.strong_hashes.data() + first_chunk * strong_hash_length, strong_hash_length);
+			tracker.update((first_chunk + part_chunks) * chunk_length);
+		}
+		data_index = num_whole_chunks * chunk_length;
+		data += data_index;
+	}
+
 	while (data_index < data_length)
 	{
 		chunk new_chunk;
@@ -86,13 +343,149 @@ signature calculate_signature(InputIter data, size_t data_length, size_t chunk_l
 			new_chunk.length = data_length - data_index;
 		}
 
-		new_chunk.hash = compute_hash(data, new_chunk.length);
+		impl::compute_chunk_hashes(data, new_chunk, result.strong_hashes.data() + result.chunks.size() * strong_hash_length,
+			strong_hash_length, chunk_buffer);
+		data_index += new_chunk.length;
+		tracker.update(data_index);
+
+		result.chunks.push_back(new_chunk);
+	}
+	result.strong_hashes.resize(result.chunks.size() * strong_hash_length);
+	tracker.finish();
+
+	return result;
+};
+
+/// <summary>
+/// Creates a signature of the given data with content-defined chunks.
+/// Chunk boundaries are found by the gear hash of the data (see cdc_chunker) instead of being at fixed positions,
+/// so data that was moved, inserted or removed only changes chunks around the change.
+/// </summary>
+/// <typeparam name="InputIter">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+/// <param name="data">Forward iterator to the beginning of the input data.</param>
+/// <param name="data_length">Length of the input</param>
+/// <param name="cdc">Minimal, average and maximal length of chunks</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
+/// <returns></returns>
+template <typename InputIter>
+signature calculate_signature_cdc(InputIter data, size_t data_length, const cdc_parameters& cdc, size_t strong_hash_length = default_strong_hash_length,
+	const progress_callback& progress = {})
+{
+	if constexpr (std::is_pointer_v<InputIter>)
+	{
+		if (data == nullptr)
+		{
+			throw std::invalid_argument("data parameter is nullptr!");
+		}
+	}
+
+	if (strong_hash_length > blake2b::max_digest_length)
+	{
+		throw std::invalid_argument("strong_hash_length parameter is too big!");
+	}
+
+	cdc_chunker chunker(cdc);
+	signature result;
+	result.strong_hash_length = strong_hash_length;
+	result.cdc = cdc;
+	result.chunks.reserve(data_length / cdc.average_length + 1);
+	std::vector<char> chunk_buffer;
+	impl::progress_tracker tracker(progress, data_length);
+
+	size_t data_index = 0;
+	while (data_index < data_length)
+	{
+		chunk new_chunk;
+		new_chunk.start_position = data_index;
+		result.strong_hashes.resize((result.chunks.size() + 1) * strong_hash_length);
+		uint8_t* strong_hash = result.strong_hashes.data() + result.chunks.size() * strong_hash_length;
+
+		if constexpr (std::is_pointer_v<InputIter>)
+		{
+			new_chunk.length = chunker.next_chunk_length(reinterpret_cast<const char*>(data), data_length - data_index);
+			impl::compute_chunk_hashes(data, new_chunk, strong_hash, strong_hash_length, chunk_buffer);
+		}
+		else
+		{
+			// boundary is known only after the chunk is read
+			chunk_buffer.clear();
+			for (bool chunk_end = false; !chunk_end && data_index + chunk_buffer.size() < data_length;)
+			{
+				chunk_buffer.push_back(*data++);
+				chunk_end = chunker.update(chunk_buffer.back());
+			}
+			chunker.reset();
+
+			new_chunk.length = chunk_buffer.size();
+			const char* chunk_data = chunk_buffer.data();
+			impl::compute_chunk_hashes(chunk_data, new_chunk, strong_hash, strong_hash_length, chunk_buffer);
+		}
 		data_index += new_chunk.length;
+		tracker.update(data_index);
 
 		result.chunks.push_back(new_chunk);
 	}
+	tracker.finish();
 
 	return result;
 };
+
+/// <summary>
+/// Creates a signature of the data read from the stream until its end, the length of the data doesn't have to be known.
+/// The data is read ahead in blocks on a background thread, so reading overlaps with hashing and only a few blocks are in memory.
+/// The result is exactly the same as the result of calculate_signature.
+/// Throws std::runtime_error if the stream fails before its end.
+/// </summary>
+/// <param name="input">Stream of the input data</param>
+/// <param name="chunk_length">How big should each chunk be</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
+/// <returns></returns>
+signature calculate_signature_stream(std::istream& input, size_t chunk_length, size_t strong_hash_length = default_strong_hash_length,
+	const progress_callback& progress = {});
+
+/// <summary>
+/// Creates a signature with content-defined chunks of the data read from the stream until its end,
+/// the length of the data doesn't have to be known. The result is exactly the same as the result of calculate_signature_cdc.
+/// Throws std::runtime_error if the stream fails before its end.
+/// </summary>
+/// <param name="input">Stream of the input data</param>
+/// <param name="cdc">Minimal, average and maximal length of chunks</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
+/// <returns></returns>
+signature calculate_signature_cdc_stream(std::istream& input, const cdc_parameters& cdc, size_t strong_hash_length = default_strong_hash_length,
+	const progress_callback& progress = {});
+
+/// <summary>
+/// Creates a signature of the given data on multiple threads.
+/// The data is split into ranges of whole chunks that are hashed independently,
+/// so the result is exactly the same as the result of calculate_signature.
+/// </summary>
+/// <param name="data">Pointer to the beginning of the input data.</param>
+/// <param name="data_length">Length of the input</param>
+/// <param name="chunk_length">How big should each chunk be</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="num_threads">Number of threads to use, 0 means all hardware threads</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
+/// <returns></returns>
+signature calculate_signature_parallel(const char* data, size_t data_length, size_t chunk_length, size_t strong_hash_length, size_t num_threads,
+	const progress_callback& progress = {});
+
+/// <summary>
+/// Creates a signature of the given data with content-defined chunks on multiple threads.
+/// Chunk boundaries are found first on the calling thread and then chunks are hashed in parallel,
+/// so the result is exactly the same as the result of calculate_signature_cdc.
+/// </summary>
+/// <param name="data">Pointer to the beginning of the input data.</param>
+/// <param name="data_length">Length of the input</param>
+/// <param name="cdc">Minimal, average and maximal length of chunks</param>
+/// <param name="strong_hash_length">Length of the strong hash of every chunk in bytes, from 0 to 64. 0 turns strong hashes off</param>
+/// <param name="num_threads">Number of threads to use, 0 means all hardware threads</param>
+/// <param name="progress">Optional callback that receives the number of hashed bytes</param>
+/// <returns></returns>
+signature calculate_signature_cdc_parallel(const char* data, size_t data_length, const cdc_parameters& cdc, size_t strong_hash_length, size_t num_threads,
+	const progress_callback& progress = {});
 	
 }; // namespace rd
@@ -0,0 +1,322 @@
+#include "strong_hash.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#if RD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace rd
+{
+
+namespace
+{
+	constexpr uint64_t blake2b_iv[8] = {
+		0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+		0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+	};
+
+	constexpr uint8_t blake2b_sigma[12][16] = {
+		{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+		{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+		{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+		{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+		{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+		{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+		{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+		{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+		{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+		{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+	};
+
+	inline uint64_t rotate_right(uint64_t value, int bits)
+	{
+		return (value >> bits) | (value << (64 - bits));
+	}
+
+	inline uint64_t load_little_endian(const uint8_t* data)
+	{
+		uint64_t result = 0;
+		for (int i = 7; i >= 0; --i)
+		{
+			result = (result << 8) | data[i];
+		}
+
+		return result;
+	}
+
+	inline void mix(uint64_t* v, int a, int b, int c, int d, uint64_t x, uint64_t y)
+	{
+		v[a] = v[a] + v[b] + x;
+		v[d] = rotate_right(v[d] ^ v[a], 32);
+		v[c] = v[c] + v[d];
+		v[b] = rotate_right(v[b] ^ v[c], 24);
+		v[a] = v[a] + v[b] + y;
+		v[d] = rotate_right(v[d] ^ v[a], 16);
+		v[c] = v[c] + v[d];
+		v[b] = rotate_right(v[b] ^ v[c], 63);
+	}
+
+	void compute_strong_hashes_scalar(const char* data, size_t chunk_length, size_t num_chunks, uint8_t* digests, size_t digest_length)
+	{
+		for (size_t i = 0; i < num_chunks; ++i)
+		{
+			compute_strong_hash(data + i * chunk_length, chunk_length, digests + i * digest_length, digest_length);
+		}
+	}
+
+#if RD_X86_SIMD
+	// Lane k of every vector holds the state of the hash of chunk k, so the rounds are the same as in blake2b::compress.
+	// Message words are gathered from the chunks, the last block of every chunk is copied into a zero padded buffer.
+	template <int Bits>
+	RD_TARGET_AVX2 __m256i rotate_right(__m256i value)
+	{
+		if constexpr (Bits == 32)
+		{
+			return _mm256_shuffle_epi32(value, _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		else if constexpr (Bits == 24)
+		{
+			return _mm256_shuffle_epi8(value, _mm256_setr_epi8(
+				3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10));
+		}
+		else if constexpr (Bits == 16)
+		{
+			return _mm256_shuffle_epi8(value, _mm256_setr_epi8(
+				2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9));
+		}
+		else
+		{
+			return _mm256_or_si256(_mm256_srli_epi64(value, Bits), _mm256_slli_epi64(value, 64 - Bits));
+		}
+	}
+
+	RD_TARGET_AVX2 void mix(__m256i* v, int a, int b, int c, int d, __m256i x, __m256i y)
+	{
+		v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), x);
+		v[d] = rotate_right<32>(_mm256_xor_si256(v[d], v[a]));
+		v[c] = _mm256_add_epi64(v[c], v[d]);
+		v[b] = rotate_right<24>(_mm256_xor_si256(v[b], v[c]));
+		v[a] = _mm256_add_epi64(_mm256_add_epi64(v[a], v[b]), y);
+		v[d] = rotate_right<16>(_mm256_xor_si256(v[d], v[a]));
+		v[c] = _mm256_add_epi64(v[c], v[d]);
+		v[b] = rotate_right<63>(_mm256_xor_si256(v[b], v[c]));
+	}
+
+	RD_TARGET_AVX2 void compress(__m256i* h, const __m256i* m, uint64_t counter, bool last_block)
+	{
+		__m256i v[16];
+		for (int i = 0; i < 8; ++i)
+		{
+			v[i] = h[i];
+			v[i + 8] = _mm256_set1_epi64x(static_cast<long long>(blake2b_iv[i]));
+		}
+		v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi64x(static_cast<long long>(counter)));
+		if (last_block)
+		{
+			v[14] = _mm256_xor_si256(v[14], _mm256_set1_epi64x(-1));
+		}
+
+		for (const auto& s : blake2b_sigma)
+		{
+			mix(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+			mix(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+			mix(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+			mix(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+			mix(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+			mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+			mix(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+			mix(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+		}
+
+		for (int i = 0; i < 8; ++i)
+		{
+			h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+		}
+	}
+
+	RD_TARGET_AVX2 void compute_strong_hashes_avx2(const char* data, size_t chunk_length, size_t num_chunks, uint8_t* digests, size_t digest_length)
+	{
+		constexpr size_t lanes = 4;
+		constexpr size_t block_length = blake2b::block_length;
+		const size_t num_blocks = chunk_length == 0 ? 1 : (chunk_length + block_length - 1) / block_length;
+		const size_t last_block_length = chunk_length - (num_blocks - 1) * block_length;
+		const __m256i offsets = _mm256_setr_epi64x(0, static_cast<long long>(chunk_length),
+			static_cast<long long>(2 * chunk_length), static_cast<long long>(3 * chunk_length));
+		const __m256i last_block_offsets = _mm256_setr_epi64x(0, block_length, 2 * block_length, 3 * block_length);
+
+		for (; num_chunks >= lanes; num_chunks -= lanes, data += lanes * chunk_length, digests += lanes * digest_length)
+		{
+			__m256i h[8];
+			for (int i = 0; i < 8; ++i)
+			{
+				h[i] = _mm256_set1_epi64x(static_cast<long long>(blake2b_iv[i]));
+			}
+			h[0] = _mm256_xor_si256(h[0], _mm256_set1_epi64x(static_cast<long long>(0x01010000 ^ digest_length)));
+
+			__m256i m[16];
+			for (size_t block = 0; block + 1 < num_blocks; ++block)
+			{
+				const char* block_data = data + block * block_length;
+				for (int i = 0; i < 16; ++i)
+				{
+					m[i] = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(block_data + 8 * i), offsets, 1);
+				}
+				compress(h, m, (block + 1) * block_length, false);
+			}
+
+			alignas(32) uint8_t last_blocks[lanes][block_length]{};
+			for (size_t k = 0; k < lanes; ++k)
+			{
+				std::memcpy(last_blocks[k], data + k * chunk_length + (num_blocks - 1) * block_length, last_block_length);
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				m[i] = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(last_blocks[0] + 8 * i), last_block_offsets, 1);
+			}
+			compress(h, m, chunk_length, true);
+
+			alignas(32) uint64_t words[8][lanes];
+			for (int i = 0; i < 8; ++i)
+			{
+				_mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), h[i]);
+			}
+			for (size_t k = 0; k < lanes; ++k)
+			{
+				for (size_t i = 0; i < digest_length; ++i)
+				{
+					digests[k * digest_length + i] = static_cast<uint8_t>(words[i / 8][k] >> (8 * (i % 8)));
+				}
+			}
+		}
+
+		compute_strong_hashes_scalar(data, chunk_length, num_chunks, digests, digest_length);
+	}
+#endif
+} // namespace
+
+blake2b::blake2b(size_t digest_length)
+	: digest_length(digest_length)
+{
+	if (digest_length == 0 || digest_length > max_digest_length)
+	{
+		throw std::invalid_argument("BLAKE2b digest length has to be between 1 and 64 bytes!");
+	}
+
+	for (int i = 0; i < 8; ++i)
+	{
+		h[i] = blake2b_iv[i];
+	}
+	h[0] ^= 0x01010000 ^ digest_length;
+}
+
+void blake2b::update(const void* data, size_t data_length)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	while (data_length > 0)
+	{
+		// the last block is compressed in final() so we compress only when we know that more data follows
+		if (buffer_length == block_length)
+		{
+			t[0] += block_length;
+			if (t[0] < block_length)
+			{
+				++t[1];
+			}
+			compress(false);
+			buffer_length = 0;
+		}
+
+		const size_t length = std::min(block_length - buffer_length, data_length);
+		std::memcpy(buffer + buffer_length, bytes, length);
+		buffer_length += length;
+		bytes += length;
+		data_length -= length;
+	}
+}
+
+void blake2b::final(uint8_t* digest)
+{
+	t[0] += buffer_length;
+	if (t[0] < buffer_length)
+	{
+		++t[1];
+	}
+	std::memset(buffer + buffer_length, 0, block_length - buffer_length);
+	compress(true);
+
+	for (size_t i = 0; i < digest_length; ++i)
+	{
+		digest[i] = static_cast<uint8_t>(h[i / 8] >> (8 * (i % 8)));
+	}
+}
+
+void blake2b::compress(bool last_block)
+{
+	uint64_t v[16];
+	uint64_t m[16];
+
+	for (int i = 0; i < 8; ++i)
+	{
+		v[i] = h[i];
+		v[i + 8] = blake2b_iv[i];
+	}
+	v[12] ^= t[0];
+	v[13] ^= t[1];
+	if (last_block)
+	{
+		v[14] = ~v[14];
+	}
+
+	for (int i = 0; i < 16; ++i)
+	{
+		m[i] = load_little_endian(buffer + 8 * i);
+	}
+
+	for (const auto& s : blake2b_sigma)
+	{
+		mix(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+		mix(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+		mix(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+		mix(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+		mix(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+		mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+		mix(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+		mix(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+	}
+
+	for (int i = 0; i < 8; ++i)
+	{
+		h[i] ^= v[i] ^ v[i + 8];
+	}
+}
+
+namespace impl
+{
+	void compute_strong_hashes_at_level(const char* data, size_t chunk_length, size_t num_chunks, uint8_t* digests, size_t digest_length, simd_level level)
+	{
+		if (digest_length == 0 || digest_length > blake2b::max_digest_length)
+		{
+			throw std::invalid_argument("BLAKE2b digest length has to be between 1 and 64 bytes!");
+		}
+
+		switch (level)
+		{
+#if RD_X86_SIMD
+		case simd_level::avx512:
+		case simd_level::avx2:
+			compute_strong_hashes_avx2(data, chunk_length, num_chunks, digests, digest_length);
+			break;
+#endif
+		default:
+			compute_strong_hashes_scalar(data, chunk_length, num_chunks, digests, digest_length);
+			break;
+		}
+	}
+} // namespace impl
+
+}; // namespace rd
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include "cpu_features.hpp"
+
+namespace rd
+{
+
+/// <summary>
+/// BLAKE2b cryptographic hash function with selectable digest length.
+/// Used for confirming that a chunk found by the weak checksum and the hash is really the original chunk.
+/// Details: https://www.rfc-editor.org/rfc/rfc7693
+/// </summary>
+class blake2b
+{
+public:
+    static constexpr size_t max_digest_length = 64;
+    static constexpr size_t block_length = 128;
+
+    /// <summary>
+    /// Creates hasher that produces digest of the given length
+    /// </summary>
+    /// <param name="digest_length">Length of the digest in bytes, from 1 to 64</param>
+    explicit blake2b(size_t digest_length);
+
+    /// <summary>
+    /// Adds data to the hash
+    /// </summary>
+    /// <param name="data">Pointer to the beginning of the data</param>
+    /// <param name="data_length">Length of the data</param>
+    void update(const void* data, size_t data_length);
+
+    /// <summary>
+    /// Finishes hashing and writes the digest
+    /// </summary>
+    /// <param name="digest">Output array that has at least digest_length bytes</param>
+    void final(uint8_t* digest);
+
+private:
+    void compress(bool last_block);
+
+    uint64_t h[8];
+    uint64_t t[2]{ 0, 0 };
+    uint8_t buffer[block_length];
+    size_t buffer_length{ 0 };
+    size_t digest_length{ 0 };
+};
+
+/// <summary>
+/// Computes strong (cryptographic) hash of the given data.
+/// </summary>
+/// <typeparam name="InIterator">Forward iterator that implement increment(++) and dereference(*) operators</typeparam>
+/// <param name="input">Forward iterator to the beginning of the input data. Keep in mind that it will be modified by this function</param>
+/// <param name="data_length">Length of the input</param>
+/// <param name="digest">Output array that has at least digest_length bytes</param>
+/// <param name="digest_length">Length of the digest in bytes, from 1 to 64</param>
+template <typename InIterator>
+void compute_strong_hash(InIterator&& input, size_t data_length, uint8_t* digest, size_t digest_length)
+{
+    blake2b hasher(digest_length);
+
+    if constexpr (std::is_pointer_v<std::decay_t<InIterator>>)
+    {
+        hasher.update(input, data_length);
+        input += data_length;
+    }
+    else
+    {
+        char block[blake2b::block_length];
+        while (data_length > 0)
+        {
+            size_t block_length = 0;
+            for (; block_length < blake2b::block_length && block_length < data_length; ++block_length)
+            {
+                block[block_length] = *input++;
+            }
+
+            hasher.update(block, block_length);
+            data_length -= block_length;
+        }
+    }
+
+    hasher.final(digest);
+}
+
+/// <summary>
+/// Helper functions used internally by the strong hash
+/// </summary>
+namespace impl
+{
+    /// <summary>
+    /// Strong hashes of consecutive chunks computed by the kernel of the given level, all levels give the same result.
+    /// </summary>
+    /// <param name="level">Level of the kernel, it can't be higher than supported_simd_level()</param>
+    void compute_strong_hashes_at_level(const char* data, size_t chunk_length, size_t num_chunks, uint8_t* digests, size_t digest_length, simd_level level);
+} // namespace impl
+
+/// <summary>
+/// Computes strong hash of every chunk of consecutive chunks of the same length,
+/// digests of chunk i are at digests + i * digest_length and they are the same as compute_strong_hash() gives.
+/// SIMD kernels run one BLAKE2b instance in every 64 bit lane, so several chunks are hashed at once.
+/// </summary>
+/// <param name="data">Pointer to the beginning of the first chunk</param>
+/// <param name="chunk_length">Length of every chunk</param>
+/// <param name="num_chunks">Number of chunks</param>
+/// <param name="digests">Output array that has at least num_chunks * digest_length bytes</param>
+/// <param name="digest_length">Length of every digest in bytes, from 1 to 64</param>
+inline void compute_strong_hashes(const char* data, size_t chunk_length, size_t num_chunks, uint8_t* digests, size_t digest_length)
+{
+    impl::compute_strong_hashes_at_level(data, chunk_length, num_chunks, digests, digest_length, impl::supported_simd_level());
+}
+
+
+}; // namespace rd
\ No newline at end of file
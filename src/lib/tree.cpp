@@ -0,0 +1,767 @@
+#include "tree.hpp"
+#include "parallel.hpp"
+#include "patch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace rd
+{
+
+namespace
+{
+	namespace fs = std::filesystem;
+
+	// every task of the workers gets about this much data, files shorter than min_task_file_length count as that long
+	// because opening a file costs about as much as reading a few kB of it
+	constexpr size_t task_data_length = 1024 * 1024;
+	constexpr size_t min_task_file_length = 4096;
+
+	void store_little_endian(std::string& output, uint64_t value, size_t length)
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			output.push_back(static_cast<char>(value >> (8 * i)));
+		}
+	}
+
+	uint64_t load_little_endian(const char* data, size_t length)
+	{
+		uint64_t value = 0;
+		for (size_t i = length; i-- > 0;)
+		{
+			value = (value << 8) | static_cast<uint8_t>(data[i]);
+		}
+
+		return value;
+	}
+
+	void store_varint(std::string& output, uint64_t value)
+	{
+		for (; value >= 0x80; value >>= 7)
+		{
+			output.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		}
+		output.push_back(static_cast<char>(value));
+	}
+
+	/// <summary>
+	/// Read-only stream buffer over data in memory, used for payloads of a mapped archive
+	/// </summary>
+	class memory_buffer : public std::streambuf
+	{
+	public:
+		memory_buffer(const char* data, size_t length)
+		{
+			char* begin = const_cast<char*>(data);
+			setg(begin, begin, begin + length);
+		}
+	};
+
+	/// <summary>
+	/// File on the disk listed by list_files
+	/// </summary>
+	struct listed_file
+	{
+		std::string path; // relative to the root of the tree
+		fs::path full_path;
+		uint64_t size{ 0 };
+		int64_t modification_time{ 0 };
+	};
+
+	/// <summary>
+	/// Content of a file, mapped into memory or read into a buffer if it can't be mapped (empty files, special files)
+	/// </summary>
+	struct file_content
+	{
+		mapped_file mapping;
+		std::vector<char> buffer;
+		const char* data{ "" };
+		size_t size{ 0 };
+	};
+
+	/// <summary>
+	/// Entry of an archive with its payload, created by a worker and written to the archive by the calling thread
+	/// </summary>
+	struct file_record
+	{
+		tree_entry entry;
+		std::string payload;
+		size_t bytes_read{ 0 };
+	};
+
+	int64_t to_nanoseconds(fs::file_time_type time)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+	}
+
+	fs::file_time_type from_nanoseconds(int64_t time)
+	{
+		return fs::file_time_type(std::chrono::duration_cast<fs::file_time_type::duration>(std::chrono::nanoseconds(time)));
+	}
+
+	std::vector<listed_file> list_files(const std::string& directory)
+	{
+		std::error_code error;
+		if (!fs::is_directory(directory, error))
+		{
+			throw std::runtime_error("Unable to read directory '" + directory + "'!");
+		}
+
+		// symbolic links are skipped, only regular files are diffed
+		std::vector<listed_file> result;
+		for (const auto& item : fs::recursive_directory_iterator(directory))
+		{
+			if (item.is_symlink() || !item.is_regular_file())
+			{
+				continue;
+			}
+
+			listed_file file;
+			file.full_path = item.path();
+			file.path = item.path().lexically_relative(directory).generic_string();
+			file.size = item.file_size();
+			file.modification_time = to_nanoseconds(item.last_write_time());
+			result.push_back(std::move(file));
+		}
+
+		std::sort(result.begin(), result.end(), [](const listed_file& left, const listed_file& right) { return left.path < right.path; });
+		return result;
+	}
+
+	void load_file(const fs::path& file_name, file_content& content)
+	{
+		if (content.mapping.open_read(file_name.string()))
+		{
+			content.data = content.mapping.data();
+			content.size = content.mapping.size();
+			return;
+		}
+
+		std::ifstream file(file_name, std::ios_base::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Unable to open file '" + file_name.string() + "'!");
+		}
+		content.buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		content.data = content.buffer.empty() ? "" : content.buffer.data();
+		content.size = content.buffer.size();
+	}
+
+	void compute_file_hash(const char* data, size_t size, uint8_t* hash)
+	{
+		blake2b hasher(tree_format::file_hash_length);
+		hasher.update(data, size);
+		hasher.final(hash);
+	}
+
+	void compute_file_hash(const file_content& content, uint8_t* hash)
+	{
+		compute_file_hash(content.data, content.size, hash);
+	}
+
+	/// <summary>
+	/// Compares the whole-file hash of the data with the hash of the entry
+	/// </summary>
+	bool has_file_hash(const char* data, size_t size, const tree_entry& entry)
+	{
+		uint8_t hash[tree_format::file_hash_length];
+		compute_file_hash(data, size, hash);
+		return std::equal(std::begin(hash), std::end(hash), std::begin(entry.file_hash));
+	}
+
+	/// <summary>
+	/// Paths in archives come from other machines, they must not point outside of the tree
+	/// </summary>
+	fs::path tree_path(const std::string& root, const std::string& path)
+	{
+		const fs::path relative(path);
+		if (path.empty() || relative.has_root_path() || relative.has_root_name())
+		{
+			throw std::runtime_error("Invalid path '" + path + "' in archive!");
+		}
+		for (const auto& part : relative)
+		{
+			if (part == "..")
+			{
+				throw std::runtime_error("Invalid path '" + path + "' in archive!");
+			}
+		}
+
+		return fs::path(root) / relative;
+	}
+
+	/// <summary>
+	/// Splits items into tasks of about task_data_length bytes, items shorter than min_task_file_length count as that long
+	/// </summary>
+	template <typename Size>
+	std::vector<std::pair<size_t, size_t>> make_tasks(size_t begin, size_t end, const Size& size)
+	{
+		std::vector<std::pair<size_t, size_t>> tasks;
+		size_t task_begin = begin;
+		size_t task_length = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			task_length += std::max<size_t>(size(i), min_task_file_length);
+			if (task_length >= task_data_length)
+			{
+				tasks.emplace_back(task_begin, i + 1);
+				task_begin = i + 1;
+				task_length = 0;
+			}
+		}
+		if (task_begin < end)
+		{
+			tasks.emplace_back(task_begin, end);
+		}
+
+		return tasks;
+	}
+
+	void add_to_stats(tree_stats& stats, uint8_t kind, size_t bytes_read)
+	{
+		++stats.files;
+		stats.unchanged_files += kind == tree_format::unchanged_file ? 1 : 0;
+		stats.changed_files += kind == tree_format::changed_file ? 1 : 0;
+		stats.removed_files += kind == tree_format::removed_file ? 1 : 0;
+		stats.bytes += bytes_read;
+	}
+
+	/// <summary>
+	/// Processes files of a tree and writes their records to the archive in the order of the files.
+	/// Small files are grouped into tasks for the workers, every task creates records of its files in memory.
+	/// Tasks are run in batches of a few tasks per thread so only records of one batch are kept in memory.
+	/// Large files are processed on the calling thread by large_file(), which can use all threads for one file
+	/// and writes its payload straight to the archive.
+	/// </summary>
+	template <typename SmallFile, typename LargeFile>
+	void process_files(const std::vector<listed_file>& files, const tree_options& options, tree_archive_writer& writer, tree_stats& stats,
+		const SmallFile& small_file, const LargeFile& large_file)
+	{
+		const size_t num_threads = resolve_thread_count(options.num_threads);
+		const size_t tasks_per_batch = num_threads * 4;
+		std::vector<std::vector<file_record>> records;
+
+		const auto process_small_files = [&](size_t begin, size_t end)
+		{
+			const auto tasks = make_tasks(begin, end, [&](size_t i) { return files[i].size; });
+			for (size_t batch_begin = 0; batch_begin < tasks.size(); batch_begin += tasks_per_batch)
+			{
+				const size_t batch_size = std::min(tasks_per_batch, tasks.size() - batch_begin);
+				records.assign(batch_size, {});
+				parallel_for(batch_size, num_threads, [&](size_t i)
+				{
+					const auto& task = tasks[batch_begin + i];
+					for (size_t file_index = task.first; file_index < task.second; ++file_index)
+					{
+						records[i].push_back(small_file(files[file_index]));
+					}
+				});
+
+				for (auto& task_records : records)
+				{
+					for (auto& record : task_records)
+					{
+						add_to_stats(stats, record.entry.kind, record.bytes_read);
+						writer.add(std::move(record.entry), record.payload);
+					}
+				}
+			}
+		};
+
+		size_t small_begin = 0;
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			if (files[i].size >= options.large_file_length)
+			{
+				process_small_files(small_begin, i);
+				small_begin = i + 1;
+
+				const auto record = large_file(files[i]);
+				add_to_stats(stats, record.first, record.second);
+			}
+		}
+		process_small_files(small_begin, files.size());
+	}
+
+	tree_entry make_entry(uint8_t kind, const listed_file& file)
+	{
+		tree_entry entry;
+		entry.kind = kind;
+		entry.path = file.path;
+		entry.file_size = file.size;
+		entry.modification_time = file.modification_time;
+
+		return entry;
+	}
+
+	signature calculate_file_signature(const file_content& content, const tree_options& options, size_t num_threads)
+	{
+		if (options.cdc.enabled())
+		{
+			return num_threads == 1
+				? calculate_signature_cdc<const char*>(content.data, content.size, options.cdc, options.strong_hash_length)
+				: calculate_signature_cdc_parallel(content.data, content.size, options.cdc, options.strong_hash_length, num_threads);
+		}
+
+		return num_threads == 1
+			? calculate_signature<const char*>(content.data, content.size, options.chunk_length, options.strong_hash_length)
+			: calculate_signature_parallel(content.data, content.size, options.chunk_length, options.strong_hash_length, num_threads);
+	}
+
+	/// <summary>
+	/// Finds out if the file is the same as the original one: by size and modification time without reading the file,
+	/// otherwise by the whole-file hash if the size is the same. Fills the size and the hash of the entry if the file was read.
+	/// </summary>
+	bool is_unchanged(const tree_entry* original, const listed_file& file, tree_entry& entry, file_content& content)
+	{
+		if (original != nullptr && original->file_size == file.size && original->modification_time == file.modification_time)
+		{
+			std::copy(std::begin(original->file_hash), std::end(original->file_hash), entry.file_hash);
+			return true;
+		}
+
+		load_file(file.full_path, content);
+		entry.file_size = content.size;
+		compute_file_hash(content, entry.file_hash);
+
+		return original != nullptr && original->file_size == content.size
+			&& std::equal(std::begin(original->file_hash), std::end(original->file_hash), entry.file_hash);
+	}
+
+	/// <summary>
+	/// Signature of the original file, empty for new files
+	/// </summary>
+	signature load_original_signature(const tree_archive& signatures, const tree_entry* original)
+	{
+		signature result;
+		if (original != nullptr)
+		{
+			memory_buffer payload(signatures.payload(*original), original->payload_length);
+			std::istream is(&payload);
+			signature::read_from_binary_file(is, result);
+		}
+
+		return result;
+	}
+
+	/// <summary>
+	/// Writes delta of the file to the sink. Files without original data (new or originally empty files) are copied as a whole.
+	/// </summary>
+	void calculate_file_delta(const signature& sig, const file_content& content, delta_writer& sink, size_t num_threads)
+	{
+		if (sig.chunks.empty())
+		{
+			if (content.size > 0)
+			{
+				sink.copy_data(0, content.size, content.data);
+			}
+		}
+		else if (num_threads == 1)
+		{
+			calculate_delta<const char*>(sig, content.data, content.size, sink);
+		}
+		else
+		{
+			calculate_delta_parallel(sig, content.data, content.size, sink, num_threads);
+		}
+		sink.finish();
+	}
+} // namespace
+
+tree_archive::tree_archive(const std::string& file_name, const char (&magic)[4])
+{
+	if (file.open_read(file_name))
+	{
+		data = file.data();
+	}
+	else
+	{
+		std::ifstream is(file_name, std::ios_base::binary);
+		if (!is.is_open())
+		{
+			throw std::runtime_error("Unable to open archive '" + file_name + "'!");
+		}
+		buffer.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+		data = buffer.data();
+	}
+	const size_t size = file.is_open() ? file.size() : buffer.size();
+
+	if (size < tree_format::header_length + tree_format::footer_length || !std::equal(std::begin(magic), std::end(magic), data)
+		|| !std::equal(std::begin(magic), std::end(magic), data + size - tree_format::footer_length + 16))
+	{
+		throw std::runtime_error("File '" + file_name + "' is not a tree archive of this kind!");
+	}
+	if (static_cast<uint8_t>(data[4]) != tree_format::version)
+	{
+		throw std::runtime_error("Unsupported tree archive version!");
+	}
+
+	const char* footer = data + size - tree_format::footer_length;
+	const uint64_t index_offset = load_little_endian(footer, 8);
+	const uint64_t num_entries = load_little_endian(footer + 8, 8);
+	const char* index_end = footer;
+	if (index_offset < tree_format::header_length || index_offset > size - tree_format::footer_length)
+	{
+		throw std::runtime_error("Tree archive is corrupted!");
+	}
+
+	constexpr size_t fixed_entry_length = 1 + 8 + 8 + tree_format::file_hash_length + 8 + 8;
+	const char* position = data + index_offset;
+	const auto require = [&](size_t length)
+	{
+		if (static_cast<size_t>(index_end - position) < length)
+		{
+			throw std::runtime_error("Tree archive is corrupted!");
+		}
+	};
+	for (uint64_t i = 0; i < num_entries; ++i)
+	{
+		tree_entry entry;
+		require(1);
+		entry.kind = static_cast<uint8_t>(*position++);
+
+		uint64_t path_length = 0;
+		for (int shift = 0;; shift += 7)
+		{
+			require(1);
+			const auto byte = static_cast<uint8_t>(*position++);
+			if (shift > 63)
+			{
+				throw std::runtime_error("Tree archive is corrupted!");
+			}
+			path_length |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				break;
+			}
+		}
+		require(path_length);
+		entry.path.assign(position, path_length);
+		position += path_length;
+
+		require(fixed_entry_length - 1);
+		entry.file_size = load_little_endian(position, 8);
+		entry.modification_time = static_cast<int64_t>(load_little_endian(position + 8, 8));
+		std::copy_n(position + 16, tree_format::file_hash_length, entry.file_hash);
+		position += 16 + tree_format::file_hash_length;
+		entry.payload_offset = load_little_endian(position, 8);
+		entry.payload_length = load_little_endian(position + 8, 8);
+		position += 16;
+
+		if (entry.kind > tree_format::removed_file || entry.payload_offset < tree_format::header_length
+			|| entry.payload_offset > index_offset || entry.payload_length > index_offset - entry.payload_offset)
+		{
+			throw std::runtime_error("Tree archive is corrupted!");
+		}
+		index.push_back(std::move(entry));
+	}
+
+	if (!std::is_sorted(index.begin(), index.end(), [](const tree_entry& left, const tree_entry& right) { return left.path < right.path; }))
+	{
+		throw std::runtime_error("Tree archive is corrupted, its index is not sorted!");
+	}
+}
+
+const tree_entry* tree_archive::find(const std::string& path) const
+{
+	const auto found = std::lower_bound(index.begin(), index.end(), path,
+		[](const tree_entry& entry, const std::string& value) { return entry.path < value; });
+
+	return found != index.end() && found->path == path ? &*found : nullptr;
+}
+
+tree_archive_writer::tree_archive_writer(std::ostream& os, const char (&magic)[4])
+	: os(os), magic(magic)
+{
+	std::string header(magic, sizeof(magic));
+	header.push_back(static_cast<char>(tree_format::version));
+	header.resize(tree_format::header_length);
+	os.write(header.data(), header.size());
+	position = header.size();
+}
+
+void tree_archive_writer::add(tree_entry entry, const std::string& payload)
+{
+	entry.payload_offset = position;
+	entry.payload_length = payload.size();
+	os.write(payload.data(), payload.size());
+	position += payload.size();
+
+	index.push_back(std::move(entry));
+}
+
+std::ostream& tree_archive_writer::begin_entry(tree_entry entry)
+{
+	entry.payload_offset = position;
+	index.push_back(std::move(entry));
+
+	return os;
+}
+
+void tree_archive_writer::end_entry()
+{
+	const auto end_position = os.tellp();
+	if (end_position == std::ostream::pos_type(-1))
+	{
+		throw std::runtime_error("Unable to write tree archive, output stream is not seekable!");
+	}
+
+	position = static_cast<uint64_t>(end_position);
+	index.back().payload_length = position - index.back().payload_offset;
+}
+
+void tree_archive_writer::finish()
+{
+	std::sort(index.begin(), index.end(), [](const tree_entry& left, const tree_entry& right) { return left.path < right.path; });
+
+	std::string output;
+	for (const auto& entry : index)
+	{
+		output.push_back(static_cast<char>(entry.kind));
+		store_varint(output, entry.path.size());
+		output += entry.path;
+		store_little_endian(output, entry.file_size, 8);
+		store_little_endian(output, static_cast<uint64_t>(entry.modification_time), 8);
+		output.append(reinterpret_cast<const char*>(entry.file_hash), tree_format::file_hash_length);
+		store_little_endian(output, entry.payload_offset, 8);
+		store_little_endian(output, entry.payload_length, 8);
+	}
+
+	store_little_endian(output, position, 8);
+	store_little_endian(output, index.size(), 8);
+	output.append(magic, sizeof(tree_format::signature_magic));
+	output.append(4, '\0');
+	os.write(output.data(), output.size());
+	position += output.size();
+
+	os.flush();
+	if (!os)
+	{
+		throw std::runtime_error("Unable to write tree archive!");
+	}
+}
+
+tree_stats signature_tree(const std::string& directory, std::ostream& archive, const tree_options& options)
+{
+	const auto files = list_files(directory);
+	tree_archive_writer writer(archive, tree_format::signature_magic);
+	tree_stats stats;
+
+	const auto small_file = [&](const listed_file& file)
+	{
+		file_record record;
+		record.entry = make_entry(tree_format::file_signature, file);
+		file_content content;
+		load_file(file.full_path, content);
+		record.entry.file_size = content.size;
+		record.bytes_read = content.size;
+		compute_file_hash(content, record.entry.file_hash);
+
+		std::ostringstream payload;
+		signature::write_to_binary_file(payload, calculate_file_signature(content, options, 1));
+		record.payload = payload.str();
+		return record;
+	};
+
+	const auto large_file = [&](const listed_file& file)
+	{
+		auto entry = make_entry(tree_format::file_signature, file);
+		file_content content;
+		load_file(file.full_path, content);
+		entry.file_size = content.size;
+		compute_file_hash(content, entry.file_hash);
+
+		const auto sig = calculate_file_signature(content, options, resolve_thread_count(options.num_threads));
+		signature::write_to_binary_file(writer.begin_entry(std::move(entry)), sig);
+		writer.end_entry();
+		return std::make_pair(tree_format::file_signature, content.size);
+	};
+
+	process_files(files, options, writer, stats, small_file, large_file);
+	writer.finish();
+
+	return stats;
+}
+
+tree_stats delta_tree(const std::string& signature_archive, const std::string& directory, std::ostream& archive, const tree_options& options)
+{
+	const tree_archive signatures(signature_archive, tree_format::signature_magic);
+	const auto files = list_files(directory);
+	tree_archive_writer writer(archive, tree_format::delta_magic);
+	tree_stats stats;
+
+	const auto small_file = [&](const listed_file& file)
+	{
+		file_record record;
+		record.entry = make_entry(tree_format::unchanged_file, file);
+		const auto original = signatures.find(file.path);
+		file_content content;
+		const bool unchanged = is_unchanged(original, file, record.entry, content);
+		record.bytes_read = content.size;
+		if (unchanged)
+		{
+			return record;
+		}
+
+		record.entry.kind = tree_format::changed_file;
+		const auto sig = load_original_signature(signatures, original);
+		std::ostringstream payload;
+		delta_writer sink(payload, options.literal_codec);
+		calculate_file_delta(sig, content, sink, 1);
+		record.payload = payload.str();
+		return record;
+	};
+
+	const auto large_file = [&](const listed_file& file)
+	{
+		auto entry = make_entry(tree_format::unchanged_file, file);
+		const auto original = signatures.find(file.path);
+		file_content content;
+		if (is_unchanged(original, file, entry, content))
+		{
+			writer.add(std::move(entry), std::string());
+			return std::make_pair(tree_format::unchanged_file, content.size);
+		}
+
+		entry.kind = tree_format::changed_file;
+		const auto sig = load_original_signature(signatures, original);
+		delta_writer sink(writer.begin_entry(std::move(entry)), options.literal_codec);
+		calculate_file_delta(sig, content, sink, resolve_thread_count(options.num_threads));
+		writer.end_entry();
+		return std::make_pair(tree_format::changed_file, content.size);
+	};
+
+	process_files(files, options, writer, stats, small_file, large_file);
+
+	// original files that are not in the tree any more, both lists are sorted by path
+	auto file = files.begin();
+	for (const auto& original : signatures.entries())
+	{
+		while (file != files.end() && file->path < original.path)
+		{
+			++file;
+		}
+		if (file == files.end() || file->path != original.path)
+		{
+			tree_entry entry;
+			entry.kind = tree_format::removed_file;
+			entry.path = original.path;
+			writer.add(std::move(entry), std::string());
+			add_to_stats(stats, tree_format::removed_file, 0);
+		}
+	}
+	writer.finish();
+
+	return stats;
+}
+
+tree_stats patch_tree(const std::string& directory, const std::string& delta_archive, const std::string& output_directory, const tree_options& options)
+{
+	const tree_archive deltas(delta_archive, tree_format::delta_magic);
+	std::error_code error;
+	if (!fs::is_directory(directory, error))
+	{
+		throw std::runtime_error("Unable to read directory '" + directory + "'!");
+	}
+	fs::create_directories(output_directory);
+	if (fs::equivalent(directory, output_directory))
+	{
+		throw std::invalid_argument("Output directory has to be different from the original directory!");
+	}
+
+	const auto& entries = deltas.entries();
+	const auto tasks = make_tasks(0, entries.size(), [&](size_t i) { return entries[i].file_size; });
+	parallel_for(tasks.size(), options.num_threads, [&](size_t task_index)
+	{
+		for (size_t i = tasks[task_index].first; i < tasks[task_index].second; ++i)
+		{
+			const auto& entry = entries[i];
+			const auto original_path = tree_path(directory, entry.path);
+			const auto output_path = tree_path(output_directory, entry.path);
+			if (entry.kind == tree_format::removed_file)
+			{
+				fs::remove(output_path);
+				continue;
+			}
+			fs::create_directories(output_path.parent_path());
+
+			// every output file is checked against the hash of the new file, an original that differs from the signed one
+			// would give a wrong file otherwise
+			if (entry.kind == tree_format::unchanged_file)
+			{
+				file_content original;
+				load_file(original_path, original);
+				if (!has_file_hash(original.data, original.size, entry))
+				{
+					throw std::runtime_error("File '" + original_path.string() + "' differs from the file the signature was made of!");
+				}
+				fs::copy_file(original_path, output_path, fs::copy_options::overwrite_existing);
+			}
+			else if (entry.kind == tree_format::changed_file)
+			{
+				// new files are patched from empty original data
+				file_content original;
+				if (fs::is_regular_file(original_path))
+				{
+					load_file(original_path, original);
+				}
+
+				memory_buffer payload(deltas.payload(entry), entry.payload_length);
+				std::istream delta_stream(&payload);
+				delta_reader reader(delta_stream);
+				mapped_file output_mapping;
+				bool hash_matches = false;
+				if (!reader.is_streamed() && output_mapping.create(output_path.string(), reader.data_length()))
+				{
+					patch<char*>(original.data, original.size, reader, output_mapping.data());
+					hash_matches = has_file_hash(output_mapping.data(), output_mapping.size(), entry);
+					// the mapping is released before the modification time is set
+					output_mapping.close();
+				}
+				else
+				{
+					std::ofstream output_file(output_path, std::ios_base::binary | std::ios_base::trunc);
+					if (!output_file.is_open())
+					{
+						throw std::runtime_error("Unable to create file '" + output_path.string() + "'!");
+					}
+					patch<std::ostreambuf_iterator<char>>(original.data, original.size, reader, std::ostreambuf_iterator<char>(output_file));
+					output_file.close();
+					file_content output;
+					load_file(output_path, output);
+					hash_matches = has_file_hash(output.data, output.size, entry);
+				}
+
+				if (!hash_matches)
+				{
+					fs::remove(output_path);
+					throw std::runtime_error("Patched file '" + output_path.string()
+						+ "' differs from the new file, original file '" + original_path.string() + "' differs from the file the signature was made of!");
+				}
+			}
+			else
+			{
+				throw std::runtime_error("Unexpected record of '" + entry.path + "' in delta archive!");
+			}
+
+			fs::last_write_time(output_path, from_nanoseconds(entry.modification_time));
+		}
+	});
+
+	tree_stats stats;
+	for (const auto& entry : entries)
+	{
+		add_to_stats(stats, entry.kind, entry.kind == tree_format::removed_file ? 0 : entry.file_size);
+	}
+
+	return stats;
+}
+
+}; // namespace rd
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "signature.hpp"
+#include "delta.hpp"
+#include "mapped_file.hpp"
+
+namespace rd
+{
+
+/// <summary>
+/// Binary format of signature and delta archives of whole directory trees. All multi-byte values are little-endian.
+///   header: magic "RDST" (signatures) or "RDDT" (deltas) (4), version (1), reserved (3)
+///   records one after another, each is the payload of one file: a signature file or a delta file
+///   index: for every record kind (1), varint path length, path, file size (8), modification time (8),
+///          whole-file hash (32), payload offset (8), payload length (8); sorted by path
+///   footer (24): index offset (8), number of index entries (8), magic (4), reserved (4)
+/// Paths are relative to the root of the tree and use '/' as the separator.
+/// Modification time is in nanoseconds of the file clock, it is only compared with times from the same machine.
+/// </summary>
+namespace tree_format
+{
+	constexpr char signature_magic[4] = { 'R', 'D', 'S', 'T' };
+	constexpr char delta_magic[4] = { 'R', 'D', 'D', 'T' };
+	constexpr uint8_t version = 1;
+	constexpr size_t header_length = 8;
+	constexpr size_t footer_length = 24;
+	constexpr size_t file_hash_length = 32;
+
+	constexpr uint8_t file_signature = 0; // payload is the signature of the file
+	constexpr uint8_t unchanged_file = 1; // file is the same as the original one, there is no payload
+	constexpr uint8_t changed_file = 2;   // payload is the delta of the file, new files have a delta of empty original data
+	constexpr uint8_t removed_file = 3;   // original file doesn't exist any more, there is no payload
+};
+
+/// <summary>
+/// Index entry of one file of a tree archive
+/// </summary>
+struct tree_entry
+{
+	uint8_t kind{ tree_format::file_signature };
+	std::string path;
+	uint64_t file_size{ 0 };
+	int64_t modification_time{ 0 };
+	uint8_t file_hash[tree_format::file_hash_length]{};
+	uint64_t payload_offset{ 0 };
+	uint64_t payload_length{ 0 };
+};
+
+/// <summary>
+/// Settings of the tree functions
+/// chunk_length: Length of chunks of the signatures
+/// cdc: Parameters of content-defined chunking, fixed length chunks are used if it is not enabled
+/// strong_hash_length: Length of the strong hash of every chunk in bytes
+/// num_threads: Number of worker threads, 0 means all hardware threads
+/// large_file_length: Files at least this long are processed one at a time by the parallel functions
+/// and their payload is written straight to the archive. Smaller files are processed in batches by the workers.
+/// literal_codec: Codec of the literal data of file deltas written by delta_tree
+/// </summary>
+struct tree_options
+{
+	size_t chunk_length{ 100 };
+	cdc_parameters cdc{};
+	size_t strong_hash_length{ default_strong_hash_length };
+	size_t num_threads{ 1 };
+	size_t large_file_length{ 16 * 1024 * 1024 };
+	codec literal_codec{ codec::none };
+};
+
+/// <summary>
+/// Counts of files processed by a tree function
+/// </summary>
+struct tree_stats
+{
+	size_t files{ 0 };           // files in the archive
+	size_t unchanged_files{ 0 }; // files found unchanged by their size and modification time or by the whole-file hash
+	size_t changed_files{ 0 };   // changed and new files
+	size_t removed_files{ 0 };
+	size_t bytes{ 0 };           // bytes of the files that had to be read
+};
+
+/// <summary>
+/// Tree archive mapped into memory (or read into memory if it can't be mapped), payloads are used in place.
+/// Throws std::runtime_error if the archive can't be read or is corrupted.
+/// </summary>
+class tree_archive
+{
+public:
+	/// <summary>
+	/// Opens archive
+	/// </summary>
+	/// <param name="file_name">Path to the archive</param>
+	/// <param name="magic">Expected magic, tree_format::signature_magic or tree_format::delta_magic</param>
+	tree_archive(const std::string& file_name, const char (&magic)[4]);
+
+	tree_archive(const tree_archive&) = delete;
+	tree_archive& operator=(const tree_archive&) = delete;
+
+	/// <summary>
+	/// Entries sorted by path
+	/// </summary>
+	const std::vector<tree_entry>& entries() const { return index; }
+
+	/// <summary>
+	/// Returns entry of the given path or nullptr if the archive doesn't have one
+	/// </summary>
+	const tree_entry* find(const std::string& path) const;
+
+	/// <summary>
+	/// Returns pointer to the payload of the entry, its length is entry.payload_length
+	/// </summary>
+	const char* payload(const tree_entry& entry) const { return data + entry.payload_offset; }
+
+private:
+	mapped_file file;
+	std::vector<char> buffer;
+	const char* data{ nullptr };
+	std::vector<tree_entry> index;
+};
+
+/// <summary>
+/// Writes tree archive, see tree_format. Payloads are written either at once or streamed,
+/// streamed payloads need a seekable stream because their length is written to the index at the end.
+/// </summary>
+class tree_archive_writer
+{
+public:
+	tree_archive_writer(std::ostream& os, const char (&magic)[4]);
+
+	/// <summary>
+	/// Adds entry with the whole payload
+	/// </summary>
+	void add(tree_entry entry, const std::string& payload);
+
+	/// <summary>
+	/// Starts entry whose payload is written to the returned stream until end_entry() is called
+	/// </summary>
+	std::ostream& begin_entry(tree_entry entry);
+	void end_entry();
+
+	/// <summary>
+	/// Writes the index and the footer. Has to be called after the last entry.
+	/// </summary>
+	void finish();
+
+private:
+	std::ostream& os;
+	const char* magic;
+	uint64_t position{ 0 };
+	std::vector<tree_entry> index;
+};
+
+/// <summary>
+/// Creates signatures of all regular files in the directory tree and writes them to a signature archive.
+/// Every entry also keeps size, modification time and hash of the whole file so that unchanged files are found cheaply.
+/// Files are processed on a pool of worker threads, small files in batches of about 1 MB per task.
+/// </summary>
+/// <param name="directory">Root of the original tree</param>
+/// <param name="archive">Output stream of the signature archive, has to be seekable</param>
+/// <param name="options">Chunking and threads</param>
+/// <returns>counts of processed files</returns>
+tree_stats signature_tree(const std::string& directory, std::ostream& archive, const tree_options& options);
+
+/// <summary>
+/// Creates deltas of all regular files in the directory tree against a signature archive and writes them to a delta archive.
+/// Files with the same size and modification time as in the signature archive are not read, files with the same size
+/// and the same whole-file hash are not diffed; both get an unchanged record without payload.
+/// Files missing in the tree get a removed record and new files get a delta of empty original data.
+/// </summary>
+/// <param name="signature_archive">Path to the signature archive of the original tree</param>
+/// <param name="directory">Root of the modified tree</param>
+/// <param name="archive">Output stream of the delta archive, has to be seekable</param>
+/// <param name="options">Threads, chunking is taken from the signatures</param>
+/// <returns>counts of processed files</returns>
+tree_stats delta_tree(const std::string& signature_archive, const std::string& directory, std::ostream& archive, const tree_options& options);
+
+/// <summary>
+/// Applies delta archive to the original tree and writes the modified tree to the output directory.
+/// Unchanged files are copied, removed files are left out and modification times are set to the times of the modified files.
+/// </summary>
+/// <param name="directory">Root of the original tree</param>
+/// <param name="delta_archive">Path to the delta archive</param>
+/// <param name="output_directory">Root of the patched tree, it is created if it doesn't exist</param>
+/// <param name="options">Threads</param>
+/// <returns>counts of processed files</returns>
+tree_stats patch_tree(const std::string& directory, const std::string& delta_archive, const std::string& output_directory, const tree_options& options);
+
+}; // namespace rd
@@ -0,0 +1,103 @@
+#include "zeros.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if RD_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace rd
+{
+
+namespace
+{
+	const char zeros[impl::zero_block_length] = {};
+
+	size_t zero_run_length_scalar(const char* data, size_t data_length)
+	{
+		// words are loaded with memcpy because the data doesn't have to be aligned
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= data_length; i += sizeof(uint64_t))
+		{
+			uint64_t word = 0;
+			std::memcpy(&word, data + i, sizeof(word));
+			if (word != 0)
+			{
+				break;
+			}
+		}
+
+		while (i < data_length && data[i] == 0)
+		{
+			++i;
+		}
+
+		return i;
+	}
+
+#if RD_X86_SIMD
+	RD_TARGET_SSSE3 size_t zero_run_length_ssse3(const char* data, size_t data_length)
+	{
+		// four vectors are or-ed together so that the loop has a single branch for 64 bytes
+		constexpr size_t block_length = 4 * sizeof(__m128i);
+		size_t i = 0;
+		for (; i + block_length <= data_length; i += block_length)
+		{
+			const auto vectors = reinterpret_cast<const __m128i*>(data + i);
+			const __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(vectors), _mm_loadu_si128(vectors + 1)),
+				_mm_or_si128(_mm_loadu_si128(vectors + 2), _mm_loadu_si128(vectors + 3)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xffff)
+			{
+				break;
+			}
+		}
+
+		return i + zero_run_length_scalar(data + i, data_length - i);
+	}
+
+	RD_TARGET_AVX2 size_t zero_run_length_avx2(const char* data, size_t data_length)
+	{
+		constexpr size_t block_length = 4 * sizeof(__m256i);
+		size_t i = 0;
+		for (; i + block_length <= data_length; i += block_length)
+		{
+			const auto vectors = reinterpret_cast<const __m256i*>(data + i);
+			const __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(vectors), _mm256_loadu_si256(vectors + 1)),
+				_mm256_or_si256(_mm256_loadu_si256(vectors + 2), _mm256_loadu_si256(vectors + 3)));
+			if (!_mm256_testz_si256(any, any))
+			{
+				break;
+			}
+		}
+
+		return i + zero_run_length_scalar(data + i, data_length - i);
+	}
+#endif
+} // namespace
+
+namespace impl
+{
+	const char* zero_block()
+	{
+		return zeros;
+	}
+
+	size_t zero_run_length_at_level(const char* data, size_t data_length, simd_level level)
+	{
+		switch (level)
+		{
+#if RD_X86_SIMD
+		case simd_level::avx512:
+		case simd_level::avx2:
+			return zero_run_length_avx2(data, data_length);
+		case simd_level::ssse3:
+			return zero_run_length_ssse3(data, data_length);
+#endif
+		default:
+			return zero_run_length_scalar(data, data_length);
+		}
+	}
+} // namespace impl
+
+}; // namespace rd
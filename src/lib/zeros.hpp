@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+
+#include "cpu_features.hpp"
+
+namespace rd
+{
+
+/// <summary>
+/// Helper functions used internally for runs of zero bytes
+/// </summary>
+namespace impl
+{
+	/// <summary>
+	/// Length of the data returned by zero_block()
+	/// </summary>
+	constexpr size_t zero_block_length = 64 * 1024;
+
+	/// <summary>
+	/// Returns zero_block_length zero bytes, used as the data of zero runs that have to be written out
+	/// </summary>
+	const char* zero_block();
+
+	/// <summary>
+	/// Length of the run of zero bytes at the beginning of the data found by the kernel of the given level, all levels give the same result.
+	/// </summary>
+	/// <param name="level">Level of the kernel, it can't be higher than supported_simd_level()</param>
+	size_t zero_run_length_at_level(const char* data, size_t data_length, simd_level level);
+} // namespace impl
+
+/// <summary>
+/// Returns the number of zero bytes at the beginning of the data.
+/// Sparse files and disk images have long runs of zeros, so whole vectors are checked at once
+/// and only the block with the first non-zero byte is searched byte by byte.
+/// </summary>
+/// <param name="data">Pointer to the beginning of the data</param>
+/// <param name="data_length">Length of the data</param>
+inline size_t zero_run_length(const char* data, size_t data_length)
+{
+	return impl::zero_run_length_at_level(data, data_length, impl::supported_simd_level());
+}
+
+/// <summary>
+/// Returns true if all bytes of the data are zero
+/// </summary>
+inline bool is_zero(const char* data, size_t data_length)
+{
+	return zero_run_length(data, data_length) == data_length;
+}
+
+}; // namespace rd
@@ -2,6 +2,12 @@
 
 #include "tst_hash.h"
 #include "tst_hash_roll.h"
+#include "tst_mapped_file.h"
+#include "tst_parallel.h"
+#include "tst_delta_stream.h"
+#include "tst_cdc.h"
+#include "tst_progress.h"
+#include "tst_tree.h"
 
 int main(int argc, char *argv[])
 {
@@ -1,6 +1,8 @@
 ﻿
 #pragma once
 
+#include <cstdint>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -8,6 +10,21 @@
 #include "hash.hpp"
 #include "signature.hpp"
 
+/// <summary>
+/// Returns random bytes of the given length, the same bytes for the same seed
+/// </summary>
+template <typename Container = std::vector<char>>
+Container make_random_data(size_t length, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	Container result(length, '\0');
+	for (auto& byte : result)
+	{
+		byte = static_cast<char>(generator() & 0xff);
+	}
+
+	return result;
+}
 
 struct test_data_small
 {
@@ -0,0 +1,176 @@
+﻿#include <gtest/gtest.h>
+
+#include "cdc.hpp"
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "test_data.h"
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <iterator>
+#include <fstream>
+
+TEST(test_cdc, chunk_lengths)
+{
+	const rd::cdc_parameters cdc{ 64, 256, 1024 };
+	const auto data = make_random_data(1 << 20, 1);
+	rd::cdc_chunker chunker(cdc);
+
+	size_t num_chunks = 0;
+	size_t chunk_begin = 0;
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		// both ways of finding boundaries give the same chunks
+		if (chunker.update(data[i]) || i + 1 == data.size())
+		{
+			const size_t length = i + 1 - chunk_begin;
+			EXPECT_EQ(chunker.next_chunk_length(data.data() + chunk_begin, data.size() - chunk_begin), length);
+			if (i + 1 < data.size())
+			{
+				EXPECT_GE(length, cdc.min_length);
+				EXPECT_LE(length, cdc.max_length);
+			}
+			chunk_begin = i + 1;
+			++num_chunks;
+		}
+	}
+
+	// average length is close to the requested one
+	const size_t average_length = data.size() / num_chunks;
+	EXPECT_GT(average_length, cdc.average_length / 2);
+	EXPECT_LT(average_length, cdc.average_length * 2);
+
+	EXPECT_THROW(rd::cdc_chunker(rd::cdc_parameters{ 0, 256, 1024 }), std::invalid_argument);
+	EXPECT_THROW(rd::cdc_chunker(rd::cdc_parameters{ 64, 2048, 1024 }), std::invalid_argument);
+}
+
+TEST(test_cdc, signature)
+{
+	const rd::cdc_parameters cdc{ 64, 256, 1024 };
+	const auto data = make_random_data(1 << 20, 2);
+
+	const auto sig = rd::calculate_signature_cdc<const char*>(data.data(), data.size(), cdc);
+	EXPECT_EQ(sig.cdc, cdc);
+	size_t position = 0;
+	for (const auto& ch : sig.chunks)
+	{
+		EXPECT_EQ(ch.start_position, position);
+		position += ch.length;
+	}
+	EXPECT_EQ(position, data.size());
+
+	// stream iterators and multiple threads give the same signature
+	std::string data_string(data.cbegin(), data.cend());
+	std::istringstream data_stream(data_string);
+	EXPECT_EQ(rd::calculate_signature_cdc<std::istreambuf_iterator<char>>(std::istreambuf_iterator<char>(data_stream), data.size(), cdc), sig);
+	EXPECT_EQ(rd::calculate_signature_cdc_parallel(data.data(), data.size(), cdc, rd::default_strong_hash_length, 3), sig);
+
+	// inserted data changes only chunks around the insertion
+	auto modified = data;
+	modified.insert(modified.begin() + modified.size() / 2, 100, 'x');
+	const auto modified_sig = rd::calculate_signature_cdc<const char*>(modified.data(), modified.size(), cdc);
+	size_t num_same = 0;
+	for (size_t i = 0, j = 0; i < sig.chunks.size() && j < modified_sig.chunks.size();)
+	{
+		const auto end = sig.chunks[i].start_position + sig.chunks[i].length;
+		const auto modified_end = modified_sig.chunks[j].start_position + modified_sig.chunks[j].length;
+		num_same += sig.chunks[i].checksum == modified_sig.chunks[j].checksum;
+		if (end + (end > data.size() / 2 ? 100 : 0) <= modified_end)
+		{
+			++i;
+		}
+		else
+		{
+			++j;
+		}
+	}
+	EXPECT_GT(num_same + 5, sig.chunks.size());
+
+	// signature is written and read with chunk positions
+	std::ostringstream signature_stream;
+	rd::signature::write_to_binary_file(signature_stream, sig);
+	std::istringstream signature_input(signature_stream.str());
+	rd::signature read_signature;
+	rd::signature::read_from_binary_file(signature_input, read_signature);
+	EXPECT_EQ(read_signature, sig);
+
+	const std::string signature_file_name = "data/signature_cdc.bin";
+	{
+		std::ofstream signature_file(signature_file_name, std::ios_base::binary);
+		rd::signature::write_to_binary_file(signature_file, sig);
+	}
+	rd::mapped_signature mapped;
+	ASSERT_TRUE(mapped.open(signature_file_name));
+	ASSERT_EQ(mapped.view().size(), sig.chunks.size());
+	EXPECT_EQ(mapped.view().cdc(), cdc);
+	for (size_t i = 0; i < sig.chunks.size(); ++i)
+	{
+		EXPECT_EQ(mapped.view().start_position(i), sig.chunks[i].start_position);
+		EXPECT_EQ(mapped.view().length(i), sig.chunks[i].length);
+		EXPECT_EQ(mapped.view().checksum(i), sig.chunks[i].checksum);
+	}
+}
+
+TEST(test_cdc, delta)
+{
+	const rd::cdc_parameters cdc{ 64, 256, 1024 };
+	const auto old_data = make_random_data(1 << 20, 3);
+
+	// a few bytes inserted every 64 KB
+	std::vector<char> new_data;
+	for (size_t i = 0; i < old_data.size(); ++i)
+	{
+		if (i % (64 * 1024) == 1000)
+		{
+			new_data.insert(new_data.end(), { 'a', 'b', 'c' });
+		}
+		new_data.push_back(old_data[i]);
+	}
+
+	const auto sig = rd::calculate_signature_cdc<const char*>(old_data.data(), old_data.size(), cdc);
+	const auto del = rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size());
+	std::vector<char> patched(del.data_length);
+	rd::patch<char*>(old_data.data(), del, patched.data());
+	EXPECT_EQ(patched, new_data);
+
+	// only chunks around the insertions are copied as data
+	size_t data_bytes = 0;
+	for (const auto& instruction : del.instructions)
+	{
+		data_bytes += instruction.command == rd::delta::opcode::copy_data ? instruction.data_length : 0;
+	}
+	EXPECT_LT(data_bytes, 16 * 4 * cdc.max_length);
+
+	// chunks of different lengths copied one after another are joined in the binary delta, it is about as small as its data
+	std::stringstream delta_file;
+	rd::delta::write_to_binary_file(delta_file, del);
+	EXPECT_LT(delta_file.str().size(), data_bytes + 1000);
+	rd::delta read_delta;
+	rd::delta::read_from_binary_file(delta_file, read_delta);
+	EXPECT_LT(read_delta.instructions.size(), 100u);
+	std::vector<char> read_patched(read_delta.data_length);
+	rd::patch<char*>(old_data.data(), read_delta, read_patched.data());
+	EXPECT_EQ(read_patched, new_data);
+
+	// stream input gives the same delta
+	std::string new_string(new_data.cbegin(), new_data.cend());
+	std::istringstream new_stream(new_string);
+	const auto stream_delta = rd::calculate_delta<std::istreambuf_iterator<char>>(sig, std::istreambuf_iterator<char>(new_stream), new_data.size());
+	ASSERT_EQ(stream_delta.instructions.size(), del.instructions.size());
+	for (size_t i = 0; i < del.instructions.size(); ++i)
+	{
+		EXPECT_EQ(stream_delta.instructions[i].command, del.instructions[i].command);
+		EXPECT_EQ(stream_delta.instructions[i].data_length, del.instructions[i].data_length);
+	}
+
+	// segments of the parallel delta are stitched to the same data
+	for (size_t segment_length : { 5000, 100000 })
+	{
+		const auto parallel_delta = rd::calculate_delta_parallel(sig, new_data.data(), new_data.size(), 3, segment_length);
+		std::vector<char> parallel_patched(parallel_delta.data_length);
+		rd::patch<char*>(old_data.data(), parallel_delta, parallel_patched.data());
+		EXPECT_EQ(parallel_patched, new_data);
+	}
+}
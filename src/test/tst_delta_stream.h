@@ -0,0 +1,723 @@
+﻿#include <gtest/gtest.h>
+
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "compression.hpp"
+#include "local_delta.hpp"
+#include "test_data.h"
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <iterator>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <utility>
+
+TEST(test_delta_stream, writer_matches_binary_file)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100);
+	const auto del = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size());
+	std::ostringstream expected;
+	rd::delta::write_to_binary_file(expected, del);
+
+	// delta written while it is calculated is the same as the delta calculated first and written later
+	std::ostringstream streamed;
+	rd::delta_writer writer(streamed);
+	rd::calculate_delta<char*>(sig, new_array.data(), new_array.size(), writer);
+	writer.finish();
+	EXPECT_EQ(streamed.str(), expected.str());
+
+	// stream iterators work with the writer as well
+	std::ostringstream streamed_from_file;
+	rd::delta_writer file_writer(streamed_from_file);
+	new_file.clear();
+	new_file.seekg(0, new_file.beg);
+	rd::calculate_delta<std::istreambuf_iterator<char>>(sig, std::istreambuf_iterator<char>(new_file), new_array.size(), file_writer);
+	file_writer.finish();
+	EXPECT_EQ(streamed_from_file.str(), expected.str());
+
+	// written delta can be read back and applied
+	std::istringstream delta_stream(streamed.str());
+	rd::delta read_delta;
+	rd::delta::read_from_binary_file(delta_stream, read_delta);
+	EXPECT_EQ(read_delta.data_length, new_array.size());
+	std::vector<char> patched(read_delta.data_length);
+	rd::patch<char*>(old_array.data(), read_delta, patched.data());
+	EXPECT_EQ(patched, new_array);
+}
+
+TEST(test_delta_stream, parallel_writer)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100);
+	const auto del = rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), 3, 10000);
+	std::ostringstream expected;
+	rd::delta::write_to_binary_file(expected, del);
+
+	std::ostringstream streamed;
+	rd::delta_writer writer(streamed);
+	rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), writer, 3, 10000);
+	writer.finish();
+	EXPECT_EQ(streamed.str(), expected.str());
+}
+
+TEST(test_delta_stream, streaming_patch)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100);
+	const auto del = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size());
+	std::ostringstream delta_stream;
+	rd::delta::write_to_binary_file(delta_stream, del);
+
+	// patch from the original in memory
+	std::istringstream delta_input(delta_stream.str());
+	rd::delta_reader reader(delta_input);
+	EXPECT_EQ(reader.data_length(), new_array.size());
+	EXPECT_EQ(reader.num_instructions(), del.instructions.size());
+	std::vector<char> patched(reader.data_length());
+	rd::patch<char*>(old_array.data(), old_array.size(), reader, patched.data());
+	EXPECT_EQ(patched, new_array);
+
+	// patch from the original file
+	std::istringstream delta_input_for_file(delta_stream.str());
+	rd::delta_reader file_reader(delta_input_for_file);
+	std::vector<char> patched_from_file;
+	rd::patch(old_file, file_reader, std::back_inserter(patched_from_file));
+	EXPECT_EQ(patched_from_file, new_array);
+
+	// original that is too short doesn't match the delta
+	std::istringstream delta_input_short(delta_stream.str());
+	rd::delta_reader short_reader(delta_input_short);
+	std::vector<char> patched_short(short_reader.data_length());
+	EXPECT_THROW(rd::patch<char*>(old_array.data(), old_array.size() / 2, short_reader, patched_short.data()), std::runtime_error);
+
+	// truncated delta is detected
+	const auto truncated = delta_stream.str().substr(0, delta_stream.str().size() / 2);
+	std::istringstream delta_input_truncated(truncated);
+	rd::delta_reader truncated_reader(delta_input_truncated);
+	std::vector<char> patched_truncated(truncated_reader.data_length());
+	EXPECT_THROW(rd::patch<char*>(old_array.data(), old_array.size(), truncated_reader, patched_truncated.data()), std::runtime_error);
+}
+
+/// <summary>
+/// Writes delta in the format used before the versioned one: header and every field are raw 8 byte values.
+/// The format has no ZERO_FILL, runs of zeros are written as COPY_DATA.
+/// </summary>
+static std::string write_legacy_delta(const rd::delta& del)
+{
+	std::string result;
+	auto write_value = [&result](size_t value) { result.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+	write_value(del.data_length);
+	write_value(del.instructions.size());
+	for (const auto& instruction : del.instructions)
+	{
+		result.push_back(instruction.command == rd::delta::opcode::copy_chunk ? 1 : 0);
+		write_value(instruction.start_index);
+		write_value(instruction.chunk_id);
+		write_value(instruction.data_length);
+		if (instruction.command == rd::delta::opcode::copy_data)
+		{
+			result.append(del.data(instruction), instruction.data_length);
+		}
+		else if (instruction.command == rd::delta::opcode::zero_fill)
+		{
+			result.append(instruction.data_length, '\0');
+		}
+	}
+
+	return result;
+}
+
+/// <summary>
+/// Copy of the delta with copies that continue one another joined into one, binary deltas join copies of different lengths
+/// </summary>
+static rd::delta join_copies(const rd::delta& del)
+{
+	rd::delta result = del;
+	result.instructions.clear();
+	for (const auto& instruction : del.instructions)
+	{
+		if (instruction.command == rd::delta::opcode::copy_chunk && !result.instructions.empty()
+			&& result.instructions.back().command == rd::delta::opcode::copy_chunk
+			&& result.instructions.back().start_index + result.instructions.back().data_length == instruction.start_index)
+		{
+			result.instructions.back().data_length += instruction.data_length;
+		}
+		else
+		{
+			result.instructions.push_back(instruction);
+		}
+	}
+
+	return result;
+}
+
+static void expect_same_instructions(const rd::delta& expected, const rd::delta& actual)
+{
+	EXPECT_EQ(actual.data_length, expected.data_length);
+	ASSERT_EQ(actual.instructions.size(), expected.instructions.size());
+	for (size_t i = 0; i < expected.instructions.size(); ++i)
+	{
+		EXPECT_EQ(actual.instructions[i].command, expected.instructions[i].command);
+		EXPECT_EQ(actual.instructions[i].start_index, expected.instructions[i].start_index);
+		EXPECT_EQ(actual.instructions[i].data_length, expected.instructions[i].data_length);
+		if (expected.instructions[i].command == rd::delta::opcode::copy_data)
+		{
+			EXPECT_EQ(std::string(actual.data(actual.instructions[i]), actual.instructions[i].data_length),
+				std::string(expected.data(expected.instructions[i]), expected.instructions[i].data_length));
+		}
+		else
+		{
+			EXPECT_EQ(actual.instructions[i].chunk_id, expected.instructions[i].chunk_id);
+		}
+	}
+}
+
+TEST(test_delta_stream, compact_format)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	for (size_t chunk_size : { 16, 100, 1000 })
+	{
+		const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), chunk_size);
+		for (const auto& del : { rd::calculate_delta<char*>(sig, new_array.data(), new_array.size()),
+			rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), 3, 10000) })
+		{
+			std::ostringstream compact;
+			rd::delta::write_to_binary_file(compact, del);
+			const auto legacy = write_legacy_delta(del);
+
+			// instruction overhead is a fraction of the legacy one
+			size_t literal_length = 0;
+			for (const auto& instruction : del.instructions)
+			{
+				literal_length += instruction.command == rd::delta::opcode::copy_data ? instruction.data_length : 0;
+			}
+			EXPECT_LT((compact.str().size() - literal_length) * 4, legacy.size() - literal_length);
+
+			// both formats are read to the same instructions
+			std::istringstream compact_input(compact.str());
+			rd::delta compact_delta;
+			rd::delta::read_from_binary_file(compact_input, compact_delta);
+			expect_same_instructions(del, compact_delta);
+
+			std::istringstream legacy_input(legacy);
+			rd::delta_reader legacy_reader(legacy_input);
+			EXPECT_TRUE(legacy_reader.is_legacy());
+			legacy_input.seekg(0);
+			rd::delta legacy_delta;
+			rd::delta::read_from_binary_file(legacy_input, legacy_delta);
+			std::vector<char> patched(legacy_delta.data_length);
+			rd::patch<char*>(old_array.data(), legacy_delta, patched.data());
+			EXPECT_EQ(patched, new_array);
+		}
+	}
+
+	// unknown version is rejected
+	std::ostringstream compact;
+	rd::delta::write_to_binary_file(compact, rd::delta{});
+	auto unknown_version = compact.str();
+	unknown_version[sizeof(rd::delta_format::magic)] = 100;
+	std::istringstream unknown_version_input(unknown_version);
+	EXPECT_THROW(rd::delta_reader reader(unknown_version_input), std::runtime_error);
+}
+
+/// <summary>
+/// Stream buffer like a pipe: it can't seek and reads return only a few bytes at a time
+/// </summary>
+class pipe_buffer : public std::streambuf
+{
+public:
+	explicit pipe_buffer(std::string data = {})
+		: data(std::move(data))
+	{
+	}
+
+	const std::string& written() const { return output; }
+
+protected:
+	int_type underflow() override
+	{
+		if (position == data.size())
+		{
+			return traits_type::eof();
+		}
+		const size_t length = std::min<size_t>(4099, data.size() - position);
+		setg(&data[position], &data[position], &data[position] + length);
+		position += length;
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int_type overflow(int_type c) override
+	{
+		if (!traits_type::eq_int_type(c, traits_type::eof()))
+		{
+			output.push_back(traits_type::to_char_type(c));
+		}
+		return traits_type::not_eof(c);
+	}
+
+	std::streamsize xsputn(const char* s, std::streamsize count) override
+	{
+		output.append(s, static_cast<size_t>(count));
+		return count;
+	}
+
+private:
+	std::string data;
+	size_t position{ 0 };
+	std::string output;
+};
+
+static std::string signature_bytes(const rd::signature& sig)
+{
+	std::ostringstream os;
+	rd::signature::write_to_binary_file(os, sig);
+	return os.str();
+}
+
+TEST(test_delta_stream, signature_from_stream)
+{
+	const auto data = make_random_data<std::string>(3 * 1024 * 1024 + 77, 18);
+
+	rd::cdc_parameters cdc;
+	cdc.min_length = 256;
+	cdc.average_length = 1024;
+	cdc.max_length = 4096;
+	for (const size_t length : { size_t{ 0 }, size_t{ 1 }, size_t{ 1000 }, size_t{ 1024 * 1024 }, data.size() })
+	{
+		SCOPED_TRACE(length);
+		const auto expected = rd::calculate_signature<const char*>(data.data(), length, 1000);
+		pipe_buffer input(data.substr(0, length));
+		std::istream input_stream(&input);
+		EXPECT_EQ(signature_bytes(rd::calculate_signature_stream(input_stream, 1000)), signature_bytes(expected));
+
+		const auto expected_cdc = rd::calculate_signature_cdc<const char*>(data.data(), length, cdc);
+		pipe_buffer cdc_input(data.substr(0, length));
+		std::istream cdc_input_stream(&cdc_input);
+		EXPECT_EQ(signature_bytes(rd::calculate_signature_cdc_stream(cdc_input_stream, cdc)), signature_bytes(expected_cdc));
+	}
+}
+
+TEST(test_delta_stream, delta_from_stream_through_pipe)
+{
+	const auto old_data = make_random_data<std::string>(3 * 1024 * 1024 + 5, 19);
+	auto new_data = old_data;
+	new_data.insert(1000, "inserted data");
+	new_data.erase(2 * 1024 * 1024, 333);
+	new_data.replace(2500000, 10, "0123456789");
+	new_data.append("appended data");
+
+	rd::cdc_parameters cdc;
+	cdc.min_length = 256;
+	cdc.average_length = 1024;
+	cdc.max_length = 4096;
+	const auto fixed_signature = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 700);
+	const auto cdc_signature = rd::calculate_signature_cdc<const char*>(old_data.data(), old_data.size(), cdc);
+	for (const auto* sig : { &fixed_signature, &cdc_signature })
+	{
+		// delta of the stream has the same instructions as the delta of the data in memory
+		const auto expected = rd::calculate_delta<const char*>(*sig, new_data.data(), new_data.size());
+		rd::delta streamed_delta;
+		rd::delta_builder builder(streamed_delta);
+		pipe_buffer new_input(new_data);
+		std::istream new_stream(&new_input);
+		const auto stats = rd::calculate_delta_stream(*sig, new_stream, builder);
+		EXPECT_EQ(stats.bytes_scanned, new_data.size());
+		expect_same_instructions(expected, streamed_delta);
+
+		// writer can't seek back in a pipe so the lengths are written at the end
+		pipe_buffer output;
+		std::ostream output_stream(&output);
+		rd::delta_writer writer(output_stream);
+		pipe_buffer writer_input(new_data);
+		std::istream writer_stream(&writer_input);
+		rd::calculate_delta_stream(*sig, writer_stream, writer);
+		writer.finish();
+
+		pipe_buffer delta_input(output.written());
+		std::istream delta_stream(&delta_input);
+		rd::delta_reader reader(delta_stream);
+		EXPECT_TRUE(reader.is_streamed());
+		EXPECT_EQ(reader.data_length(), rd::delta_format::unknown_length);
+		std::string patched;
+		rd::patch<std::back_insert_iterator<std::string>>(old_data.data(), old_data.size(), reader, std::back_inserter(patched));
+		EXPECT_EQ(patched, new_data);
+		EXPECT_FALSE(reader.is_streamed());
+		EXPECT_EQ(reader.data_length(), new_data.size());
+		EXPECT_EQ(reader.num_instructions(), rd::delta_writer::num_written_instructions(expected));
+
+		// a streamed delta is read as a whole as well
+		std::istringstream whole_input(output.written());
+		rd::delta read_delta;
+		rd::delta::read_from_binary_file(whole_input, read_delta);
+		EXPECT_EQ(read_delta.instructions.size(), rd::delta_writer::num_written_instructions(expected));
+		expect_same_instructions(join_copies(expected), join_copies(read_delta));
+
+		// truncated streamed delta is detected
+		std::istringstream truncated_input(output.written().substr(0, output.written().size() - 4));
+		rd::delta_reader truncated_reader(truncated_input);
+		std::string truncated_patched;
+		EXPECT_THROW(rd::patch<std::back_insert_iterator<std::string>>(old_data.data(), old_data.size(), truncated_reader,
+			std::back_inserter(truncated_patched)), std::runtime_error);
+	}
+}
+
+TEST(test_delta_stream, zero_runs)
+{
+	auto old_data = make_random_data<std::string>(2 * 1024 * 1024, 22);
+	std::fill(old_data.begin() + 500000, old_data.begin() + 800000, '\0');
+
+	// zeros kept where the original has them, a new run of zeros, zeros appended at the end
+	auto new_data = old_data;
+	new_data.insert(100000, "inserted data");
+	std::fill(new_data.begin() + 1200000, new_data.begin() + 1500000, '\0');
+	new_data.append(100000, '\0');
+
+	// chunks of zeros get the same hashes as any other chunk
+	const auto fixed_signature = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 700);
+	const std::string zero_chunk(700, '\0');
+	const auto& zero_chunk_hashes = fixed_signature.chunks[600000 / 700];
+	EXPECT_EQ(zero_chunk_hashes.checksum, rd::compute_checksum(zero_chunk.data(), zero_chunk.size()));
+	EXPECT_EQ(zero_chunk_hashes.hash, rd::compute_hash(zero_chunk.data(), zero_chunk.size()));
+
+	rd::cdc_parameters cdc;
+	cdc.min_length = 256;
+	cdc.average_length = 1024;
+	cdc.max_length = 4096;
+	const auto cdc_signature = rd::calculate_signature_cdc<const char*>(old_data.data(), old_data.size(), cdc);
+	for (const auto* sig : { &fixed_signature, &cdc_signature })
+	{
+		// runs of zeros don't become literal data
+		rd::delta del;
+		rd::delta_builder builder(del);
+		const auto stats = rd::calculate_delta<const char*>(*sig, new_data.data(), new_data.size(), builder);
+		EXPECT_GE(stats.zero_bytes, 300000u + 300000u + 100000u - 3 * cdc.max_length);
+		EXPECT_LT(stats.literal_bytes, 6 * cdc.max_length);
+		EXPECT_TRUE(std::any_of(del.instructions.cbegin(), del.instructions.cend(),
+			[](const rd::delta::instruction& instruction) { return instruction.command == rd::delta::opcode::zero_fill; }));
+
+		// streams find the same runs
+		rd::delta streamed_delta;
+		rd::delta_builder streamed_builder(streamed_delta);
+		pipe_buffer new_input(new_data);
+		std::istream new_stream(&new_input);
+		rd::calculate_delta_stream(*sig, new_stream, streamed_builder);
+		expect_same_instructions(del, streamed_delta);
+
+		// runs have no data in the binary delta
+		std::stringstream delta_stream;
+		rd::delta::write_to_binary_file(delta_stream, del);
+		EXPECT_LT(delta_stream.str().size(), stats.literal_bytes + 10000);
+		rd::delta read_delta;
+		rd::delta::read_from_binary_file(delta_stream, read_delta);
+		expect_same_instructions(join_copies(del), join_copies(read_delta));
+
+		// zeros are written over output that isn't zero
+		std::vector<char> patched(new_data.size(), 'x');
+		delta_stream.clear();
+		delta_stream.seekg(0);
+		rd::delta_reader reader(delta_stream);
+		rd::patch<char*>(old_data.data(), old_data.size(), reader, patched.data());
+		EXPECT_TRUE(std::equal(patched.cbegin(), patched.cend(), new_data.cbegin(), new_data.cend()));
+
+		std::string patched_in_batches;
+		rd::impl::delta_instruction_source source(del);
+		rd::impl::progress_tracker tracker;
+		auto read_at = [&old_data](size_t position, char* data, size_t length) { std::copy_n(old_data.data() + position, length, data); };
+		rd::impl::patch_in_batches(source, read_at, 100000, std::back_inserter(patched_in_batches), tracker);
+		EXPECT_EQ(patched_in_batches, new_data);
+
+		// segments that start inside a run of zeros are stitched together
+		const auto parallel_delta = rd::calculate_delta_parallel(*sig, new_data.data(), new_data.size(), 3, 100000);
+		std::vector<char> patched_parallel(parallel_delta.data_length);
+		rd::patch<char*>(old_data.data(), parallel_delta, patched_parallel.data());
+		EXPECT_TRUE(std::equal(patched_parallel.cbegin(), patched_parallel.cend(), new_data.cbegin(), new_data.cend()));
+	}
+}
+
+TEST(test_delta_stream, literal_codecs)
+{
+	const auto random_data = make_random_data<std::string>(200000, 23);
+	std::mt19937 generator(23);
+	std::string text;
+	while (text.size() < 300000)
+	{
+		text += "line " + std::to_string(generator() % 1000) + ": value=" + std::to_string(generator() % 50) + "\n";
+	}
+
+	// short blocks, matches overlapping their own output with every period, data that doesn't compress
+	std::vector<std::string> blocks{ "", "a", std::string(11, 'b'), std::string(12, 'c'), "0123456789abcdefghij", text, random_data };
+	for (const size_t period : { 1, 2, 3, 7, 8, 9, 20, 100 })
+	{
+		std::string repeated;
+		while (repeated.size() < 100000 + period)
+		{
+			repeated += random_data.substr(0, period);
+		}
+		blocks.push_back(repeated);
+	}
+
+	for (const auto literal_codec : { rd::codec::lz, rd::codec::zstd })
+	{
+		if (!rd::is_codec_available(literal_codec))
+		{
+			EXPECT_THROW(rd::delta_writer writer(std::cout, literal_codec), std::invalid_argument);
+			continue;
+		}
+
+		for (const auto& block : blocks)
+		{
+			SCOPED_TRACE(block.size());
+			std::vector<char> compressed;
+			const bool is_compressed = rd::compress_block(literal_codec, block.data(), block.size(), compressed);
+			EXPECT_EQ(is_compressed, compressed.size() < block.size());
+			std::string decompressed(block.size(), '\0');
+			rd::decompress_block(literal_codec, compressed.data(), compressed.size(), &decompressed[0], decompressed.size());
+			EXPECT_EQ(decompressed, block);
+		}
+
+		std::vector<char> compressed;
+		EXPECT_TRUE(rd::compress_block(literal_codec, text.data(), text.size(), compressed));
+		EXPECT_LT(compressed.size(), text.size() / 2);
+		EXPECT_FALSE(rd::compress_block(literal_codec, random_data.data(), random_data.size(), compressed));
+
+		// corrupted blocks are rejected without reading or writing outside of the buffers
+		std::string decompressed(text.size(), '\0');
+		EXPECT_THROW(rd::decompress_block(literal_codec, compressed.data(), compressed.size() / 2, &decompressed[0], decompressed.size()),
+			std::runtime_error);
+		EXPECT_THROW(rd::decompress_block(literal_codec, compressed.data(), compressed.size(), &decompressed[0], decompressed.size() - 1),
+			std::runtime_error);
+		rd::compress_block(literal_codec, text.data(), text.size(), compressed);
+		for (size_t i = 0; i < 1000; ++i)
+		{
+			auto corrupted = compressed;
+			corrupted[generator() % corrupted.size()] = static_cast<char>(generator());
+			try
+			{
+				rd::decompress_block(literal_codec, corrupted.data(), corrupted.size(), &decompressed[0], decompressed.size());
+			}
+			catch (const std::runtime_error&)
+			{
+			}
+		}
+	}
+}
+
+TEST(test_delta_stream, compressed_delta)
+{
+	std::mt19937 generator(24);
+	std::string old_data;
+	while (old_data.size() < 2 * 1024 * 1024)
+	{
+		old_data += "record " + std::to_string(generator() % 100000) + " state=" + std::to_string(generator() % 7) + "\n";
+	}
+
+	// small literals and a literal longer than several literal blocks
+	std::string new_data = "inserted at the beginning\n" + old_data;
+	for (size_t i = 1; i < 100; ++i)
+	{
+		new_data.replace(i * 10000, 20, "changed=" + std::to_string(i));
+	}
+	std::string long_literal;
+	while (long_literal.size() < 3 * rd::delta_format::literal_block_length + 1000)
+	{
+		long_literal += "new record " + std::to_string(generator() % 100000) + "\n";
+	}
+	new_data.insert(1500000, long_literal);
+
+	const auto sig = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 700);
+	const auto del = rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size());
+
+	std::ostringstream raw;
+	rd::delta::write_to_binary_file(raw, del);
+	std::ostringstream compressed;
+	rd::delta::write_to_binary_file(compressed, del, rd::codec::lz);
+	EXPECT_LT(compressed.str().size(), raw.str().size() / 2);
+	EXPECT_EQ(static_cast<uint8_t>(compressed.str()[sizeof(rd::delta_format::magic)]), rd::delta_format::compressed_version);
+
+	std::istringstream compressed_input(compressed.str());
+	rd::delta read_delta;
+	rd::delta::read_from_binary_file(compressed_input, read_delta);
+	expect_same_instructions(del, read_delta);
+
+	// streamed delta written while it is calculated, patched while it is read in small pieces
+	pipe_buffer output;
+	std::ostream output_stream(&output);
+	rd::delta_writer writer(output_stream, rd::codec::lz);
+	rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size(), writer);
+	writer.finish();
+	pipe_buffer delta_input(output.written());
+	std::istream delta_stream(&delta_input);
+	rd::delta_reader reader(delta_stream);
+	std::string patched;
+	rd::patch<std::back_insert_iterator<std::string>>(old_data.data(), old_data.size(), reader, std::back_inserter(patched));
+	EXPECT_EQ(patched, new_data);
+
+	// data that isn't read is skipped in the literal blocks
+	std::istringstream skipped_input(compressed.str());
+	rd::delta_reader skipping_reader(skipped_input);
+	rd::delta::instruction instruction;
+	size_t num_instructions = 0;
+	char first_byte = 0;
+	while (skipping_reader.next(instruction))
+	{
+		if (instruction.command == rd::delta::opcode::copy_data && num_instructions % 2 == 0)
+		{
+			EXPECT_EQ(skipping_reader.read_data(&first_byte, 1), 1u);
+			EXPECT_EQ(first_byte, new_data[instruction.start_index]);
+		}
+		++num_instructions;
+	}
+	EXPECT_EQ(num_instructions, del.instructions.size());
+
+	// the first literal block follows the header, a block with an unknown codec is rejected
+	const size_t header_length = sizeof(rd::delta_format::magic) + 1 + 2 * sizeof(uint64_t);
+	auto unknown_codec = compressed.str();
+	ASSERT_EQ(static_cast<uint8_t>(unknown_codec[header_length]), rd::delta_format::literals);
+	EXPECT_EQ(static_cast<rd::codec>(unknown_codec[header_length + 1]), rd::codec::lz);
+	unknown_codec[header_length + 1] = 100;
+	std::istringstream unknown_codec_input(unknown_codec);
+	rd::delta unknown_codec_delta;
+	EXPECT_THROW(rd::delta::read_from_binary_file(unknown_codec_input, unknown_codec_delta), std::runtime_error);
+
+	// truncated compressed delta is detected
+	std::istringstream truncated_input(compressed.str().substr(0, compressed.str().size() / 2));
+	rd::delta truncated_delta;
+	EXPECT_THROW(rd::delta::read_from_binary_file(truncated_input, truncated_delta), std::runtime_error);
+}
+
+TEST(test_delta_stream, read_ahead_window)
+{
+	const auto data = make_random_data<std::string>(3 * rd::impl::read_ahead_block_length + 1234, 20);
+	std::mt19937 generator(20);
+
+	// kept data longer than the room in front of the blocks is joined into one buffer
+	for (const size_t capacity : { size_t{ 64 }, size_t{ 4096 } })
+	{
+		SCOPED_TRACE(capacity);
+		pipe_buffer input(data);
+		std::istream input_stream(&input);
+		rd::impl::stream_window window(input_stream, capacity);
+		size_t position = 0;
+		while (true)
+		{
+			const size_t keep_from = position > 1000 ? position - 1000 : 0;
+			window.require(keep_from, position + 100);
+			if (position >= window.length())
+			{
+				break;
+			}
+			const size_t end = std::min(window.length(), position + 100);
+			ASSERT_EQ(std::string(window.at(keep_from), end - keep_from), data.substr(keep_from, end - keep_from));
+			position += generator() % 50000;
+		}
+		EXPECT_EQ(window.length(), data.size());
+	}
+
+	// errors of the stream are thrown in the reading thread
+	class failing_buffer : public std::streambuf
+	{
+	protected:
+		int_type underflow() override { throw std::runtime_error("read failed"); }
+	};
+	failing_buffer failing;
+	std::istream failing_stream(&failing);
+	rd::impl::stream_window failing_window(failing_stream, 64);
+	EXPECT_THROW(failing_window.require(0, 100), std::runtime_error);
+}
+
+TEST(test_delta_stream, local_delta)
+{
+	const auto old_data = make_random_data<std::string>(2 * 1024 * 1024, 25);
+
+	// edits closer to each other than any chunk, a moved block, a new run of zeros and a copy of the beginning at the end
+	auto new_data = old_data;
+	for (size_t i = 1; i < 200; ++i)
+	{
+		new_data[i * 5000 + (i % 7)] ^= 0x5a;
+		new_data[i * 5000 + 40] ^= 0x5a;
+	}
+	new_data.insert(1200003, "inserted");
+	new_data.erase(1400001, 3);
+	new_data.insert(1600000, old_data.substr(333333, 50000));
+	std::fill(new_data.begin() + 1700000, new_data.begin() + 1800000, '\0');
+	new_data += old_data.substr(7, 20000);
+
+	rd::delta del;
+	rd::delta_builder builder(del);
+	const auto stats = rd::calculate_local_delta(old_data.data(), old_data.size(), new_data.data(), new_data.size(), builder);
+	EXPECT_EQ(stats.bytes_scanned, new_data.size());
+	EXPECT_EQ(stats.literal_bytes + stats.matched_bytes + stats.zero_bytes, new_data.size());
+	EXPECT_GE(stats.zero_bytes, 100000u);
+
+	// only the changed bytes are literal data, a signature delta has whole chunks around every edit
+	EXPECT_LE(stats.literal_bytes, 2 * 199 + 8);
+	const auto sig = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 16);
+	rd::delta signature_delta;
+	rd::delta_builder signature_builder(signature_delta);
+	const auto signature_stats = rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size(), signature_builder);
+	EXPECT_LT(stats.literal_bytes * 10, signature_stats.literal_bytes);
+
+	std::vector<char> patched(del.data_length);
+	rd::patch<char*>(old_data.data(), del, patched.data());
+	EXPECT_TRUE(std::equal(patched.cbegin(), patched.cend(), new_data.cbegin(), new_data.cend()));
+
+	// written delta is patched like any other delta, with and without compressed literals
+	for (const auto literal_codec : { rd::codec::none, rd::codec::lz })
+	{
+		std::stringstream delta_stream;
+		rd::delta_writer writer(delta_stream, literal_codec);
+		rd::calculate_local_delta(old_data.data(), old_data.size(), new_data.data(), new_data.size(), writer);
+		writer.finish();
+		rd::delta_reader reader(delta_stream);
+		std::string patched_from_stream;
+		rd::patch<std::back_insert_iterator<std::string>>(old_data.data(), old_data.size(), reader, std::back_inserter(patched_from_stream));
+		EXPECT_EQ(patched_from_stream, new_data);
+	}
+
+	// shorter blocks find shorter common runs, a block length of 1 still gives a valid delta
+	const std::string original = "0123456789abcdef0123456789abcdef";
+	const std::string modified = "xx89abcdefyy0123zz";
+	for (const auto& [block_length, literal_length] : std::vector<std::pair<size_t, size_t>>{ { 1, 6 }, { 4, 6 }, { 8, 10 }, { 64, 18 } })
+	{
+		rd::local_delta_options options;
+		options.block_length = block_length;
+		const auto short_delta = rd::calculate_local_delta(original.data(), original.size(), modified.data(), modified.size(), options);
+		std::vector<char> short_patched(short_delta.data_length);
+		rd::patch<char*>(original.data(), short_delta, short_patched.data());
+		EXPECT_EQ(std::string(short_patched.data(), short_patched.size()), modified);
+		EXPECT_EQ(short_delta.literals.size(), literal_length);
+	}
+
+	// empty data on either side
+	const auto empty_original = rd::calculate_local_delta(nullptr, 0, modified.data(), modified.size());
+	EXPECT_EQ(empty_original.literals.size(), modified.size());
+	const auto empty_input = rd::calculate_local_delta(original.data(), original.size(), nullptr, 0);
+	EXPECT_TRUE(empty_input.instructions.empty());
+
+	rd::local_delta_options no_blocks;
+	no_blocks.block_length = 0;
+	EXPECT_THROW(rd::calculate_local_delta(original.data(), original.size(), modified.data(), modified.size(), no_blocks), std::invalid_argument);
+	EXPECT_THROW(rd::calculate_local_delta(nullptr, 10, modified.data(), modified.size()), std::invalid_argument);
+}
@@ -1,7 +1,14 @@
 ﻿#include <gtest/gtest.h>
 #include "checksum.hpp"
 #include "hash.hpp"
+#include "strong_hash.hpp"
+#include "cpu_features.hpp"
+#include "zeros.hpp"
+#include "test_data.h"
 #include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
 
 
 TEST(test_hash, checksum_adler32)
@@ -27,3 +34,128 @@ TEST(test_hash, jenkins_hash_function)
 	data = "Jenkins's one_at_a_time hash was originally created to fulfill certain requirements described by Colin Plumb, a cryptographer, but was ultimately not put to use.";
 	EXPECT_EQ(rd::compute_hash(data.begin(), data.length()), 0xd20c13be);
 }
+
+TEST(test_hash, rolling_checksum)
+{
+	std::string data{ "Adler-32 is a checksum algorithm written by Mark Adler in 1995, modifying Fletcher's checksum. \xff\x80\x01\xfe\x7f" };
+	for (size_t window_length : { 1, 5, 16, 50 })
+	{
+		rd::rolling_checksum checksum;
+		checksum.reset(data.data(), window_length);
+		for (size_t i = 0; i + window_length < data.length(); ++i)
+		{
+			EXPECT_EQ(checksum.value(), rd::compute_checksum(data.data() + i, window_length));
+			checksum.roll(data[i], data[i + window_length]);
+		}
+		EXPECT_EQ(checksum.value(), rd::compute_checksum(data.data() + data.length() - window_length, window_length));
+	}
+}
+
+static std::string strong_hash_hex(const std::string& data, size_t digest_length)
+{
+	uint8_t digest[rd::blake2b::max_digest_length];
+	rd::compute_strong_hash(data.begin(), data.length(), digest, digest_length);
+
+	std::ostringstream result;
+	for (size_t i = 0; i < digest_length; ++i)
+	{
+		result << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(digest[i]);
+	}
+
+	return result.str();
+}
+
+TEST(test_hash, strong_hash_blake2b)
+{
+	EXPECT_EQ(strong_hash_hex("abc", 64), "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d17d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
+	EXPECT_EQ(strong_hash_hex("", 16), "cae66941d9efbd404e4d88758ea67670");
+	EXPECT_EQ(strong_hash_hex("The quick brown fox jumps over the lazy dog", 32), "01718cec35cd3d796dd00020e0bfecb473ad23457d063b75eff29c0ffa2e58a9");
+
+	std::string data;
+	for (int i = 0; i < 3 * 256; ++i)
+	{
+		data.push_back(static_cast<char>(i));
+	}
+	EXPECT_EQ(strong_hash_hex(data, 20), "1e87621a16cfec1ca4d983f1762381eb4ea1e2f8");
+
+	// pointer input is hashed without the intermediate block buffer
+	uint8_t digest[20];
+	rd::compute_strong_hash(data.data(), data.length(), digest, 20);
+	EXPECT_EQ(digest[0], 0x1e);
+	EXPECT_EQ(digest[19], 0xf8);
+
+	EXPECT_THROW(rd::blake2b(0), std::invalid_argument);
+	EXPECT_THROW(rd::blake2b(65), std::invalid_argument);
+}
+
+// every kernel the CPU supports has to give the same result as the scalar one
+TEST(test_hash, simd_kernels)
+{
+	const auto random_data = make_random_data(64 * 1024 + 3, 7);
+	// bytes 0xff make the checksum sums as big as possible
+	const std::vector<char> max_data(3 * rd::impl::checksum_max_block_length + 100, '\xff');
+
+	const std::string text{ "The quick brown fox jumps over the lazy dog" };
+	const auto max_level = static_cast<int>(rd::impl::supported_simd_level());
+	for (int level_index = 0; level_index <= max_level; ++level_index)
+	{
+		const auto level = static_cast<rd::impl::simd_level>(level_index);
+		EXPECT_EQ(rd::impl::compute_checksum_at_level(text.data(), text.length(), level), 0x5bdc0fda);
+		for (const auto* data : { &random_data, &max_data })
+		{
+			for (size_t length : { 0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200, 5551, 5552, 5553, 11104, 16000 })
+			{
+				for (size_t offset : { 0, 1 })
+				{
+					EXPECT_EQ(rd::impl::compute_checksum_at_level(data->data() + offset, length, level),
+						rd::impl::compute_checksum_scalar(data->data() + offset, length)) << level_index << " " << length;
+				}
+			}
+			EXPECT_EQ(rd::impl::compute_checksum_at_level(data->data(), data->size(), level),
+				rd::impl::compute_checksum_scalar(data->data(), data->size())) << level_index;
+		}
+
+		for (size_t chunk_length : { 1, 3, 4, 7, 100, 1000 })
+		{
+			for (size_t num_chunks : { 0, 1, 7, 8, 9, 16, 17, 33 })
+			{
+				std::vector<uint32_t> hashes(num_chunks);
+				rd::impl::compute_hashes_at_level(random_data.data() + 1, chunk_length, num_chunks, hashes.data(), level);
+				for (size_t i = 0; i < num_chunks; ++i)
+				{
+					EXPECT_EQ(hashes[i], rd::compute_hash(random_data.data() + 1 + i * chunk_length, chunk_length)) << level_index << " " << chunk_length;
+				}
+			}
+		}
+
+		// runs of zeros of every length end at the first non-zero byte, or at the end of the data
+		std::vector<char> zeros(1000, '\0');
+		for (size_t run_length : { 0, 1, 7, 8, 31, 32, 63, 64, 65, 127, 128, 129, 500, 999 })
+		{
+			zeros[run_length] = 1;
+			for (size_t offset = 0; offset <= std::min<size_t>(run_length, 1); ++offset)
+			{
+				EXPECT_EQ(rd::impl::zero_run_length_at_level(zeros.data() + offset, zeros.size() - offset, level), run_length - offset)
+					<< level_index << " " << run_length;
+			}
+			EXPECT_EQ(rd::impl::zero_run_length_at_level(zeros.data(), run_length, level), run_length) << level_index;
+			zeros[run_length] = 0;
+		}
+
+		for (size_t chunk_length : { 1, 127, 128, 129, 300 })
+		{
+			for (size_t digest_length : { 1, 16, 64 })
+			{
+				constexpr size_t num_chunks = 9;
+				std::vector<uint8_t> digests(num_chunks * digest_length);
+				rd::impl::compute_strong_hashes_at_level(random_data.data() + 1, chunk_length, num_chunks, digests.data(), digest_length, level);
+				for (size_t i = 0; i < num_chunks; ++i)
+				{
+					std::vector<uint8_t> digest(digest_length);
+					rd::compute_strong_hash(random_data.data() + 1 + i * chunk_length, chunk_length, digest.data(), digest_length);
+					EXPECT_TRUE(std::equal(digest.cbegin(), digest.cend(), digests.cbegin() + i * digest_length)) << level_index << " " << chunk_length;
+				}
+			}
+		}
+	}
+}
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <ostream>
+#include <sstream>
 #include <iterator>
 #include <fstream>
 
@@ -51,9 +52,11 @@ TEST(test_hash_roll, multi_change_test)
 	EXPECT_EQ(original_signature.chunks.size(), 7);
 	EXPECT_EQ(original_signature.chunks[0].length, original_data.chunk_length);
 	EXPECT_EQ(original_signature.chunks[6].length, 50);
-	rd::signature expected_signature{ { {0, 100, 0x31477121}, {100, 100, 0x6c03a0c3},  {200, 100, 0x1C42219B}, {300, 100, 0xB408C42C},
-		{400, 100, 0x4b699624}, {500, 100, 0x203bff41}, {600, 50, 0xe81b3115} } };
-	EXPECT_EQ(original_signature, expected_signature);
+	rd::signature expected_signature{ { {0, 100, 0x31477121, 0xc72b1325}, {100, 100, 0x6c03a0c3, 0xdae51389},  {200, 100, 0x1C42219B, 0xee9f13ed},
+		{300, 100, 0xB408C42C, 0x02681451}, {400, 100, 0x4b699624, 0x162214b5}, {500, 100, 0x203bff41, 0x29dc1519}, {600, 50, 0xe81b3115, 0x122e0abf} } };
+	EXPECT_EQ(original_signature.chunks, expected_signature.chunks);
+	EXPECT_EQ(original_signature.strong_hash_length, rd::default_strong_hash_length);
+	EXPECT_EQ(original_signature.strong_hashes.size(), 7 * rd::default_strong_hash_length);
 
 	test_data_small_multichange multi_change_data;
 	rd::delta delta_multi = rd::calculate_delta<char*>(original_signature, multi_change_data.data, multi_change_data.data_length);
@@ -61,67 +64,187 @@ TEST(test_hash_roll, multi_change_test)
 	EXPECT_EQ(delta_multi.data_length, 665);
 
 	// we cant match first 100 bytes to anything so we copy them to delta 
-	EXPECT_EQ(delta_multi.instructions[0].command, "COPY_DATA");
+	EXPECT_EQ(delta_multi.instructions[0].command, rd::delta::opcode::copy_data);
 	EXPECT_EQ(delta_multi.instructions[0].start_index, 0);
 	EXPECT_EQ(delta_multi.instructions[0].data_length, 100);
-	EXPECT_EQ(strncmp(multi_change_data.data, delta_multi.instructions[0].data.data(), 100), 0);
+	EXPECT_EQ(strncmp(multi_change_data.data, delta_multi.data(delta_multi.instructions[0]), 100), 0);
 
 	// then we match a chunk from index 105 to 205 so we need to copy next 5 bytes of input to the delta
-	EXPECT_EQ(delta_multi.instructions[1].command, "COPY_DATA");
+	EXPECT_EQ(delta_multi.instructions[1].command, rd::delta::opcode::copy_data);
 	EXPECT_EQ(delta_multi.instructions[1].start_index, 100);
 	EXPECT_EQ(delta_multi.instructions[1].data_length, 5);
-	EXPECT_EQ(strncmp(multi_change_data.data + 100, delta_multi.instructions[1].data.data(), 5), 0);
+	EXPECT_EQ(strncmp(multi_change_data.data + 100, delta_multi.data(delta_multi.instructions[1]), 5), 0);
 
 	// then we copy matched chunk which is original chunk 1
-	EXPECT_EQ(delta_multi.instructions[2].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[2].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[2].start_index, 100);
 	EXPECT_EQ(delta_multi.instructions[2].data_length, original_data.chunk_length);
 	EXPECT_EQ(delta_multi.instructions[2].chunk_id, 1);
 
 	// next we match original chunk 3 
-	EXPECT_EQ(delta_multi.instructions[3].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[3].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[3].start_index, 300);
 	EXPECT_EQ(delta_multi.instructions[3].data_length, original_data.chunk_length);
 	EXPECT_EQ(delta_multi.instructions[3].chunk_id, 3);
 
 	// then original chunk 4
-	EXPECT_EQ(delta_multi.instructions[4].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[4].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[4].start_index, 400);
 	EXPECT_EQ(delta_multi.instructions[4].data_length, original_data.chunk_length);
 	EXPECT_EQ(delta_multi.instructions[4].chunk_id, 4);
 
 	// we match original chunk 6 after 5 bytes so we need to copy those 5 bytes to the delta
-	EXPECT_EQ(delta_multi.instructions[5].command, "COPY_DATA");
+	EXPECT_EQ(delta_multi.instructions[5].command, rd::delta::opcode::copy_data);
 	EXPECT_EQ(delta_multi.instructions[5].start_index, 405);
 	EXPECT_EQ(delta_multi.instructions[5].data_length, 5);
-	EXPECT_EQ(strncmp(multi_change_data.data + 405, delta_multi.instructions[5].data.data(), 5), 0);
+	EXPECT_EQ(strncmp(multi_change_data.data + 405, delta_multi.data(delta_multi.instructions[5]), 5), 0);
 
 	// then copy original chunk 6 which is only 50 bytes long
-	EXPECT_EQ(delta_multi.instructions[6].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[6].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[6].start_index, 600);
 	EXPECT_EQ(delta_multi.instructions[6].data_length, original_data.chunk_length / 2);
 	EXPECT_EQ(delta_multi.instructions[6].chunk_id, 6);
 
 	// we then match original chunk 2
-	EXPECT_EQ(delta_multi.instructions[7].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[7].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[7].start_index, 200);
 	EXPECT_EQ(delta_multi.instructions[7].data_length, original_data.chunk_length);
 	EXPECT_EQ(delta_multi.instructions[7].chunk_id, 2);
 
 	// we match original chunk 5
-	EXPECT_EQ(delta_multi.instructions[8].command, "COPY_CHUNK");
+	EXPECT_EQ(delta_multi.instructions[8].command, rd::delta::opcode::copy_chunk);
 	EXPECT_EQ(delta_multi.instructions[8].start_index, 500);
 	EXPECT_EQ(delta_multi.instructions[8].data_length, original_data.chunk_length);
 	EXPECT_EQ(delta_multi.instructions[8].chunk_id, 5);
 
 	// 5 bytes are unmatched so we copy them
-	EXPECT_EQ(delta_multi.instructions[9].command, "COPY_DATA");
+	EXPECT_EQ(delta_multi.instructions[9].command, rd::delta::opcode::copy_data);
 	EXPECT_EQ(delta_multi.instructions[9].start_index, 660);
 	EXPECT_EQ(delta_multi.instructions[9].data_length, 5);
-	EXPECT_EQ(strncmp(multi_change_data.data + 660, delta_multi.instructions[9].data.data(), 5), 0);
+	EXPECT_EQ(strncmp(multi_change_data.data + 660, delta_multi.data(delta_multi.instructions[9]), 5), 0);
 }
 
 
+TEST(test_hash_roll, match_extension)
+{
+	test_data_small original_data;
+	auto original_signature = rd::calculate_signature<char*>(original_data.data, original_data.data_length - 50, original_data.chunk_length);
+	test_data_small_multichange multi_change_data;
+
+	rd::delta extended;
+	rd::delta_builder builder(extended);
+	rd::match_extender<rd::delta_builder> extender(builder, original_data.data, original_data.data_length);
+	rd::calculate_delta<char*>(original_signature, multi_change_data.data, multi_change_data.data_length, extender);
+	extender.finish();
+	ASSERT_EQ(extended.instructions.size(), 9);
+	EXPECT_EQ(extender.extended_bytes(), 50);
+
+	// ones after "bbbbb" equal the end of original chunk 0, so chunk 1 is copied together with them
+	EXPECT_EQ(extended.instructions[0].command, rd::delta::opcode::copy_data);
+	EXPECT_EQ(extended.instructions[0].start_index, 0);
+	EXPECT_EQ(extended.instructions[0].data_length, 55);
+	EXPECT_EQ(extended.instructions[1].command, rd::delta::opcode::copy_chunk);
+	EXPECT_EQ(extended.instructions[1].start_index, 50);
+	EXPECT_EQ(extended.instructions[1].data_length, 150);
+	EXPECT_EQ(extended.instructions[1].chunk_id, 1);
+
+	// changed bytes next to the other chunks stay data
+	EXPECT_EQ(extended.instructions[4].command, rd::delta::opcode::copy_data);
+	EXPECT_EQ(extended.instructions[4].start_index, 405);
+	EXPECT_EQ(extended.instructions[4].data_length, 5);
+	EXPECT_EQ(extended.instructions[8].command, rd::delta::opcode::copy_data);
+	EXPECT_EQ(extended.instructions[8].start_index, 660);
+	EXPECT_EQ(extended.instructions[8].data_length, 5);
+
+	std::vector<char> patched(extended.data_length);
+	rd::patch<char*>(original_data.data, extended, patched.data());
+	EXPECT_EQ(std::string(patched.data(), patched.size()), std::string(multi_change_data.data, multi_change_data.data_length));
+
+	// with long chunks only the changed bytes are left as data
+	const auto old_data = make_random_data<std::string>(1024 * 1024, 25);
+	auto new_data = old_data;
+	for (size_t position = 20000; position < new_data.size(); position += 30011)
+	{
+		new_data[position] = static_cast<char>(new_data[position] + 1);
+	}
+	new_data.insert(515000, "inserted");
+	new_data.erase(755000, 100);
+
+	// bytes between two changes that are closer than two chunks have no chunk to extend, changes here are far apart
+	const auto sig = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 4096);
+	const size_t num_changed_bytes = new_data.size() / 30011 + 10;
+	for (const size_t max_backward_length : { rd::match_extender<rd::delta_builder>::default_max_backward_length, size_t{ 1000 } })
+	{
+		SCOPED_TRACE(max_backward_length);
+		rd::delta del;
+		rd::delta_builder del_builder(del);
+		rd::match_extender<rd::delta_builder> del_extender(del_builder, old_data.data(), old_data.size(), max_backward_length);
+		const auto stats = rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size(), del_extender);
+		del_extender.finish();
+		EXPECT_GT(stats.literal_bytes, 30 * 4096u);
+		EXPECT_EQ(stats.literal_bytes - del_extender.extended_bytes(), del.literals.size());
+		if (max_backward_length > 4096)
+		{
+			EXPECT_LE(del.literals.size(), num_changed_bytes);
+		}
+
+		// extended chunks are written with any offset and length
+		std::stringstream delta_stream;
+		rd::delta::write_to_binary_file(delta_stream, del);
+		rd::delta_reader reader(delta_stream);
+		std::string patched_data;
+		rd::patch<std::back_insert_iterator<std::string>>(old_data.data(), old_data.size(), reader, std::back_inserter(patched_data));
+		EXPECT_EQ(patched_data, new_data);
+
+		// stitched segments of the parallel delta are extended the same way, unless the held data is too short for whole chunks
+		rd::delta parallel_delta;
+		rd::delta_builder parallel_builder(parallel_delta);
+		rd::match_extender<rd::delta_builder> parallel_extender(parallel_builder, old_data.data(), old_data.size(), max_backward_length);
+		rd::calculate_delta_parallel(sig, new_data.data(), new_data.size(), parallel_extender, 3, 100000);
+		parallel_extender.finish();
+		if (max_backward_length > 4096)
+		{
+			EXPECT_EQ(parallel_delta.literals.size(), del.literals.size());
+		}
+		std::vector<char> patched_parallel(parallel_delta.data_length);
+		rd::patch<char*>(old_data.data(), parallel_delta, patched_parallel.data());
+		EXPECT_EQ(std::string(patched_parallel.data(), patched_parallel.size()), new_data);
+	}
+
+	// signature of other data is detected when its chunk is outside of the original
+	rd::delta other;
+	rd::delta_builder other_builder(other);
+	rd::match_extender<rd::delta_builder> other_extender(other_builder, old_data.data(), 1000);
+	EXPECT_THROW(rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size(), other_extender), std::invalid_argument);
+}
+
+TEST(test_hash_roll, strong_hash_mismatch)
+{
+	test_data_small original_data;
+	auto original_signature = rd::calculate_signature<char*>(original_data.data, original_data.data_length, original_data.chunk_length);
+
+	// chunk matched by the checksum and the hash but not by the strong hash has to be copied as data
+	original_signature.strong_hashes[3 * original_signature.strong_hash_length] ^= 0xff;
+	rd::delta del = rd::calculate_delta<char*>(original_signature, original_data.data, original_data.data_length);
+	ASSERT_EQ(del.instructions.size(), 7);
+	EXPECT_EQ(del.instructions[2].command, rd::delta::opcode::copy_chunk);
+	EXPECT_EQ(del.instructions[3].command, rd::delta::opcode::copy_data);
+	EXPECT_EQ(del.instructions[3].start_index, 300);
+	EXPECT_EQ(del.instructions[4].command, rd::delta::opcode::copy_chunk);
+	EXPECT_EQ(del.instructions[4].chunk_id, 4);
+
+	std::vector<char> patched(del.data_length);
+	rd::patch<char*>(original_data.data, del, patched.data());
+	EXPECT_EQ(std::string(patched.data(), patched.size()), std::string(original_data.data, original_data.data_length));
+
+	// without strong hashes the chunk is matched by the hash
+	original_signature = rd::calculate_signature<char*>(original_data.data, original_data.data_length, original_data.chunk_length, 0);
+	EXPECT_TRUE(original_signature.strong_hashes.empty());
+	del = rd::calculate_delta<char*>(original_signature, original_data.data, original_data.data_length);
+	EXPECT_EQ(del.instructions.size(), 7);
+	EXPECT_EQ(del.instructions[3].command, rd::delta::opcode::copy_chunk);
+}
+
 TEST(test_hash_roll, binary_file_test)
 {
 	constexpr size_t chunk_size = 5000;
@@ -279,3 +402,79 @@ TEST(test_hash_roll, binary_file_char_arrays)
 	patched_file.write(patch_array.data(), delta_array.data_length);
 }
 
+
+TEST(test_hash_roll, compact_signature_file)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+
+	for (size_t strong_hash_length : { 0, 16 })
+	{
+		const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100, strong_hash_length);
+
+		// only hashes are stored for every chunk
+		std::ostringstream compact;
+		rd::signature::write_to_binary_file(compact, sig);
+		EXPECT_EQ(compact.str().size(), rd::signature_format::header_length + sig.chunks.size() * (8 + strong_hash_length));
+
+		std::istringstream compact_input(compact.str());
+		rd::signature read_signature;
+		rd::signature::read_from_binary_file(compact_input, read_signature);
+		EXPECT_EQ(read_signature, sig);
+
+		// legacy files are still read
+		std::string legacy;
+		auto write_value = [&legacy](const auto& value) { legacy.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+		write_value(sig.chunks.size());
+		write_value(sig.strong_hash_length);
+		for (size_t i = 0; i < sig.chunks.size(); ++i)
+		{
+			write_value(sig.chunks[i].start_position);
+			write_value(sig.chunks[i].length);
+			write_value(sig.chunks[i].hash);
+			write_value(sig.chunks[i].checksum);
+			legacy.append(reinterpret_cast<const char*>(sig.strong_hash(i)), sig.strong_hash_length);
+		}
+		std::istringstream legacy_input(legacy);
+		rd::signature legacy_signature;
+		rd::signature::read_from_binary_file(legacy_input, legacy_signature);
+		EXPECT_EQ(legacy_signature, sig);
+	}
+
+	// truncated file is detected
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100);
+	std::ostringstream compact;
+	rd::signature::write_to_binary_file(compact, sig);
+	std::istringstream truncated_input(compact.str().substr(0, compact.str().size() - 1));
+	rd::signature truncated_signature;
+	EXPECT_THROW(rd::signature::read_from_binary_file(truncated_input, truncated_signature), std::runtime_error);
+}
+
+TEST(test_hash_roll, signature_index_keeps_duplicates)
+{
+	// every chunk of the data is the same
+	const std::string data(1000, 'a');
+	const auto sig = rd::calculate_signature<const char*>(data.data(), data.size(), 100);
+	const rd::impl::signature_index index(sig);
+
+	const auto candidates = index.find(sig.chunks[0].checksum);
+	ASSERT_EQ(static_cast<size_t>(candidates.end() - candidates.begin()), sig.chunks.size());
+	for (size_t i = 0; i < sig.chunks.size(); ++i)
+	{
+		EXPECT_EQ(candidates.begin()[i].chunk_id, i);
+		EXPECT_EQ(candidates.begin()[i].length, sig.chunks[i].length);
+		EXPECT_EQ(candidates.begin()[i].hash, sig.chunks[i].hash);
+	}
+	EXPECT_TRUE(index.find(sig.chunks[0].checksum + 1).empty());
+
+	// all checksums of a bigger signature are found
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	const auto old_signature = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 16);
+	const rd::impl::signature_index old_index(old_signature);
+	for (size_t i = 0; i < old_signature.chunks.size(); ++i)
+	{
+		const auto old_candidates = old_index.find(old_signature.chunks[i].checksum);
+		EXPECT_TRUE(std::any_of(old_candidates.begin(), old_candidates.end(), [i](const auto& c) { return c.chunk_id == i; }));
+	}
+}
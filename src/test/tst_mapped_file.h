@@ -0,0 +1,267 @@
+﻿#include <gtest/gtest.h>
+
+#include "mapped_file.hpp"
+#include "random_access_file.hpp"
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "test_data.h"
+
+#include <string>
+#include <vector>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <cstdio>
+
+TEST(test_mapped_file, read_and_create)
+{
+	const std::string old_file_name = "data/old.bmp";
+	const std::string new_file_name = "data/new.bmp";
+	const std::string patched_file_name = "data/patched_mapped.bmp";
+	constexpr size_t chunk_size = 1000;
+
+	std::ifstream old_file(old_file_name, std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file(new_file_name, std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	rd::mapped_file old_mapping;
+	ASSERT_TRUE(old_mapping.open_read(old_file_name));
+	ASSERT_EQ(old_mapping.size(), old_array.size());
+	EXPECT_TRUE(std::equal(old_array.cbegin(), old_array.cend(), old_mapping.data()));
+
+	rd::mapped_file new_mapping;
+	ASSERT_TRUE(new_mapping.open_read(new_file_name));
+
+	// mapped data gives the same results as the arrays
+	auto sig = rd::calculate_signature<const char*>(old_mapping.data(), old_mapping.size(), chunk_size);
+	EXPECT_EQ(sig, rd::calculate_signature<char*>(old_array.data(), old_array.size(), chunk_size));
+	auto del = rd::calculate_delta<const char*>(sig, new_mapping.data(), new_mapping.size());
+	EXPECT_EQ(del.data_length, new_array.size());
+
+	{
+		rd::mapped_file patched_mapping;
+		ASSERT_TRUE(patched_mapping.create(patched_file_name, del.data_length));
+		rd::patch<char*>(old_mapping.data(), del, patched_mapping.data());
+	}
+
+	std::ifstream patched_file(patched_file_name, std::ios_base::binary);
+	std::vector<char> patched_array{ std::istreambuf_iterator<char>(patched_file), std::istreambuf_iterator<char>() };
+	EXPECT_EQ(patched_array, new_array);
+
+	// mapping can be moved
+	rd::mapped_file moved_mapping = std::move(old_mapping);
+	EXPECT_FALSE(old_mapping.is_open());
+	EXPECT_TRUE(moved_mapping.is_open());
+	EXPECT_EQ(moved_mapping.size(), old_array.size());
+}
+
+TEST(test_mapped_file, not_mappable)
+{
+	rd::mapped_file mapping;
+	EXPECT_FALSE(mapping.open_read("data/this_file_does_not_exist.bin"));
+	EXPECT_FALSE(mapping.is_open());
+
+	// empty files can't be mapped, streams have to be used for them
+	{
+		std::ofstream empty_file("data/empty.bin", std::ios_base::binary);
+	}
+	EXPECT_FALSE(mapping.open_read("data/empty.bin"));
+	EXPECT_FALSE(mapping.create("data/empty.bin", 0));
+
+	// directories can't be mapped
+	EXPECT_FALSE(mapping.open_read("data"));
+}
+
+TEST(test_mapped_file, mapped_signature)
+{
+	const std::string signature_file_name = "data/signature_mapped.bin";
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100);
+	{
+		std::ofstream signature_file(signature_file_name, std::ios_base::binary);
+		rd::signature::write_to_binary_file(signature_file, sig);
+	}
+
+	rd::mapped_signature mapped;
+	ASSERT_TRUE(mapped.open(signature_file_name));
+	const auto& view = mapped.view();
+	ASSERT_EQ(view.size(), sig.chunks.size());
+	EXPECT_EQ(view.strong_hash_length(), sig.strong_hash_length);
+	for (size_t i = 0; i < sig.chunks.size(); ++i)
+	{
+		EXPECT_EQ(view.start_position(i), sig.chunks[i].start_position);
+		EXPECT_EQ(view.length(i), sig.chunks[i].length);
+		EXPECT_EQ(view.checksum(i), sig.chunks[i].checksum);
+		EXPECT_EQ(view.hash(i), sig.chunks[i].hash);
+		EXPECT_TRUE(std::equal(sig.strong_hash(i), sig.strong_hash(i) + sig.strong_hash_length, view.strong_hash(i)));
+	}
+
+	// delta from the mapped signature is the same as from the loaded one
+	const auto expected = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size());
+	const auto actual = rd::calculate_delta<char*>(view, new_array.data(), new_array.size());
+	ASSERT_EQ(actual.instructions.size(), expected.instructions.size());
+	for (size_t i = 0; i < expected.instructions.size(); ++i)
+	{
+		EXPECT_EQ(actual.instructions[i].command, expected.instructions[i].command);
+		EXPECT_EQ(actual.instructions[i].start_index, expected.instructions[i].start_index);
+		EXPECT_EQ(actual.instructions[i].data_length, expected.instructions[i].data_length);
+	}
+
+	// files in other formats are not mapped
+	EXPECT_FALSE(mapped.open("data/old.bmp"));
+	EXPECT_FALSE(mapped.is_open());
+}
+
+TEST(test_mapped_file, batched_patch_of_reordered_file)
+{
+	const std::string old_file_name = "data/random_access_old.bin";
+	constexpr size_t block_length = 4096;
+
+	// new data has the blocks of the old data in random order, some of them twice, and a few literals,
+	// it is longer than one batch so chunks are split between batches
+	auto old_array = make_random_data(3 * rd::impl::patch_batch_length / 2, 20);
+	std::mt19937 generator(20);
+	std::vector<char> new_array;
+	const size_t num_blocks = old_array.size() / block_length;
+	for (size_t i = 0; i < num_blocks + 100; ++i)
+	{
+		const size_t block = i % 7 == 0 ? i % num_blocks : generator() % num_blocks;
+		new_array.insert(new_array.end(), old_array.begin() + block * block_length, old_array.begin() + (block + 1) * block_length);
+		if (i % 100 == 0)
+		{
+			new_array.push_back(static_cast<char>(i));
+		}
+	}
+	{
+		std::ofstream old_file(old_file_name, std::ios_base::binary);
+		old_file.write(old_array.data(), static_cast<std::streamsize>(old_array.size()));
+	}
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), block_length);
+	const auto del = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size());
+	std::ostringstream delta_stream;
+	rd::delta::write_to_binary_file(delta_stream, del);
+
+	rd::random_access_file original;
+	ASSERT_TRUE(original.open(old_file_name));
+	EXPECT_EQ(original.size(), old_array.size());
+	std::istringstream delta_input(delta_stream.str());
+	rd::delta_reader reader(delta_input);
+	std::vector<char> patched;
+	rd::patch<std::back_insert_iterator<std::vector<char>>>(original, reader, std::back_inserter(patched));
+	EXPECT_TRUE(patched == new_array);
+
+	// file streams are read in batches too
+	std::ifstream original_stream(old_file_name, std::ios_base::binary);
+	std::vector<char> patched_from_stream;
+	rd::patch<std::back_insert_iterator<std::vector<char>>>(original_stream, del, std::back_inserter(patched_from_stream));
+	EXPECT_TRUE(patched_from_stream == new_array);
+
+	// chunks outside of the original file are rejected
+	std::istringstream short_delta_input(delta_stream.str());
+	rd::delta_reader short_reader(short_delta_input);
+	rd::random_access_file short_original;
+	ASSERT_TRUE(short_original.open("data/old.bmp"));
+	std::vector<char> patched_short;
+	EXPECT_THROW(rd::patch<std::back_insert_iterator<std::vector<char>>>(short_original, short_reader, std::back_inserter(patched_short)),
+		std::runtime_error);
+
+	original.close();
+	std::remove(old_file_name.c_str());
+}
+
+static std::vector<char> read_whole_file(const std::string& file_name)
+{
+	std::ifstream file(file_name, std::ios_base::binary);
+	return std::vector<char>{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+TEST(test_mapped_file, in_place_patch)
+{
+	const std::string file_name = "data/in_place.bin";
+	constexpr size_t chunk_size = 1024;
+
+	auto old_array = make_random_data(1024 * 1024, 21);
+	std::mt19937 generator(21);
+
+	// a few changed pages, blocks swapped, data inserted and removed, file extended or truncated, region cleared and zeros appended,
+	// insertions that shift the whole file forward
+	std::vector<std::vector<char>> new_arrays(6, old_array);
+	for (size_t i = 0; i < 10; ++i)
+	{
+		new_arrays[0][generator() % old_array.size()] ^= 1;
+	}
+	std::swap_ranges(new_arrays[1].begin() + 100000, new_arrays[1].begin() + 200000, new_arrays[1].begin() + 600000);
+	new_arrays[2].insert(new_arrays[2].begin() + 300000, 777, 'x');
+	new_arrays[2].erase(new_arrays[2].begin() + 700000, new_arrays[2].begin() + 720000);
+	new_arrays[3].resize(old_array.size() / 2);
+	new_arrays[3].insert(new_arrays[3].begin(), old_array.begin() + 600000, old_array.end());
+	std::fill(new_arrays[4].begin() + 400000, new_arrays[4].begin() + 500000, '\0');
+	new_arrays[4].resize(old_array.size() + 300000);
+	for (size_t position = 900000; position > 0; position -= 100000)
+	{
+		new_arrays[5].insert(new_arrays[5].begin() + position, 5, 'y');
+	}
+	new_arrays[5].insert(new_arrays[5].begin() + 100, 1000, 'z');
+
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), chunk_size);
+	for (const auto& new_array : new_arrays)
+	{
+		std::stringstream delta_stream;
+		rd::delta_writer writer(delta_stream);
+		rd::in_place_sink<rd::delta_writer> in_place_writer(writer);
+		rd::calculate_delta<const char*>(sig, new_array.data(), new_array.size(), in_place_writer);
+		writer.finish();
+
+		// chunks shifted by insertions and deletions are moved instead of becoming data
+		if (&new_array == &new_arrays[2] || &new_array == &new_arrays[5])
+		{
+			std::stringstream plain_delta;
+			rd::delta_writer plain_writer(plain_delta);
+			rd::calculate_delta<const char*>(sig, new_array.data(), new_array.size(), plain_writer);
+			plain_writer.finish();
+			EXPECT_EQ(delta_stream.str().size(), plain_delta.str().size());
+		}
+
+		{
+			std::ofstream file(file_name, std::ios_base::binary | std::ios_base::trunc);
+			file.write(old_array.data(), static_cast<std::streamsize>(old_array.size()));
+		}
+		const auto stats = rd::patch_in_place(file_name, delta_stream);
+		EXPECT_EQ(stats.data_length, new_array.size());
+		EXPECT_TRUE(read_whole_file(file_name) == new_array);
+		if (&new_array == &new_arrays[0])
+		{
+			// only the changed chunks are written
+			EXPECT_LE(stats.bytes_written, 10 * chunk_size);
+			EXPECT_EQ(stats.bytes_read, 0u);
+		}
+		if (&new_array == &new_arrays[4])
+		{
+			// zeros are punched or extended instead of being written
+			EXPECT_GE(stats.zero_bytes, 300000u + 100000u - 2 * chunk_size);
+			EXPECT_LE(stats.bytes_written, 3 * chunk_size + stats.zero_bytes);
+		}
+	}
+
+	// delta that reads chunks after they are overwritten is rejected before the file is changed
+	std::stringstream swapped_delta;
+	rd::delta_writer writer(swapped_delta);
+	rd::calculate_delta<const char*>(sig, new_arrays[1].data(), new_arrays[1].size(), writer);
+	writer.finish();
+	{
+		std::ofstream file(file_name, std::ios_base::binary | std::ios_base::trunc);
+		file.write(old_array.data(), static_cast<std::streamsize>(old_array.size()));
+	}
+	EXPECT_THROW(rd::patch_in_place(file_name, swapped_delta), std::runtime_error);
+	EXPECT_TRUE(read_whole_file(file_name) == old_array);
+
+	std::remove(file_name.c_str());
+}
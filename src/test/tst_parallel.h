@@ -0,0 +1,160 @@
+﻿#include <gtest/gtest.h>
+
+#include "parallel.hpp"
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "test_data.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <fstream>
+
+TEST(test_parallel, parallel_for)
+{
+	std::vector<std::atomic<int>> counters(1000);
+	rd::parallel_for(counters.size(), 4, [&](size_t i) { ++counters[i]; });
+	for (const auto& counter : counters)
+	{
+		EXPECT_EQ(counter, 1);
+	}
+
+	EXPECT_THROW(rd::parallel_for(100, 4, [](size_t i)
+	{
+		if (i == 42)
+		{
+			throw std::runtime_error("task failed");
+		}
+	}), std::runtime_error);
+}
+
+TEST(test_parallel, signature_is_same_as_sequential)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	ASSERT_FALSE(old_array.empty());
+
+	for (size_t chunk_size : { 7, 100, 5000, 1000000 })
+	{
+		const auto sequential = rd::calculate_signature<char*>(old_array.data(), old_array.size(), chunk_size);
+		for (size_t num_threads : { 1, 2, 3, 8 })
+		{
+			const auto parallel = rd::calculate_signature_parallel(old_array.data(), old_array.size(), chunk_size,
+				rd::default_strong_hash_length, num_threads);
+			EXPECT_EQ(sequential, parallel);
+		}
+	}
+
+	const auto sequential = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 100, 0);
+	EXPECT_EQ(sequential, rd::calculate_signature_parallel(old_array.data(), old_array.size(), 100, 0, 4));
+}
+
+static size_t count_data_bytes(const rd::delta& del)
+{
+	size_t result = 0;
+	for (const auto& instruction : del.instructions)
+	{
+		result += instruction.command == rd::delta::opcode::copy_data ? instruction.data_length : 0;
+	}
+
+	return result;
+}
+
+TEST(test_parallel, delta_patches_to_same_data)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+
+	for (size_t chunk_size : { 100, 1000 })
+	{
+		const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), chunk_size);
+		const auto sequential = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size());
+
+		// single segment gives the same instructions as the sequential delta
+		const auto single = rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), 4, new_array.size());
+		ASSERT_EQ(single.instructions.size(), sequential.instructions.size());
+		for (size_t i = 0; i < single.instructions.size(); ++i)
+		{
+			EXPECT_EQ(single.instructions[i].command, sequential.instructions[i].command);
+			EXPECT_EQ(single.instructions[i].start_index, sequential.instructions[i].start_index);
+			EXPECT_EQ(single.instructions[i].data_length, sequential.instructions[i].data_length);
+		}
+
+		for (size_t segment_length : { 97, 4096, 100000 })
+		{
+			const auto parallel = rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), 3, segment_length);
+			EXPECT_EQ(parallel.data_length, new_array.size());
+
+			std::vector<char> patched(parallel.data_length);
+			rd::patch<char*>(old_array.data(), parallel, patched.data());
+			EXPECT_EQ(patched, new_array);
+
+			const size_t num_segments = (new_array.size() + segment_length - 1) / segment_length;
+			EXPECT_LE(count_data_bytes(parallel), count_data_bytes(sequential) + (num_segments - 1) * (chunk_size - 1));
+		}
+	}
+}
+
+TEST(test_parallel, delta_chunk_across_segment_boundary)
+{
+	test_data_small original_data;
+	const auto sig = rd::calculate_signature<char*>(original_data.data, original_data.data_length, original_data.chunk_length);
+
+	// the second segment starts in the middle of original chunk 2 which is matched by the first segment
+	auto del = rd::calculate_delta_parallel(sig, original_data.data, original_data.data_length, 2, 250);
+	ASSERT_EQ(del.instructions.size(), 7);
+	for (size_t i = 0; i < del.instructions.size(); ++i)
+	{
+		EXPECT_EQ(del.instructions[i].command, rd::delta::opcode::copy_chunk);
+		EXPECT_EQ(del.instructions[i].chunk_id, i);
+	}
+
+	// unmatched data at the boundary is merged into one instruction
+	test_data_small_multichange multi_change_data;
+	del = rd::calculate_delta_parallel(sig, multi_change_data.data, multi_change_data.data_length, 2, 50);
+	EXPECT_EQ(del.data_length, multi_change_data.data_length);
+	EXPECT_EQ(del.instructions[0].command, rd::delta::opcode::copy_data);
+	EXPECT_EQ(del.instructions[0].data_length, 105);
+	std::vector<char> patched(del.data_length);
+	rd::patch<char*>(original_data.data, del, patched.data());
+	EXPECT_EQ(std::string(patched.data(), patched.size()), std::string(multi_change_data.data, multi_change_data.data_length));
+}
+
+TEST(test_parallel, delta_stats)
+{
+	std::ifstream old_file("data/old.bmp", std::ios_base::binary);
+	std::vector<char> old_array{ std::istreambuf_iterator<char>(old_file), std::istreambuf_iterator<char>() };
+	std::ifstream new_file("data/new.bmp", std::ios_base::binary);
+	std::vector<char> new_array{ std::istreambuf_iterator<char>(new_file), std::istreambuf_iterator<char>() };
+	const auto sig = rd::calculate_signature<char*>(old_array.data(), old_array.size(), 1000);
+
+	rd::delta sequential;
+	rd::delta_builder sequential_builder(sequential);
+	const auto stats = rd::calculate_delta<char*>(sig, new_array.data(), new_array.size(), sequential_builder);
+	size_t num_copied_chunks = 0;
+	for (const auto& instruction : sequential.instructions)
+	{
+		num_copied_chunks += instruction.command == rd::delta::opcode::copy_chunk ? 1 : 0;
+	}
+	EXPECT_EQ(stats.literal_bytes, count_data_bytes(sequential));
+	EXPECT_EQ(stats.literal_bytes + stats.matched_bytes, new_array.size());
+	EXPECT_EQ(stats.strong_confirmations, num_copied_chunks);
+	EXPECT_EQ(stats.weak_hits, stats.strong_confirmations + stats.false_positives);
+	EXPECT_GE(stats.weak_probes, stats.weak_hits);
+	EXPECT_GE(stats.bytes_scanned, new_array.size());
+	EXPECT_GE(stats.index_seconds, 0.0);
+	EXPECT_GE(stats.scan_seconds, 0.0);
+
+	rd::delta parallel;
+	rd::delta_builder parallel_builder(parallel);
+	const auto parallel_stats = rd::calculate_delta_parallel(sig, new_array.data(), new_array.size(), parallel_builder, 3, 4096);
+	EXPECT_EQ(parallel_stats.literal_bytes, count_data_bytes(parallel));
+	EXPECT_EQ(parallel_stats.literal_bytes + parallel_stats.matched_bytes, new_array.size());
+	EXPECT_EQ(parallel_stats.weak_hits, parallel_stats.strong_confirmations + parallel_stats.false_positives);
+	EXPECT_GE(parallel_stats.weak_probes, parallel_stats.weak_hits);
+}
@@ -0,0 +1,104 @@
+﻿#include <gtest/gtest.h>
+
+#include "progress.hpp"
+#include "signature.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "test_data.h"
+
+#include <sstream>
+#include <vector>
+#include <iterator>
+
+/// <summary>
+/// Records calls of the progress callback
+/// </summary>
+struct progress_log
+{
+	rd::progress_callback callback()
+	{
+		return [this](size_t bytes_done, size_t bytes_total) { calls.emplace_back(bytes_done, bytes_total); };
+	}
+
+	void check(size_t total) const
+	{
+		ASSERT_FALSE(calls.empty());
+		EXPECT_EQ(calls.back().first, total);
+		EXPECT_LE(calls.size(), total / rd::progress_interval + 2);
+		for (size_t i = 0; i < calls.size(); ++i)
+		{
+			EXPECT_EQ(calls[i].second, total);
+			EXPECT_LE(calls[i].first, total);
+			if (i > 0)
+			{
+				EXPECT_GE(calls[i].first, calls[i - 1].first);
+			}
+		}
+	}
+
+	std::vector<std::pair<size_t, size_t>> calls;
+};
+
+TEST(test_progress, signature)
+{
+	const auto data = make_random_data(3 * rd::progress_interval + 123, 1);
+	const auto expected = rd::calculate_signature<const char*>(data.data(), data.size(), 1000);
+
+	progress_log pointer_log;
+	EXPECT_EQ(rd::calculate_signature<const char*>(data.data(), data.size(), 1000, rd::default_strong_hash_length, pointer_log.callback()), expected);
+	pointer_log.check(data.size());
+	EXPECT_GE(pointer_log.calls.size(), 4);
+
+	progress_log stream_log;
+	std::istringstream stream(std::string(data.data(), data.size()));
+	EXPECT_EQ(rd::calculate_signature(std::istreambuf_iterator<char>(stream), data.size(), 1000, rd::default_strong_hash_length, stream_log.callback()), expected);
+	stream_log.check(data.size());
+
+	progress_log parallel_log;
+	EXPECT_EQ(rd::calculate_signature_parallel(data.data(), data.size(), 1000, rd::default_strong_hash_length, 3, parallel_log.callback()), expected);
+	parallel_log.check(data.size());
+
+	const rd::cdc_parameters cdc{ 256, 1024, 4096 };
+	progress_log cdc_log;
+	const auto cdc_signature = rd::calculate_signature_cdc<const char*>(data.data(), data.size(), cdc, rd::default_strong_hash_length, cdc_log.callback());
+	cdc_log.check(data.size());
+	progress_log cdc_parallel_log;
+	EXPECT_EQ(rd::calculate_signature_cdc_parallel(data.data(), data.size(), cdc, rd::default_strong_hash_length, 3, cdc_parallel_log.callback()), cdc_signature);
+	cdc_parallel_log.check(data.size());
+}
+
+TEST(test_progress, delta_and_patch)
+{
+	const auto old_data = make_random_data(3 * rd::progress_interval + 123, 2);
+	auto new_data = old_data;
+	const auto changes = make_random_data(1000, 3);
+	for (size_t position = 0; position + 100 < new_data.size(); position += 500000)
+	{
+		std::copy_n(changes.begin(), 100, new_data.begin() + position);
+	}
+	const auto sig = rd::calculate_signature<const char*>(old_data.data(), old_data.size(), 1000);
+
+	progress_log delta_log;
+	rd::delta del;
+	rd::delta_builder builder(del);
+	rd::calculate_delta<const char*>(sig, new_data.data(), new_data.size(), builder, delta_log.callback());
+	delta_log.check(new_data.size());
+	EXPECT_GE(delta_log.calls.size(), 4);
+
+	progress_log parallel_log;
+	rd::delta parallel_del;
+	rd::delta_builder parallel_builder(parallel_del);
+	rd::calculate_delta_parallel(sig, new_data.data(), new_data.size(), parallel_builder, 3, 1 << 20, parallel_log.callback());
+	parallel_log.check(new_data.size());
+
+	progress_log patch_log;
+	std::vector<char> patched(del.data_length);
+	rd::patch<char*>(old_data.data(), del, patched.data(), patch_log.callback());
+	patch_log.check(new_data.size());
+	EXPECT_EQ(patched, new_data);
+
+	// without a callback nothing is reported and the results are the same
+	std::vector<char> patched_quietly(del.data_length);
+	rd::patch<char*>(old_data.data(), del, patched_quietly.data());
+	EXPECT_EQ(patched_quietly, new_data);
+}
@@ -0,0 +1,196 @@
+﻿#include <gtest/gtest.h>
+
+#include "tree.hpp"
+#include "test_data.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+
+namespace tree_test
+{
+	namespace fs = std::filesystem;
+
+	void write_file(const fs::path& file_name, size_t length, uint32_t seed)
+	{
+		fs::create_directories(file_name.parent_path());
+		std::ofstream(file_name, std::ios_base::binary) << make_random_data<std::string>(length, seed);
+	}
+
+	std::string read_file(const fs::path& file_name)
+	{
+		std::ifstream file(file_name, std::ios_base::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	/// <summary>
+	/// Relative paths and contents of all files of the tree
+	/// </summary>
+	std::vector<std::pair<std::string, std::string>> read_tree(const fs::path& root)
+	{
+		std::vector<std::pair<std::string, std::string>> result;
+		for (const auto& item : fs::recursive_directory_iterator(root))
+		{
+			if (item.is_regular_file())
+			{
+				result.emplace_back(item.path().lexically_relative(root).generic_string(), read_file(item.path()));
+			}
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	/// <summary>
+	/// Original tree and its modified copy in a temporary directory that is removed at the end
+	/// </summary>
+	struct test_trees
+	{
+		test_trees()
+		{
+			fs::remove_all(root);
+			for (uint32_t i = 0; i < 50; ++i)
+			{
+				write_file(old_tree / "small" / ("file" + std::to_string(i)), i * 97, i);
+			}
+			write_file(old_tree / "empty", 0, 0);
+			write_file(old_tree / "large" / "one", 300000, 100);
+			write_file(old_tree / "large" / "two", 200000, 101);
+			write_file(old_tree / "removed", 1000, 102);
+			fs::copy(old_tree, new_tree, fs::copy_options::recursive);
+			for (const auto& item : fs::recursive_directory_iterator(old_tree))
+			{
+				fs::last_write_time(new_tree / item.path().lexically_relative(old_tree), item.last_write_time());
+			}
+
+			// small change, large change, new and removed files, file with the same content and a different time
+			write_file(new_tree / "small" / "file7", 7 * 97 + 5, 7);
+			write_file(new_tree / "large" / "one", 300000, 100);
+			std::fstream large(new_tree / "large" / "one", std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+			large.seekp(150000);
+			large.write("changed", 7);
+			large.close();
+			write_file(new_tree / "added" / "file", 5000, 103);
+			fs::remove(new_tree / "removed");
+			fs::last_write_time(new_tree / "small" / "file3", fs::last_write_time(new_tree / "small" / "file3") + std::chrono::seconds(10));
+		}
+
+		~test_trees()
+		{
+			std::error_code error;
+			fs::remove_all(root, error);
+		}
+
+		const fs::path root{ fs::temp_directory_path() / "rolldiff_tree_test" };
+		const fs::path old_tree{ root / "old" };
+		const fs::path new_tree{ root / "new" };
+		const fs::path output_tree{ root / "output" };
+	};
+}
+
+TEST(test_tree, round_trip)
+{
+	tree_test::test_trees trees;
+
+	for (size_t num_threads : { 1, 3 })
+	{
+		rd::tree_options options;
+		options.num_threads = num_threads;
+		options.large_file_length = 100000;
+		if (num_threads > 1)
+		{
+			options.cdc = rd::cdc_parameters{ 64, 256, 1024 };
+		}
+
+		const auto signature_file = trees.root / "signatures";
+		std::ofstream signature_archive(signature_file, std::ios_base::binary);
+		const auto signature_stats = rd::signature_tree(trees.old_tree.string(), signature_archive, options);
+		signature_archive.close();
+		EXPECT_EQ(signature_stats.files, 54);
+
+		const rd::tree_archive signatures(signature_file.string(), rd::tree_format::signature_magic);
+		ASSERT_EQ(signatures.entries().size(), 54);
+		ASSERT_NE(signatures.find("large/one"), nullptr);
+		EXPECT_EQ(signatures.find("large/one")->file_size, 300000);
+		EXPECT_EQ(signatures.find("missing"), nullptr);
+
+		const auto delta_file = trees.root / "deltas";
+		std::ofstream delta_archive(delta_file, std::ios_base::binary);
+		const auto delta_stats = rd::delta_tree(signature_file.string(), trees.new_tree.string(), delta_archive, options);
+		delta_archive.close();
+		EXPECT_EQ(delta_stats.files, 55);
+		EXPECT_EQ(delta_stats.changed_files, 3);
+		EXPECT_EQ(delta_stats.removed_files, 1);
+		EXPECT_EQ(delta_stats.unchanged_files, 51);
+		// only the changed files and the file with a different time are read
+		EXPECT_EQ(delta_stats.bytes, (7 * 97 + 5) + 300000 + 5000 + 3 * 97);
+
+		const rd::tree_archive deltas(delta_file.string(), rd::tree_format::delta_magic);
+		ASSERT_NE(deltas.find("small/file3"), nullptr);
+		EXPECT_EQ(deltas.find("small/file3")->kind, rd::tree_format::unchanged_file);
+		EXPECT_EQ(deltas.find("removed")->kind, rd::tree_format::removed_file);
+		EXPECT_EQ(deltas.find("added/file")->kind, rd::tree_format::changed_file);
+		EXPECT_LT(deltas.find("large/one")->payload_length, 10000);
+
+		std::filesystem::remove_all(trees.output_tree);
+		const auto patch_stats = rd::patch_tree(trees.old_tree.string(), delta_file.string(), trees.output_tree.string(), options);
+		EXPECT_EQ(patch_stats.files, 55);
+		EXPECT_EQ(tree_test::read_tree(trees.output_tree), tree_test::read_tree(trees.new_tree));
+		EXPECT_EQ(std::filesystem::last_write_time(trees.output_tree / "small" / "file3"),
+			std::filesystem::last_write_time(trees.new_tree / "small" / "file3"));
+
+		// archives of different kinds are not mixed up
+		EXPECT_THROW(rd::tree_archive(signature_file.string(), rd::tree_format::delta_magic), std::runtime_error);
+	}
+}
+
+TEST(test_tree, paths_outside_of_tree_are_rejected)
+{
+	tree_test::test_trees trees;
+
+	const auto delta_file = trees.root / "deltas";
+	std::ofstream delta_archive(delta_file, std::ios_base::binary);
+	rd::tree_archive_writer writer(delta_archive, rd::tree_format::delta_magic);
+	rd::tree_entry entry;
+	entry.kind = rd::tree_format::unchanged_file;
+	entry.path = "../new/empty";
+	writer.add(entry, std::string());
+	writer.finish();
+	delta_archive.close();
+
+	EXPECT_THROW(rd::patch_tree(trees.old_tree.string(), delta_file.string(), trees.output_tree.string(), rd::tree_options{}), std::runtime_error);
+}
+
+TEST(test_tree, patch_checks_file_hashes)
+{
+	tree_test::test_trees trees;
+
+	const auto signature_file = trees.root / "signatures";
+	std::ofstream signature_archive(signature_file, std::ios_base::binary);
+	rd::signature_tree(trees.old_tree.string(), signature_archive, rd::tree_options{});
+	signature_archive.close();
+	const auto delta_file = trees.root / "deltas";
+	std::ofstream delta_archive(delta_file, std::ios_base::binary);
+	rd::delta_tree(signature_file.string(), trees.new_tree.string(), delta_archive, rd::tree_options{});
+	delta_archive.close();
+
+	// originals that changed after the signature was made give wrong files, both unchanged and patched ones are detected
+	for (const auto* path : { "small/file3", "large/one" })
+	{
+		const auto original_file = trees.old_tree / path;
+		const auto original = tree_test::read_file(original_file);
+		std::fstream modified(original_file, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		modified.write("modified", 8);
+		modified.close();
+
+		std::filesystem::remove_all(trees.output_tree);
+		EXPECT_THROW(rd::patch_tree(trees.old_tree.string(), delta_file.string(), trees.output_tree.string(), rd::tree_options{}), std::runtime_error);
+		std::ofstream(original_file, std::ios_base::binary | std::ios_base::trunc) << original;
+	}
+
+	std::filesystem::remove_all(trees.output_tree);
+	rd::patch_tree(trees.old_tree.string(), delta_file.string(), trees.output_tree.string(), rd::tree_options{});
+	EXPECT_EQ(tree_test::read_tree(trees.output_tree), tree_test::read_tree(trees.new_tree));
+}